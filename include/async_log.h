@@ -0,0 +1,216 @@
+/*******************************************************************************
+ *
+ *      async_log
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef ASYNC_LOG_H_
+#define ASYNC_LOG_H_
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+// log output that never blocks the calling thread on the terminal or disk
+// messages are formatted into a buffer owned by the calling thread; a background thread collects every buffer at least every
+// WRITE_INTERVAL_MS (sooner when one fills up) and writes them out. order is kept within a thread, not across threads
+// anything that writes to the same stream directly should call flush() first so the log doesn't land after it
+//
+// combine with the runtime levels in global_flags.h so arguments are only evaluated when the message is wanted:
+//   __DEBUG__NORMAL__ logPrintf( "genome %s\n", genome->toString().c_str() );
+class AsyncLog
+{
+public:
+	const static unsigned int WRITE_INTERVAL_MS = 50;
+	// wake the writer early once a thread has buffered this much
+	const static unsigned int BUFFER_SIZE = 64 * 1024;
+
+protected:
+	struct ThreadBuffer
+	{
+		std::mutex mutex_;
+		std::string text_;
+	};
+
+	std::mutex mutex_;
+	std::condition_variable wake_writer_;
+	std::condition_variable written_;
+	std::vector<ThreadBuffer *> thread_buffers_;
+	std::thread writer_;
+	bool stop_writer_;
+	unsigned long long flush_requests_;
+	unsigned long long flushes_done_;
+	FILE * file_;
+
+	AsyncLog() :
+		stop_writer_( false ), flush_requests_( 0 ), flushes_done_( 0 ), file_( stdout )
+	{
+		writer_ = std::thread( &AsyncLog::writerLoop, this );
+	}
+
+public:
+	~AsyncLog()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			stop_writer_ = true;
+		}
+		wake_writer_.notify_one();
+		writer_.join();
+		for ( unsigned int i = 0; i < thread_buffers_.size(); ++i )
+			delete thread_buffers_[i];
+	}
+
+	static AsyncLog & instance()
+	{
+		static AsyncLog async_log;
+		return async_log;
+	}
+
+	// everything logged before the call is written to the old stream first
+	void setFile( FILE * file )
+	{
+		flush();
+		std::lock_guard<std::mutex> lock( mutex_ );
+		file_ = file;
+	}
+
+	void write( const char * text, size_t length )
+	{
+		ThreadBuffer * buffer = threadBuffer();
+		bool wake = false;
+		{
+			std::lock_guard<std::mutex> lock( buffer->mutex_ );
+			buffer->text_.append( text, length );
+			wake = buffer->text_.size() >= BUFFER_SIZE;
+		}
+		if ( wake ) wake_writer_.notify_one();
+	}
+
+	void vprintf( const char * format, va_list args )
+	{
+		char text[512];
+		va_list args_copy;
+		va_copy( args_copy, args );
+		const int length = vsnprintf( text, sizeof( text ), format, args_copy );
+		va_end( args_copy );
+		if ( length < 0 ) return;
+		if ( (size_t) length < sizeof( text ) )
+		{
+			write( text, length );
+			return;
+		}
+
+		// long messages (e.g. whole genomes) are formatted straight into a string of the right size
+		std::string long_text( length + 1, '\0' );
+		vsnprintf( &long_text[0], long_text.size(), format, args );
+		write( long_text.c_str(), length );
+	}
+
+	// block until everything logged so far (by any thread) has been written
+	void flush()
+	{
+		std::unique_lock<std::mutex> lock( mutex_ );
+		const unsigned long long request = ++flush_requests_;
+		wake_writer_.notify_one();
+		written_.wait( lock, [this, request] { return flushes_done_ >= request; } );
+	}
+
+protected:
+	ThreadBuffer * threadBuffer()
+	{
+		static thread_local ThreadBuffer * thread_buffer = NULL;
+		if ( !thread_buffer )
+		{
+			thread_buffer = new ThreadBuffer();
+			thread_buffer->text_.reserve( BUFFER_SIZE );
+			std::lock_guard<std::mutex> lock( mutex_ );
+			thread_buffers_.push_back( thread_buffer );
+		}
+		return thread_buffer;
+	}
+
+	void writerLoop()
+	{
+		std::string text;
+		std::unique_lock<std::mutex> lock( mutex_ );
+		while ( true )
+		{
+			wake_writer_.wait_for( lock, std::chrono::milliseconds( WRITE_INTERVAL_MS ) );
+			const bool stopping = stop_writer_;
+			const unsigned long long flush_request = flush_requests_;
+			FILE * file = file_;
+
+			// each thread's buffer is swapped out whole; the thread only waits for that swap
+			for ( unsigned int i = 0; i < thread_buffers_.size(); ++i )
+			{
+				ThreadBuffer * buffer = thread_buffers_[i];
+				std::lock_guard<std::mutex> buffer_lock( buffer->mutex_ );
+				text.append( buffer->text_ );
+				buffer->text_.clear();
+			}
+
+			lock.unlock();
+			if ( !text.empty() )
+			{
+				fwrite( text.data(), 1, text.size(), file );
+				fflush( file );
+				text.clear();
+			}
+			lock.lock();
+
+			if ( flush_request > flushes_done_ )
+			{
+				flushes_done_ = flush_request;
+				written_.notify_all();
+			}
+			if ( stopping ) return;
+		}
+	}
+};
+
+inline void logPrintf( const char * format, ... ) __attribute__ ((format (printf, 1, 2)));
+
+inline void logPrintf( const char * format, ... )
+{
+	va_list args;
+	va_start( args, format );
+	AsyncLog::instance().vprintf( format, args );
+	va_end( args );
+}
+
+#endif /* ASYNC_LOG_H_ */
@@ -37,7 +37,6 @@
 #define AUDIO_GENEOME_H_
 
 #include "genetic_process.h"
-#include <AL/alut.h>
 
 namespace AudioGenomeDefs
 {
@@ -45,29 +44,53 @@ namespace AudioGenomeDefs
 	typedef double _FitnessType;
 	typedef unsigned int _SizeType;
 
-	template<class _KeyDataType>
-	static float getFrequency( const _KeyDataType & key )
+	// tempo, beat resolution and output rate used to turn FSM cycles and pitch indices into wave durations and frequencies
+	// everything that would otherwise need a pow() per note is precomputed when the configuration is created
+	struct Timing
 	{
-		return key <= 0 ? 1.0 : 440 * pow( 2, ( (float) key - 49 ) / 12 );
-	}
+	public:
+		const static int NUM_KEYS = 128;
 
-	static float getDurationFromCycles( const _SizeType & num_cycles, const _SizeType & cycles_per_second = 16 )
-	{
-		return (float) num_cycles / cycles_per_second;
-	}
+		float beats_per_minute_;
+		// beat resolution: how many cycles (genes) make up one beat
+		_SizeType cycles_per_beat_;
+		unsigned int sample_rate_;
+		// frequency of key 49 (A4)
+		float tuning_frequency_;
 
-	// 0 -> 1/16; 4 -> 1/1
-	template<class _DataType>
-	static float getDurationFromIndex( _DataType duration_index )
-	{
-		return 1 / pow( 2, 4 - duration_index );
-	}
+	protected:
+		double frames_per_cycle_;
+		float frequencies_[NUM_KEYS];
 
-	template<class _DataType>
-	static float getDurationFromCycles( _DataType num_cycles )
-	{
-		return (float) num_cycles / 16;
-	}
+	public:
+		// the defaults reproduce the original fixed timing of 16 cycles per second
+		Timing( float beats_per_minute = 60, _SizeType cycles_per_beat = 16, unsigned int sample_rate = 44100, float tuning_frequency = 440 ) :
+			beats_per_minute_( beats_per_minute ), cycles_per_beat_( cycles_per_beat ), sample_rate_( sample_rate ), tuning_frequency_( tuning_frequency )
+		{
+			frames_per_cycle_ = 60.0 * sample_rate_ / ( beats_per_minute_ * cycles_per_beat_ );
+			for ( int key = 0; key < NUM_KEYS; ++key )
+			{
+				frequencies_[key] = key <= 0 ? 1.0 : tuning_frequency_ * pow( 2, ( (float) key - 49 ) / 12 );
+			}
+		}
+
+		// duration of a note of num_cycles starting start_cycle cycles into the song, in whole output frames
+		// the note ends on the frame nearest its cumulative position, so consecutive notes never drift against the beat
+		// (rounding every note on its own would lose up to half a frame per note)
+		float getDurationFromCycles( unsigned long long start_cycle, _SizeType num_cycles ) const
+		{
+			const double start_frame = floor( start_cycle * frames_per_cycle_ + 0.5 );
+			const double end_frame = floor( ( start_cycle + num_cycles ) * frames_per_cycle_ + 0.5 );
+			return (float) ( end_frame - start_frame ) / sample_rate_;
+		}
+
+		float getFrequency( int key ) const
+		{
+			if ( key <= 0 ) return 1.0;
+			if ( key < NUM_KEYS ) return frequencies_[key];
+			return tuning_frequency_ * pow( 2, ( (float) key - 49 ) / 12 );
+		}
+	};
 
 	struct AudioGeneEncodings
 	{
@@ -84,6 +107,18 @@ namespace AudioGenomeDefs
 		const static _Storage pitch = 5;
 	};
 
+	// wave shapes; these are independent of any audio library so the evolutionary core never needs one
+	struct Waveform
+	{
+	public:
+		typedef int _Storage;
+		const static _Storage sine = 0;
+		const static _Storage square = 1;
+		const static _Storage sawtooth = 2;
+		const static _Storage whitenoise = 3;
+		const static _Storage impulse = 4;
+	};
+
 	struct AudioStateControl
 	{
 		typedef int _Storage;
@@ -107,12 +142,12 @@ namespace AudioGenomeDefs
 	struct WaveDescriptor
 	{
 		int type; //silent/active
-		ALenum wave_type;
+		Waveform::_Storage wave_type;
 		float frequency;
 		float phase;
 		float duration;
 
-		WaveDescriptor( int type_, ALenum wave_type_, float frequency_, float phase_, float duration_ )
+		WaveDescriptor( int type_, Waveform::_Storage wave_type_, float frequency_, float phase_, float duration_ )
 		{
 			type = type_;
 			wave_type = wave_type_;
@@ -137,7 +172,7 @@ namespace AudioGenomeDefs
 		int pitch_index;
 
 		float phase;
-		ALenum shape;
+		Waveform::_Storage shape;
 
 		WaveState()
 		{
@@ -148,7 +183,7 @@ namespace AudioGenomeDefs
 			pitch_index = 40;
 
 			phase = 0;
-			shape = ALUT_WAVEFORM_SINE;
+			shape = Waveform::sine;
 		}
 
 		std::string toString()
@@ -204,7 +239,6 @@ namespace AudioGenomeDefs
 
 		WaveFSM()
 		{
-			printf( "\n\n This should only print once!!\n\n" );
 			timer_counter = 0;
 			timer_max = 0;
 			timer_enabled = true;
@@ -316,7 +350,7 @@ namespace AudioGenomeDefs
 		// 0 -> wait 1; 4 -> wait 16
 		unsigned int getDuration( unsigned int duration_index_ )
 		{
-			return pow( 2, duration_index_ );
+			return 1u << duration_index_;
 		}
 	};
 }
@@ -405,20 +439,38 @@ public:
 	std::vector<_WaveDescriptor> wave_descriptors;
 	typedef typename std::vector<_WaveDescriptor>::iterator _WaveDescriptorIterator;
 
-	// we want to use the same WaveFSM object for all audio genes so that the song is continuous.
-	static AudioGenomeDefs::WaveFSM wave_fsm;
+	// tempo and sample rate used when decoding; set this before evaluating any genomes
+	static AudioGenomeDefs::Timing timing;
 	AudioGenome( Descriptor descriptor, _ChromosomeVector chromosomes = _ChromosomeVector() ) :
 		_GenomeBase( descriptor, chromosomes )
 	{
 		//
 	}
 
+	// every genome is decoded from a fresh state machine, so its fitness only depends on its genes: not on the genomes
+	// evaluated before it, the number of evaluation threads or whether the run was resumed from a checkpoint
 	_FitnessType calculateFitness()
+	{
+		AudioGenomeDefs::WaveFSM fsm;
+		return decode( fsm );
+	}
+
+	// rebuild wave_descriptors (and the fitness) by running every gene through the given state machine
+	// use a fresh WaveFSM to decode a genome on its own (e.g. from several threads at once)
+	_FitnessType decode( AudioGenomeDefs::WaveFSM & fsm )
+	{
+		return decode( fsm, timing );
+	}
+
+	_FitnessType decode( AudioGenomeDefs::WaveFSM & fsm, const AudioGenomeDefs::Timing & timing_ )
 	{
 		// printf( "calculateFitness in AudioGenome\n" );
+		MemoryScope memory_scope( MemorySubsystem::wave_descriptors );
 		wave_descriptors.clear();// = std::vector<WaveDescriptor>();
 		// printf( "wave descriptors size: %zu\n", wave_descriptors.size() );
 		fitness_ = 1;
+		// cycles covered by the notes so far
+		unsigned long long song_cycles = 0;
 
 		for ( _ChromosomeIterator chromosome_it = begin(); chromosome_it != end(); ++chromosome_it )
 		{
@@ -430,20 +482,21 @@ public:
 			for ( _GeneIterator gene_it = current_chromosome->begin(); gene_it != current_chromosome->end(); ++gene_it )
 			{
 				_GenePtr current_gene = *gene_it;
-				int type = wave_fsm.update( current_gene->data_ );
+				int type = fsm.update( current_gene->data_ );
 
 				if ( type != 0 )
 				{
-					const float duration = AudioGenomeDefs::getDurationFromCycles( wave_fsm.last_note_duration );
-					const float frequency = type == 1 ? AudioGenomeDefs::getFrequency( wave_fsm.last_state.pitch_index ) : type == 2 ? 8 : 0;
+					const float duration = timing_.getDurationFromCycles( song_cycles, fsm.last_note_duration );
+					song_cycles += fsm.last_note_duration;
+					const float frequency = type == 1 ? timing_.getFrequency( fsm.last_state.pitch_index ) : type == 2 ? 8 : 0;
 
-					wave_descriptors.push_back( _WaveDescriptor( type, wave_fsm.last_state.shape, frequency, wave_fsm.last_state.phase, duration ) );
+					wave_descriptors.push_back( _WaveDescriptor( type, fsm.last_state.shape, frequency, fsm.last_state.phase, duration ) );
 
 					// we want as many beats (and therefore as little silence) as possible
 					// so give a positive reward for non-silent notes
 					// and a negative reward for silent notes
-					if ( type == 1 ) fitness_ += wave_fsm.last_note_duration;
-					if ( type == 2 ) fitness_ -= wave_fsm.last_note_duration;
+					if ( type == 1 ) fitness_ += fsm.last_note_duration;
+					if ( type == 2 ) fitness_ -= fsm.last_note_duration;
 				}
 			}
 		}
@@ -453,10 +506,44 @@ public:
 		return fitness_;
 	}
 
+	// number of values behaviour() describes a genome with
+	const static unsigned int BEHAVIOUR_SIZE = 16;
+
+	// a fixed-size summary of what the genome sounds like, for comparing genomes by behaviour rather than by genes: the melodic
+	// contour, i.e. the pitch (log2 of the frequency) sounding at BEHAVIOUR_SIZE evenly spaced points of the song, 0 where it's
+	// silent. only valid after the genome has been decoded
+	void behaviour( float * values ) const
+	{
+		float song_duration = 0;
+		for ( typename std::vector<_WaveDescriptor>::const_iterator wave_it = wave_descriptors.begin(); wave_it != wave_descriptors.end(); ++wave_it )
+		{
+			song_duration += wave_it->duration;
+		}
+
+		typename std::vector<_WaveDescriptor>::const_iterator wave_it = wave_descriptors.begin();
+		float wave_end = wave_it != wave_descriptors.end() ? wave_it->duration : 0;
+		for ( unsigned int i = 0; i < BEHAVIOUR_SIZE; ++i )
+		{
+			const float time = song_duration * ( i + 0.5f ) / BEHAVIOUR_SIZE;
+			while ( wave_it != wave_descriptors.end() && wave_end <= time && wave_it + 1 != wave_descriptors.end() )
+			{
+				++wave_it;
+				wave_end += wave_it->duration;
+			}
+			values[i] = wave_it != wave_descriptors.end() && wave_it->type == 1 && wave_it->frequency > 0 ? log2f( wave_it->frequency ) : 0;
+		}
+	}
+
 	AudioGenome * copy( _SizeType start = 0, _SizeType copy_length = 0 )
 	{
-		// make a full copy of this genome's chromosomes using the base class's copy function
-		AudioGenome * new_genome = new AudioGenome( descriptor_, _GenomeBase::copy( start, copy_length )->chromosomes() );
+		// make a full copy of this genome's chromosomes using the base class's copy function, then take them over
+		_GenomeBase * base_copy = _GenomeBase::copy( start, copy_length );
+		AudioGenome * new_genome;
+		{
+			MemoryScope memory_scope( MemorySubsystem::genomes );
+			new_genome = new AudioGenome( descriptor_, base_copy->releaseChromosomes() );
+		}
+		delete base_copy;
 		return new_genome;
 	}
 };
@@ -0,0 +1,235 @@
+/*******************************************************************************
+ *
+ *      audio_mixer
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef AUDIO_MIXER_H_
+#define AUDIO_MIXER_H_
+
+#include <vector>
+#include <math.h>
+#include "wave_renderer.h"
+
+// plays several voices (each a sequence of WaveDescriptors, e.g. one genome) at once into a single mono or stereo stream
+// voices are rendered, panned and summed in blocks; a peak limiter keeps the sum from clipping
+class AudioMixer
+{
+public:
+	typedef WaveRenderer::_SampleType _SampleType;
+	typedef AudioGenomeDefs::WaveDescriptor _WaveDescriptor;
+	typedef std::vector<_WaveDescriptor> _WaveDescriptorVector;
+
+	struct Descriptor
+	{
+	public:
+		unsigned int num_channels_;
+		float master_gain_;
+		// the limiter never lets a sample exceed this level
+		float limiter_threshold_;
+		// how quickly the limiter lets go after a peak
+		float limiter_release_ms_;
+		// used by every voice; the amplitude should leave headroom for the sum of all voices
+		WaveRenderer::Descriptor voice_descriptor_;
+
+		Descriptor( unsigned int num_channels = 2, WaveRenderer::Descriptor voice_descriptor = WaveRenderer::Descriptor(), float master_gain = 1, float limiter_threshold = 0.95,
+				float limiter_release_ms = 50 ) :
+			num_channels_( num_channels ), master_gain_( master_gain ), limiter_threshold_( limiter_threshold ), limiter_release_ms_( limiter_release_ms ), voice_descriptor_( voice_descriptor )
+		{
+			//
+		}
+	};
+
+	const static unsigned int BLOCK_SIZE = WaveRenderer::BLOCK_SIZE;
+
+protected:
+	struct Voice
+	{
+		WaveRenderer renderer_;
+		_WaveDescriptorVector waves_;
+		unsigned int next_wave_;
+		float left_gain_;
+		float right_gain_;
+
+		Voice( const WaveRenderer::Descriptor & descriptor, const _WaveDescriptorVector & waves, float left_gain, float right_gain ) :
+			renderer_( descriptor ), waves_( waves ), next_wave_( 0 ), left_gain_( left_gain ), right_gain_( right_gain )
+		{
+			//
+		}
+
+		// fill the block with this voice's next samples; returns the number of frames written before the voice ran out
+		unsigned int render( float * samples, unsigned int block_size )
+		{
+			unsigned int num_frames = 0;
+			while ( num_frames < block_size )
+			{
+				const unsigned int rendered = renderer_.renderBlock( samples + num_frames, block_size - num_frames );
+				num_frames += rendered;
+				if ( rendered > 0 ) continue;
+				if ( next_wave_ >= waves_.size() ) break;
+				renderer_.begin( waves_[next_wave_++] );
+			}
+			return num_frames;
+		}
+	};
+
+	Descriptor descriptor_;
+	std::vector<Voice *> voices_;
+	float limiter_gain_;
+	float limiter_release_coefficient_;
+
+	float voice_block_[BLOCK_SIZE];
+	float left_block_[BLOCK_SIZE];
+	float right_block_[BLOCK_SIZE];
+
+public:
+	AudioMixer( Descriptor descriptor = Descriptor() ) :
+		descriptor_( descriptor ), limiter_gain_( 1 )
+	{
+		if ( descriptor_.num_channels_ < 1 ) descriptor_.num_channels_ = 1;
+		if ( descriptor_.num_channels_ > 2 ) descriptor_.num_channels_ = 2;
+		limiter_release_coefficient_ = exp( -1000 / ( descriptor_.limiter_release_ms_ * descriptor_.voice_descriptor_.sample_rate_ ) );
+	}
+
+	virtual ~AudioMixer()
+	{
+		clear();
+	}
+
+	const Descriptor & descriptor() const
+	{
+		return descriptor_;
+	}
+
+	// pan in [-1,1] (left to right); equal-power panning keeps the loudness constant across the field
+	void addVoice( const _WaveDescriptorVector & waves, float gain = 1, float pan = 0 )
+	{
+		const float angle = ( pan + 1 ) * M_PI / 4;
+		const float left_gain = descriptor_.num_channels_ == 2 ? gain * cos( angle ) : gain;
+		const float right_gain = descriptor_.num_channels_ == 2 ? gain * sin( angle ) : 0;
+		MemoryScope memory_scope( MemorySubsystem::audio_buffers );
+		voices_.push_back( new Voice( descriptor_.voice_descriptor_, waves, left_gain, right_gain ) );
+	}
+
+	unsigned int numVoices() const
+	{
+		return voices_.size();
+	}
+
+	void clear()
+	{
+		for ( typename std::vector<Voice *>::iterator it = voices_.begin(); it != voices_.end(); ++it )
+		{
+			delete *it;
+		}
+		voices_.clear();
+	}
+
+	// mix up to max_frames interleaved frames of all voices; voices that finish are dropped
+	// returns the number of frames written (0 once every voice has finished)
+	unsigned int mix( _SampleType * samples, unsigned int max_frames )
+	{
+		unsigned int total_frames = 0;
+		while ( total_frames < max_frames && !voices_.empty() )
+		{
+			const unsigned int block_size = max_frames - total_frames < BLOCK_SIZE ? max_frames - total_frames : BLOCK_SIZE;
+			const unsigned int num_frames = mixBlock( block_size );
+			if ( num_frames == 0 ) break;
+			limitBlock( samples + total_frames * descriptor_.num_channels_, num_frames );
+			total_frames += num_frames;
+		}
+		return total_frames;
+	}
+
+protected:
+	// sum one block of every voice into left_block_/right_block_; returns the length of the longest voice in this block
+	unsigned int mixBlock( unsigned int block_size )
+	{
+		memset( left_block_, 0, sizeof( left_block_ ) );
+		memset( right_block_, 0, sizeof( right_block_ ) );
+
+		unsigned int num_frames = 0;
+		for ( typename std::vector<Voice *>::iterator it = voices_.begin(); it != voices_.end(); )
+		{
+			Voice * voice = *it;
+			const unsigned int rendered = voice->render( voice_block_, block_size );
+
+			const float left_gain = voice->left_gain_, right_gain = voice->right_gain_;
+			float * __restrict left = left_block_;
+			float * __restrict right = right_block_;
+			const float * __restrict in = voice_block_;
+			for ( unsigned int i = 0; i < rendered; ++i )
+			{
+				left[i] += left_gain * in[i];
+				right[i] += right_gain * in[i];
+			}
+
+			if ( rendered > num_frames ) num_frames = rendered;
+			if ( rendered < block_size )
+			{
+				delete voice;
+				it = voices_.erase( it );
+			}
+			else ++it;
+		}
+		return num_frames;
+	}
+
+	// apply the master gain and limiter, then convert to interleaved 16-bit samples
+	// the limiter reacts instantly to peaks above the threshold and recovers exponentially
+	void limitBlock( _SampleType * samples, unsigned int num_frames )
+	{
+		const float master_gain = descriptor_.master_gain_, threshold = descriptor_.limiter_threshold_, release = limiter_release_coefficient_;
+		const bool stereo = descriptor_.num_channels_ == 2;
+		float gain = limiter_gain_;
+
+		for ( unsigned int i = 0; i < num_frames; ++i )
+		{
+			const float left = master_gain * left_block_[i], right = master_gain * right_block_[i];
+			const float peak = stereo && fabs( right ) > fabs( left ) ? fabs( right ) : fabs( left );
+
+			const float target = peak > threshold ? threshold / peak : 1;
+			gain = target < gain ? target : target - ( target - gain ) * release;
+
+			if ( stereo )
+			{
+				samples[2 * i] = (_SampleType) ( 32767 * gain * left );
+				samples[2 * i + 1] = (_SampleType) ( 32767 * gain * right );
+			}
+			else samples[i] = (_SampleType) ( 32767 * gain * left );
+		}
+
+		limiter_gain_ = gain;
+	}
+};
+
+#endif /* AUDIO_MIXER_H_ */
@@ -0,0 +1,233 @@
+/*******************************************************************************
+ *
+ *      audio_output
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef AUDIO_OUTPUT_H_
+#define AUDIO_OUTPUT_H_
+
+#include <string>
+#include "wav_writer.h"
+
+struct AudioFormat
+{
+public:
+	unsigned int sample_rate_;
+	unsigned int num_channels_;
+
+	AudioFormat( unsigned int sample_rate = 44100, unsigned int num_channels = 1 ) :
+		sample_rate_( sample_rate ), num_channels_( num_channels )
+	{
+		//
+	}
+};
+
+// somewhere rendered audio can be sent; backends decide whether that means a sound device, a file or nowhere at all
+// buffers are played in the order they're queued; update() reports how many of them have finished since the last call
+class AudioOutput
+{
+public:
+	typedef short _SampleType;
+
+protected:
+	AudioFormat format_;
+	unsigned long num_frames_queued_;
+	unsigned long num_buffers_queued_;
+	unsigned long num_underruns_;
+
+public:
+	AudioOutput() :
+		num_frames_queued_( 0 ), num_buffers_queued_( 0 ), num_underruns_( 0 )
+	{
+		//
+	}
+
+	virtual ~AudioOutput()
+	{
+		//
+	}
+
+	virtual bool open( const AudioFormat & format )
+	{
+		format_ = format;
+		num_frames_queued_ = 0;
+		num_buffers_queued_ = 0;
+		num_underruns_ = 0;
+		return true;
+	}
+
+	virtual void close()
+	{
+		//
+	}
+
+	// queue one buffer of interleaved samples; num_frames is the number of samples per channel
+	virtual bool queueBuffer( const _SampleType * samples, unsigned int num_frames )
+	{
+		num_frames_queued_ += num_frames;
+		++num_buffers_queued_;
+		return true;
+	}
+
+	// returns the number of buffers that finished playing since the last call
+	virtual unsigned int update() = 0;
+
+	// number of buffers queued but not yet reported as finished by update()
+	virtual unsigned int numQueuedBuffers() const = 0;
+
+	// real-time outputs consume audio at the sample rate; everything else consumes it as fast as it's queued
+	virtual bool isRealTime() const
+	{
+		return false;
+	}
+
+	virtual std::string name() const = 0;
+
+	const AudioFormat & format() const
+	{
+		return format_;
+	}
+
+	unsigned long numFramesQueued() const
+	{
+		return num_frames_queued_;
+	}
+
+	unsigned long numBuffersQueued() const
+	{
+		return num_buffers_queued_;
+	}
+
+	// number of times playback ran out of audio since open(); only real-time outputs can underrun
+	unsigned long numUnderruns() const
+	{
+		return num_underruns_;
+	}
+
+	// total audio time queued since open(), in seconds
+	double secondsQueued() const
+	{
+		return format_.sample_rate_ > 0 ? (double) num_frames_queued_ / format_.sample_rate_ : 0;
+	}
+};
+
+// discards all audio immediately; used to measure the throughput of everything up to the output
+class NullAudioOutput : public AudioOutput
+{
+protected:
+	unsigned int num_unreported_buffers_;
+
+public:
+	NullAudioOutput() :
+		num_unreported_buffers_( 0 )
+	{
+		//
+	}
+
+	bool open( const AudioFormat & format )
+	{
+		num_unreported_buffers_ = 0;
+		return AudioOutput::open( format );
+	}
+
+	bool queueBuffer( const _SampleType * samples, unsigned int num_frames )
+	{
+		++num_unreported_buffers_;
+		return AudioOutput::queueBuffer( samples, num_frames );
+	}
+
+	unsigned int update()
+	{
+		const unsigned int result = num_unreported_buffers_;
+		num_unreported_buffers_ = 0;
+		return result;
+	}
+
+	unsigned int numQueuedBuffers() const
+	{
+		return num_unreported_buffers_;
+	}
+
+	std::string name() const
+	{
+		return "null";
+	}
+};
+
+// streams all audio into a WAV file as it's queued
+class WavFileAudioOutput : public NullAudioOutput
+{
+protected:
+	std::string filename_;
+	WavWriter writer_;
+
+public:
+	WavFileAudioOutput( const std::string & filename ) :
+		filename_( filename )
+	{
+		//
+	}
+
+	~WavFileAudioOutput()
+	{
+		close();
+	}
+
+	bool open( const AudioFormat & format )
+	{
+		if ( !writer_.open( filename_, format.sample_rate_, format.num_channels_ ) )
+		{
+			fprintf( stderr, "Failed to open %s for writing\n", filename_.c_str() );
+			return false;
+		}
+		return NullAudioOutput::open( format );
+	}
+
+	void close()
+	{
+		if ( !writer_.close() ) fprintf( stderr, "Failed to finish writing %s\n", filename_.c_str() );
+	}
+
+	bool queueBuffer( const _SampleType * samples, unsigned int num_frames )
+	{
+		if ( !writer_.write( samples, num_frames ) ) return false;
+		return NullAudioOutput::queueBuffer( samples, num_frames );
+	}
+
+	std::string name() const
+	{
+		return "wav:" + filename_;
+	}
+};
+
+#endif /* AUDIO_OUTPUT_H_ */
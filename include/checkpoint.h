@@ -0,0 +1,361 @@
+/*******************************************************************************
+ *
+ *      checkpoint
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "genetic_process.h"
+#include "genome_archive.h"
+#include "worker_pool.h"
+
+/*
+ * Population checkpoint
+ *
+ * header (256 bytes):
+ *   char[8]  magic "CSCHKPNT"
+ *   uint32   version
+ *   uint32   gene size in bytes (sizeof( _DataType ))
+ *   uint32   chromosomes per genome
+ *   uint32   genes per chromosome
+ *   uint32   population size
+ *   uint32   evaluation threads
+ *   double   mutation rate
+ *   int64    random seed
+ *   uint64   generation
+ *   uint64[4] random number generator state
+ *   uint32   population evaluated (0/1)
+ *   double   total fitness, total fitness proportion, min, max, avg
+ *   (zero padding)
+ * records: the genome archive record layout, one per individual in population order
+ *   double      fitness
+ *   _DataType[] genes, chromosome by chromosome
+ *
+ * all values are stored in host byte order. files are written next to the target and renamed into place, so a crash while
+ * writing never leaves a broken checkpoint behind
+ *
+ * a genome's fitness only depends on its genes (every AudioGenome is decoded from a fresh WaveFSM), so the genes, the fitness
+ * and the random state are all a resumed run needs to continue exactly like an uninterrupted one. the state of evaluation
+ * listeners (e.g. the novelty archive or the hall of fame) isn't saved: runs that use them start those afresh on resume
+ */
+namespace CheckpointDefs
+{
+	const static char MAGIC[8] = { 'C', 'S', 'C', 'H', 'K', 'P', 'N', 'T' };
+	const static unsigned int VERSION = 1;
+	const static unsigned int HEADER_SIZE = 256;
+
+	struct Header
+	{
+		char magic_[8];
+		unsigned int version_;
+		unsigned int gene_size_;
+		unsigned int genome_size_;
+		unsigned int chromosome_size_;
+		unsigned int population_size_;
+		unsigned int num_threads_;
+		double mutation_rate_;
+		long long random_seed_;
+		unsigned long long generation_;
+		unsigned long long random_state_[4];
+		unsigned int population_evaluated_;
+		unsigned int reserved_;
+		double total_fitness_;
+		double total_fitness_proportion_;
+		double min_fitness_;
+		double max_fitness_;
+		double avg_fitness_;
+	};
+
+	static_assert( sizeof( Header ) <= HEADER_SIZE, "checkpoint header does not fit its reserved space" );
+}
+
+// writes checkpoints of a GeneticProcess in the background
+// write() snapshots the population into one packed buffer on the calling thread (no Genome objects are copied) and hands it to
+// a writer thread; only one checkpoint is in flight at a time, so a second write() waits for the previous one to finish
+template<class _GeneticProcessType>
+class CheckpointWriter
+{
+public:
+	typedef _GeneticProcessType _GeneticProcess;
+	typedef typename _GeneticProcess::_Genome _Genome;
+	typedef typename _GeneticProcess::_DataType _DataType;
+	typedef typename _GeneticProcess::_PopulationVector _PopulationVector;
+
+protected:
+	std::thread writer_;
+	std::vector<char> buffer_;
+	std::string filename_;
+	bool success_;
+
+public:
+	CheckpointWriter() :
+		success_( true )
+	{
+		//
+	}
+
+	virtual ~CheckpointWriter()
+	{
+		wait();
+	}
+
+	// snapshot the process now and write it to filename in the background
+	void write( const _GeneticProcess & process, const std::string & filename )
+	{
+		wait();
+		ScopedTrace trace( "checkpoint snapshot", "checkpoint" );
+
+		const _PopulationVector & population = process.population();
+		const typename _GeneticProcess::Descriptor & descriptor = process.descriptor();
+		const unsigned int genes_per_genome = descriptor.genome_descriptor_.size_ * descriptor.genome_descriptor_.chromosome_descriptor_.size_;
+		const size_t record_size = sizeof( double ) + genes_per_genome * sizeof( _DataType );
+
+		buffer_.assign( CheckpointDefs::HEADER_SIZE + population.size() * record_size, 0 );
+
+		CheckpointDefs::Header & header = *(CheckpointDefs::Header *) &buffer_[0];
+		memcpy( header.magic_, CheckpointDefs::MAGIC, sizeof( header.magic_ ) );
+		header.version_ = CheckpointDefs::VERSION;
+		header.gene_size_ = sizeof( _DataType );
+		header.genome_size_ = descriptor.genome_descriptor_.size_;
+		header.chromosome_size_ = descriptor.genome_descriptor_.chromosome_descriptor_.size_;
+		header.population_size_ = population.size();
+		header.num_threads_ = descriptor.num_threads_;
+		header.mutation_rate_ = descriptor.mutation_rate_;
+		header.random_seed_ = descriptor.random_seed_;
+		header.generation_ = process.generation();
+		memcpy( header.random_state_, GeneticProcessUtil::randomState().s_, sizeof( header.random_state_ ) );
+		header.population_evaluated_ = process.populationEvaluated();
+		const typename _GeneticProcess::PopulationStatistics & stats = process.populationStatistics();
+		if ( header.population_evaluated_ )
+		{
+			header.total_fitness_ = stats.total_fitness_;
+			header.total_fitness_proportion_ = stats.total_fitness_proportion_;
+			header.min_fitness_ = stats.min_fitness_;
+			header.max_fitness_ = stats.max_fitness_;
+			header.avg_fitness_ = stats.avg_fitness_;
+		}
+
+		char * record = &buffer_[CheckpointDefs::HEADER_SIZE];
+		for ( size_t i = 0; i < population.size(); ++i, record += record_size )
+		{
+			const double fitness = population[i]->fitness();
+			memcpy( record, &fitness, sizeof( fitness ) );
+			GenomeArchiveDefs::packGenome( population[i], (_DataType *) ( record + sizeof( double ) ) );
+		}
+
+		filename_ = filename;
+		writer_ = std::thread( &CheckpointWriter::writeBuffer, this );
+	}
+
+	// wait for the checkpoint in flight (if any); returns whether the last checkpoint was written successfully
+	bool wait()
+	{
+		if ( writer_.joinable() ) writer_.join();
+		return success_;
+	}
+
+protected:
+	void writeBuffer()
+	{
+		TraceLog::instance().setThreadName( "checkpoint writer" );
+		ScopedTrace trace( "checkpoint write", "checkpoint", "bytes", buffer_.size() );
+
+		const std::string temp_filename = filename_ + ".tmp";
+		FILE * file = fopen( temp_filename.c_str(), "wb" );
+		success_ = file != NULL;
+		if ( success_ ) success_ = fwrite( &buffer_[0], 1, buffer_.size(), file ) == buffer_.size();
+		if ( success_ ) success_ = fflush( file ) == 0 && fsync( fileno( file ) ) == 0;
+		if ( file ) fclose( file );
+		if ( success_ ) success_ = rename( temp_filename.c_str(), filename_.c_str() ) == 0;
+		if ( !success_ )
+		{
+			fprintf( stderr, "Failed to write checkpoint %s\n", filename_.c_str() );
+			unlink( temp_filename.c_str() );
+		}
+		// the snapshot can be large; don't keep it around until the next checkpoint
+		std::vector<char>().swap( buffer_ );
+	}
+};
+
+// memory-maps a checkpoint and restores a GeneticProcess from it
+// genomes are unpacked straight from the mapping with their stored fitness, then GeneticProcess::restore() decodes an
+// evaluated population again (on the process's worker pool) to rebuild what they derive from their genes
+template<class _GeneticProcessType>
+class CheckpointReader
+{
+public:
+	typedef _GeneticProcessType _GeneticProcess;
+	typedef typename _GeneticProcess::_Genome _Genome;
+	typedef typename _GeneticProcess::_GenomePtr _GenomePtr;
+	typedef typename _GeneticProcess::_DataType _DataType;
+	typedef typename _GeneticProcess::_PopulationVector _PopulationVector;
+	typedef typename _Genome::_Chromosome _Chromosome;
+
+protected:
+	int fd_;
+	const char * data_;
+	size_t size_;
+	const CheckpointDefs::Header * header_;
+	size_t record_size_;
+
+public:
+	CheckpointReader() :
+		fd_( -1 ), data_( NULL ), size_( 0 ), header_( NULL ), record_size_( 0 )
+	{
+		//
+	}
+
+	virtual ~CheckpointReader()
+	{
+		close();
+	}
+
+	bool open( const std::string & filename )
+	{
+		close();
+		fd_ = ::open( filename.c_str(), O_RDONLY );
+		if ( fd_ < 0 ) return false;
+
+		struct stat file_stat;
+		if ( fstat( fd_, &file_stat ) != 0 || (size_t) file_stat.st_size < CheckpointDefs::HEADER_SIZE )
+		{
+			close();
+			return false;
+		}
+
+		size_ = file_stat.st_size;
+		void * mapping = mmap( NULL, size_, PROT_READ, MAP_SHARED, fd_, 0 );
+		if ( mapping == MAP_FAILED )
+		{
+			close();
+			return false;
+		}
+		data_ = (const char *) mapping;
+		header_ = (const CheckpointDefs::Header *) data_;
+
+		if ( memcmp( header_->magic_, CheckpointDefs::MAGIC, sizeof( header_->magic_ ) ) != 0 || header_->version_ != CheckpointDefs::VERSION || header_->gene_size_ != sizeof( _DataType ) )
+		{
+			fprintf( stderr, "%s is not a compatible checkpoint\n", filename.c_str() );
+			close();
+			return false;
+		}
+
+		record_size_ = sizeof( double ) + (size_t) header_->genome_size_ * header_->chromosome_size_ * sizeof( _DataType );
+		if ( CheckpointDefs::HEADER_SIZE + header_->population_size_ * record_size_ > size_ )
+		{
+			fprintf( stderr, "%s is truncated\n", filename.c_str() );
+			close();
+			return false;
+		}
+
+		madvise( mapping, size_, MADV_WILLNEED );
+		return true;
+	}
+
+	void close()
+	{
+		if ( data_ ) munmap( (void *) data_, size_ );
+		if ( fd_ >= 0 ) ::close( fd_ );
+		fd_ = -1;
+		data_ = NULL;
+		header_ = NULL;
+		size_ = 0;
+	}
+
+	bool isOpen() const
+	{
+		return data_ != NULL;
+	}
+
+	const CheckpointDefs::Header & header() const
+	{
+		return *header_;
+	}
+
+	// the descriptor the checkpointed process was created with
+	typename _GeneticProcess::Descriptor descriptor() const
+	{
+		return typename _GeneticProcess::Descriptor( header_->population_size_, header_->mutation_rate_, header_->random_seed_, typename _Genome::Descriptor( header_->genome_size_,
+				typename _Chromosome::Descriptor( header_->chromosome_size_ ) ), header_->num_threads_ );
+	}
+
+	// replace the process's population, statistics, generation and random number generator state with the checkpoint's
+	// num_threads extra threads share the unpacking (each gene is its own allocation, so the allocator limits how much that helps)
+	void restore( _GeneticProcess & process, unsigned int num_threads = 0 ) const
+	{
+		ScopedTrace trace( "checkpoint restore", "checkpoint", "individuals", header_->population_size_ );
+
+		const typename _Genome::Descriptor genome_descriptor( header_->genome_size_, typename _Chromosome::Descriptor( header_->chromosome_size_ ) );
+		_PopulationVector population( header_->population_size_ );
+
+		// rebuild in chunks so each task is worth handing to a thread
+		const unsigned int chunk_size = 1024;
+		const unsigned int num_chunks = ( header_->population_size_ + chunk_size - 1 ) / chunk_size;
+		WorkerPool pool( num_threads );
+		pool.run( num_chunks, [&]( unsigned int chunk, unsigned int )
+		{
+			MemoryScope memory_scope( MemorySubsystem::genomes );
+			const unsigned int end = std::min( ( chunk + 1 ) * chunk_size, header_->population_size_ );
+			for ( unsigned int i = chunk * chunk_size; i < end; ++i )
+			{
+				const char * record = data_ + CheckpointDefs::HEADER_SIZE + i * record_size_;
+				double fitness;
+				memcpy( &fitness, record, sizeof( fitness ) );
+				population[i] = GenomeArchiveDefs::unpackGenome<_Genome>( genome_descriptor, (const _DataType *) ( record + sizeof( double ) ) );
+				population[i]->setFitness( fitness );
+			}
+		} );
+
+		typename _GeneticProcess::PopulationStatistics stats;
+		stats.total_fitness_ = header_->total_fitness_;
+		stats.total_fitness_proportion_ = header_->total_fitness_proportion_;
+		stats.min_fitness_ = header_->min_fitness_;
+		stats.max_fitness_ = header_->max_fitness_;
+		stats.avg_fitness_ = header_->avg_fitness_;
+
+		process.restore( header_->generation_, population, stats, header_->population_evaluated_ != 0 );
+		memcpy( GeneticProcessUtil::randomState().s_, header_->random_state_, sizeof( header_->random_state_ ) );
+	}
+};
+
+#endif /* CHECKPOINT_H_ */
@@ -0,0 +1,382 @@
+/*******************************************************************************
+ *
+ *      fitness_sharing
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef FITNESS_SHARING_H_
+#define FITNESS_SHARING_H_
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+#include "genetic_process.h"
+#include "genome_archive.h"
+#include "worker_pool.h"
+
+// fitness sharing: individuals split their fitness with the genomes around them, so a crowded niche is worth less than a
+// sparse one and the population can hold several "species" instead of converging on one
+//
+// the distance between two genomes is the fraction of gene positions that differ. an individual's niche count is
+//   sum over the population of 1 - ( distance / radius_ ) ^ alpha_ for every genome closer than radius_
+// (itself included) and its fitness becomes min + ( fitness - min ) / niche count, min being the population's lowest fitness,
+// so negative fitness values are shared the same way as positive ones
+//
+// comparing every pair is quadratic in the population size. instead each of num_tables_ hash tables buckets the population
+// by the genes at positions_per_table_ distinct positions drawn afresh every generation (bit sampling, the locality-sensitive
+// hash for Hamming distance), and an individual is only compared with the genomes in its buckets. a genome with d of the n
+// genes different lands in the individual's bucket with a probability p(d) that only depends on d, so every table gives an
+// unbiased estimate of the niche count by weighing each genome it finds by 1 / p(d); the tables' estimates are averaged.
+// buckets bigger than max_bucket_scan_ (a converged population) are sampled and the sample weighted up, which keeps the cost
+// linear in the population size. more tables lower the variance, more positions make buckets smaller and cheaper but the
+// weights (and so the variance) larger. with num_tables_ = 0 every pair is compared, for reference
+//
+// add it to a GeneticProcess with addEvaluationListener()
+template<class _GeneticProcessType>
+class FitnessSharing: public _GeneticProcessType::EvaluationListener
+{
+public:
+	typedef _GeneticProcessType _GeneticProcess;
+	typedef typename _GeneticProcess::_Genome _Genome;
+	typedef typename _GeneticProcess::_GenomePtr _GenomePtr;
+	typedef typename _GeneticProcess::_DataType _DataType;
+	typedef typename _GeneticProcess::_FitnessType _FitnessType;
+	typedef typename _GeneticProcess::_PopulationVector _PopulationVector;
+
+	struct Descriptor
+	{
+		// genomes closer than this fraction of differing genes share fitness
+		double radius_;
+		// shape of the sharing function; 1 is linear in the distance
+		double alpha_;
+		// hash tables the population is bucketed by; 0 compares every pair
+		unsigned int num_tables_;
+		// gene positions hashed by each table
+		unsigned int positions_per_table_;
+		// bucket members compared with an individual per table; larger buckets are sampled
+		unsigned int max_bucket_scan_;
+		// threads used to pack, bucket and compare the population
+		unsigned int num_threads_;
+		// seeds the positions the tables hash; the process's random numbers aren't touched
+		unsigned long long random_seed_;
+
+		Descriptor( double radius = 0.25, double alpha = 1, unsigned int num_tables = 8, unsigned int positions_per_table = 6, unsigned int max_bucket_scan = 32,
+				unsigned int num_threads = 1, unsigned long long random_seed = 1 ) :
+			radius_( radius ), alpha_( alpha ), num_tables_( num_tables ), positions_per_table_( positions_per_table ), max_bucket_scan_( max_bucket_scan ),
+					num_threads_( num_threads ), random_seed_( random_seed )
+		{
+			//
+		}
+	};
+
+	// individuals per task when spreading the population over threads
+	const static unsigned int CHUNK_SIZE = 64;
+
+protected:
+	typedef std::pair<unsigned long long, unsigned int> _BucketKey;
+
+	Descriptor descriptor_;
+	WorkerPool worker_pool_;
+	unsigned long long random_state_;
+
+	// the population's genes, one genome after the other
+	std::vector<_DataType> genes_;
+	unsigned int genome_length_;
+	// num_tables_ * positions_per_table_ positions, table after table
+	std::vector<unsigned int> positions_;
+	// per table, the population sorted by bucket key
+	std::vector<_BucketKey> keys_;
+	// per table and individual, where its bucket starts and ends in that table's part of keys_
+	std::vector<unsigned int> bucket_begin_;
+	std::vector<unsigned int> bucket_end_;
+	// genes that may differ for two genomes to share, and per number of differing genes below that, the share and the share
+	// divided by the chance of two such genomes meeting in a bucket
+	unsigned int max_differences_;
+	std::vector<double> shares_;
+	std::vector<double> weighted_shares_;
+	std::vector<unsigned long long> distance_evaluations_;
+
+	std::vector<double> niche_counts_;
+	double mean_niche_count_;
+	unsigned long long total_distance_evaluations_;
+
+public:
+	FitnessSharing( Descriptor descriptor = Descriptor() ) :
+		descriptor_( descriptor ), worker_pool_( descriptor.num_threads_ > 1 ? descriptor.num_threads_ - 1 : 0 ), random_state_( descriptor.random_seed_ ), genome_length_( 0 ),
+				mean_niche_count_( 0 ), total_distance_evaluations_( 0 )
+	{
+		//
+	}
+
+	virtual ~FitnessSharing()
+	{
+		//
+	}
+
+	// mean niche count of the last population shared; 1 means nobody was within the radius of anybody else
+	double meanNicheCount() const
+	{
+		return mean_niche_count_;
+	}
+
+	// niche count of each individual of the last population shared, in population order
+	const std::vector<double> & nicheCounts() const
+	{
+		return niche_counts_;
+	}
+
+	// genome comparisons made for the last population
+	unsigned long long distanceEvaluations() const
+	{
+		return total_distance_evaluations_;
+	}
+
+	bool adjustFitness( _GeneticProcess & process )
+	{
+		ScopedTrace trace( "fitness sharing", "ga" );
+		const _PopulationVector & population = process.population();
+		const unsigned int num_individuals = population.size();
+		if ( num_individuals == 0 || descriptor_.radius_ <= 0 ) return false;
+
+		const unsigned int num_chunks = ( num_individuals + CHUNK_SIZE - 1 ) / CHUNK_SIZE;
+		const unsigned int num_workers = worker_pool_.numWorkers();
+
+		const typename _Genome::Descriptor & genome_descriptor = process.descriptor().genome_descriptor_;
+		genome_length_ = genome_descriptor.size_ * genome_descriptor.chromosome_descriptor_.size_;
+		if ( genome_length_ == 0 ) return false;
+		genes_.resize( (size_t) num_individuals * genome_length_ );
+		worker_pool_.run( num_chunks, [this, &population, num_individuals]( unsigned int chunk, unsigned int )
+		{
+			const unsigned int end = std::min( ( chunk + 1 ) * CHUNK_SIZE, num_individuals );
+			for ( unsigned int i = chunk * CHUNK_SIZE; i < end; ++i )
+			{
+				GenomeArchiveDefs::packGenome( population[i], &genes_[(size_t) i * genome_length_] );
+			}
+		} );
+
+		computeShares();
+		if ( descriptor_.num_tables_ > 0 ) bucketPopulation( num_individuals, num_chunks );
+		distance_evaluations_.assign( num_workers, 0 );
+
+		niche_counts_.resize( num_individuals );
+		worker_pool_.run( num_chunks, [this, num_individuals]( unsigned int chunk, unsigned int worker )
+		{
+			const unsigned int end = std::min( ( chunk + 1 ) * CHUNK_SIZE, num_individuals );
+			for ( unsigned int i = chunk * CHUNK_SIZE; i < end; ++i )
+			{
+				niche_counts_[i] = descriptor_.num_tables_ > 0 ? nicheCount( i, num_individuals, worker ) : exactNicheCount( i, num_individuals, worker );
+			}
+		} );
+
+		_FitnessType min_fitness = population[0]->fitness();
+		for ( unsigned int i = 1; i < num_individuals; ++i )
+		{
+			min_fitness = std::min( min_fitness, population[i]->fitness() );
+		}
+
+		mean_niche_count_ = 0;
+		total_distance_evaluations_ = 0;
+		for ( unsigned int i = 0; i < num_individuals; ++i )
+		{
+			population[i]->setFitness( min_fitness + ( population[i]->fitness() - min_fitness ) / niche_counts_[i] );
+			mean_niche_count_ += niche_counts_[i];
+		}
+		mean_niche_count_ /= num_individuals;
+		for ( unsigned int i = 0; i < num_workers; ++i )
+		{
+			total_distance_evaluations_ += distance_evaluations_[i];
+		}
+		return true;
+	}
+
+protected:
+	// splitmix64; the tables get their own stream so sharing doesn't change what the process draws
+	unsigned long long nextRandom()
+	{
+		unsigned long long z = ( random_state_ += 0x9E3779B97F4A7C15ull );
+		z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+		z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+		return z ^ ( z >> 31 );
+	}
+
+	const _DataType * genes( unsigned int individual ) const
+	{
+		return &genes_[(size_t) individual * genome_length_];
+	}
+
+	void bucketPopulation( unsigned int num_individuals, unsigned int num_chunks )
+	{
+		const unsigned int num_tables = descriptor_.num_tables_;
+		const unsigned int num_positions = std::min( descriptor_.positions_per_table_, genome_length_ );
+
+		// distinct within a table, so p(d) below is exact
+		positions_.resize( num_tables * num_positions );
+		for ( unsigned int table = 0; table < num_tables; ++table )
+		{
+			unsigned int * table_positions = &positions_[table * num_positions];
+			for ( unsigned int i = 0; i < num_positions; ++i )
+			{
+				do
+				{
+					table_positions[i] = nextRandom() % genome_length_;
+				} while ( std::find( table_positions, table_positions + i, table_positions[i] ) != table_positions + i );
+			}
+		}
+
+		// FNV-1a over the sampled genes
+		keys_.resize( (size_t) num_tables * num_individuals );
+		worker_pool_.run( num_chunks, [this, num_individuals, num_tables, num_positions]( unsigned int chunk, unsigned int )
+		{
+			const unsigned int end = std::min( ( chunk + 1 ) * CHUNK_SIZE, num_individuals );
+			for ( unsigned int i = chunk * CHUNK_SIZE; i < end; ++i )
+			{
+				for ( unsigned int table = 0; table < num_tables; ++table )
+				{
+					unsigned long long key = 14695981039346656037ULL;
+					for ( unsigned int position = 0; position < num_positions; ++position )
+					{
+						const unsigned char * bytes = (const unsigned char *) &genes( i )[positions_[table * num_positions + position]];
+						for ( size_t byte = 0; byte < sizeof( _DataType ); ++byte )
+						{
+							key = ( key ^ bytes[byte] ) * 1099511628211ULL;
+						}
+					}
+					keys_[(size_t) table * num_individuals + i] = _BucketKey( key, i );
+				}
+			}
+		} );
+
+		bucket_begin_.resize( (size_t) num_tables * num_individuals );
+		bucket_end_.resize( (size_t) num_tables * num_individuals );
+		worker_pool_.run( num_tables, [this, num_individuals]( unsigned int table, unsigned int )
+		{
+			const typename std::vector<_BucketKey>::iterator table_keys = keys_.begin() + (size_t) table * num_individuals;
+			std::sort( table_keys, table_keys + num_individuals );
+
+			unsigned int * bucket_begin = &bucket_begin_[(size_t) table * num_individuals];
+			unsigned int * bucket_end = &bucket_end_[(size_t) table * num_individuals];
+			for ( unsigned int begin = 0, end; begin < num_individuals; begin = end )
+			{
+				for ( end = begin + 1; end < num_individuals && table_keys[end].first == table_keys[begin].first; ++end )
+					;
+				for ( unsigned int i = begin; i < end; ++i )
+				{
+					bucket_begin[table_keys[i].second] = begin;
+					bucket_end[table_keys[i].second] = end;
+				}
+			}
+		} );
+	}
+
+	void computeShares()
+	{
+		const unsigned int num_positions = std::min( descriptor_.positions_per_table_, genome_length_ );
+		max_differences_ = std::min( (unsigned int) ceil( descriptor_.radius_ * genome_length_ ), genome_length_ + 1 );
+		shares_.resize( max_differences_ );
+		weighted_shares_.resize( max_differences_ );
+		for ( unsigned int differences = 0; differences < max_differences_; ++differences )
+		{
+			shares_[differences] = 1 - pow( (double) differences / genome_length_ / descriptor_.radius_, descriptor_.alpha_ );
+
+			// p(d): all of a table's positions among the genome_length_ - d that match
+			double probability = 1;
+			for ( unsigned int i = 0; i < num_positions; ++i )
+			{
+				probability *= genome_length_ - differences > i ? (double) ( genome_length_ - differences - i ) / ( genome_length_ - i ) : 0;
+			}
+			weighted_shares_[differences] = probability > 0 ? shares_[differences] / probability : 0;
+		}
+	}
+
+	// the number of genes two genomes differ in, or max_differences_ if it's at least that
+	unsigned int differences( unsigned int a, unsigned int b, unsigned int worker )
+	{
+		++distance_evaluations_[worker];
+		const _DataType * genes_a = genes( a );
+		const _DataType * genes_b = genes( b );
+
+		// counted without branching on each gene (whether two genes match is a coin flip the predictor can't learn); the radius
+		// is checked every few genes, which is enough to give up early on genomes from different niches
+		unsigned int num_differences = 0;
+		for ( unsigned int i = 0; i < genome_length_; ++i )
+		{
+			num_differences += memcmp( &genes_a[i], &genes_b[i], sizeof( _DataType ) ) != 0;
+			if ( ( i & 7 ) == 7 && num_differences >= max_differences_ ) return max_differences_;
+		}
+		return std::min( num_differences, max_differences_ );
+	}
+
+	double nicheCount( unsigned int individual, unsigned int num_individuals, unsigned int worker )
+	{
+		const unsigned int max_scan = std::max( descriptor_.max_bucket_scan_, 1u );
+
+		double estimate = 0;
+		for ( unsigned int table = 0; table < descriptor_.num_tables_; ++table )
+		{
+			const _BucketKey * table_keys = &keys_[(size_t) table * num_individuals];
+			const unsigned int begin = bucket_begin_[(size_t) table * num_individuals + individual];
+			const unsigned int bucket_size = bucket_end_[(size_t) table * num_individuals + individual] - begin;
+
+			// the whole bucket, or an evenly spaced sample offset by the individual so different individuals see different members
+			const unsigned int num_scanned = std::min( bucket_size, max_scan );
+			double table_estimate = 0;
+			unsigned int num_compared = 0;
+			for ( unsigned int i = 0; i < num_scanned; ++i )
+			{
+				const unsigned int other = table_keys[begin + (unsigned int) ( ( (unsigned long long) i * bucket_size / num_scanned + individual ) % bucket_size )].second;
+				if ( other == individual ) continue;
+				const unsigned int other_differences = differences( individual, other, worker );
+				if ( other_differences < max_differences_ ) table_estimate += weighted_shares_[other_differences];
+				++num_compared;
+			}
+			if ( num_compared > 0 ) estimate += table_estimate * ( bucket_size - 1 ) / num_compared;
+		}
+
+		// the individual itself always counts in full
+		return 1 + estimate / descriptor_.num_tables_;
+	}
+
+	double exactNicheCount( unsigned int individual, unsigned int num_individuals, unsigned int worker )
+	{
+		double niche_count = 1;
+		for ( unsigned int other = 0; other < num_individuals; ++other )
+		{
+			if ( other == individual ) continue;
+			const unsigned int other_differences = differences( individual, other, worker );
+			if ( other_differences < max_differences_ ) niche_count += shares_[other_differences];
+		}
+		return niche_count;
+	}
+};
+
+#endif /* FITNESS_SHARING_H_ */
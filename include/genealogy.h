@@ -0,0 +1,666 @@
+/*******************************************************************************
+ *
+ *      genealogy
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef GENEALOGY_H_
+#define GENEALOGY_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "genetic_process.h"
+#include "genome_archive.h"
+#include "generation_history.h"
+
+/*
+ * Genealogy
+ *
+ * the ancestry of every individual in a run, stored as deltas: a child is its two parents' positions, the crossover point
+ * and the genes that differ from what crossover alone would have produced (i.e. its mutations). whole genomes are only
+ * stored in keyframes (the first generation, every keyframe interval generations and whenever the parents are unknown),
+ * so reconstructing an ancestor walks back at most one keyframe interval
+ *
+ * like the generation history it is a data file plus an index file (data file name + ".idx")
+ *
+ * data file header (32 bytes):
+ *   char[8]  magic "CSGENLGY"
+ *   uint32   version
+ *   uint32   gene size in bytes (sizeof( _DataType ))
+ *   uint32   chromosomes per genome
+ *   uint32   genes per chromosome
+ *   uint64   reserved
+ * keyframe generation:
+ *   _DataType[] genes of each individual, chromosome by chromosome
+ * delta generation:
+ *   uint32[] offset of each individual's record from the start of the generation, plus one for the end
+ *   records:
+ *     uint32  first parent's position in the previous generation (supplies the chromosomes before the crossover point)
+ *     uint32  second parent's position (supplies the rest)
+ *     uint32  crossover point
+ *     uint32  number of mutations
+ *     mutations, by ascending position:
+ *       uint32    gene position in the genome (chromosome * genes per chromosome + gene)
+ *       _DataType new value
+ *
+ * index file header (16 bytes):
+ *   char[8]  magic "CSGENIDX"
+ *   uint32   version
+ *   uint32   entry size in bytes
+ * index entries (one per generation, consecutive generations in order):
+ *   uint64   generation
+ *   uint64   offset of the generation in the data file
+ *   uint32   number of individuals
+ *   uint32   1 for keyframes, 0 for deltas
+ *
+ * index entries are only written once their generation is in the data file, so a genealogy can be read while it is written
+ *
+ * all values are stored in host byte order
+ */
+namespace GenealogyDefs
+{
+	const static char MAGIC[8] = { 'C', 'S', 'G', 'E', 'N', 'L', 'G', 'Y' };
+	const static char INDEX_MAGIC[8] = { 'C', 'S', 'G', 'E', 'N', 'I', 'D', 'X' };
+	const static unsigned int VERSION = 1;
+	const static unsigned int DEFAULT_KEYFRAME_INTERVAL = 1000;
+
+	struct Header
+	{
+		char magic_[8];
+		unsigned int version_;
+		unsigned int gene_size_;
+		unsigned int genome_size_;
+		unsigned int chromosome_size_;
+		unsigned long long reserved_;
+	};
+
+	struct IndexHeader
+	{
+		char magic_[8];
+		unsigned int version_;
+		unsigned int entry_size_;
+	};
+
+	struct IndexEntry
+	{
+		unsigned long long generation_;
+		unsigned long long offset_;
+		unsigned int num_individuals_;
+		unsigned int keyframe_;
+	};
+
+	struct RecordHeader
+	{
+		unsigned int parents_[2];
+		unsigned int crossover_point_;
+		unsigned int num_mutations_;
+	};
+}
+
+// appends generations of a GeneticProcess to a genealogy
+// the previous generation is kept packed so each child can be diffed against its parents' crossover
+template<class _GeneticProcessType>
+class GenealogyWriter
+{
+public:
+	typedef _GeneticProcessType _GeneticProcess;
+	typedef typename _GeneticProcess::_Genome _Genome;
+	typedef typename _GeneticProcess::_DataType _DataType;
+	typedef typename _GeneticProcess::_SizeType _SizeType;
+	typedef typename _GeneticProcess::_PopulationVector _PopulationVector;
+	typedef typename _GeneticProcess::_ParentIndices _ParentIndices;
+
+protected:
+	FILE * data_file_;
+	FILE * index_file_;
+	GenealogyDefs::Header header_;
+	unsigned int keyframe_interval_;
+	unsigned long long data_offset_;
+	unsigned long long num_generations_;
+	// the generation appended last, packed, and the one being appended
+	std::vector<_DataType> previous_genes_;
+	std::vector<_DataType> current_genes_;
+	unsigned long long previous_generation_;
+	unsigned long long generations_since_keyframe_;
+	std::vector<char> block_;
+	// bytes a full copy of every generation would have taken
+	unsigned long long raw_bytes_;
+
+public:
+	GenealogyWriter() :
+		data_file_( NULL ), index_file_( NULL ), keyframe_interval_( GenealogyDefs::DEFAULT_KEYFRAME_INTERVAL ), data_offset_( 0 ), num_generations_( 0 ), previous_generation_( 0 ),
+				generations_since_keyframe_( 0 ), raw_bytes_( 0 )
+	{
+		//
+	}
+
+	virtual ~GenealogyWriter()
+	{
+		close();
+	}
+
+	// creates (or truncates) the data and index files; keyframe_interval 0 only writes keyframes when it has to
+	bool open( const std::string & filename, const typename _Genome::Descriptor & descriptor, unsigned int keyframe_interval = GenealogyDefs::DEFAULT_KEYFRAME_INTERVAL )
+	{
+		close();
+		data_file_ = fopen( filename.c_str(), "wb" );
+		index_file_ = fopen( GenerationHistoryDefs::indexFilename( filename ).c_str(), "wb" );
+		if ( !data_file_ || !index_file_ )
+		{
+			close();
+			return false;
+		}
+
+		header_ = makeHeader( descriptor );
+		const GenealogyDefs::IndexHeader index_header = makeIndexHeader();
+		if ( fwrite( &header_, sizeof( header_ ), 1, data_file_ ) != 1 || fwrite( &index_header, sizeof( index_header ), 1, index_file_ ) != 1 || fflush( data_file_ ) != 0
+				|| fflush( index_file_ ) != 0 )
+		{
+			close();
+			return false;
+		}
+
+		reset( keyframe_interval, sizeof( header_ ), 0, 0 );
+		return true;
+	}
+
+	// continues the genealogy of a resumed run: the checkpoint's generation and everything logged after it are cut from both
+	// files, so appending the restored population starts over with a keyframe; a genealogy that doesn't exist yet is created
+	bool resume( const std::string & filename, const typename _Genome::Descriptor & descriptor, unsigned long long generation,
+			unsigned int keyframe_interval = GenealogyDefs::DEFAULT_KEYFRAME_INTERVAL )
+	{
+		close();
+		if ( access( filename.c_str(), F_OK ) != 0 && access( GenerationHistoryDefs::indexFilename( filename ).c_str(), F_OK ) != 0 )
+		{
+			return open( filename, descriptor, keyframe_interval );
+		}
+
+		data_file_ = fopen( filename.c_str(), "r+b" );
+		index_file_ = fopen( GenerationHistoryDefs::indexFilename( filename ).c_str(), "r+b" );
+		if ( !data_file_ || !index_file_ )
+		{
+			close();
+			return false;
+		}
+
+		// never append to a genealogy of differently shaped genomes
+		header_ = makeHeader( descriptor );
+		const GenealogyDefs::IndexHeader index_header = makeIndexHeader();
+		GenealogyDefs::Header file_header;
+		GenealogyDefs::IndexHeader file_index_header;
+		if ( fread( &file_header, sizeof( file_header ), 1, data_file_ ) != 1 || fread( &file_index_header, sizeof( file_index_header ), 1, index_file_ ) != 1
+				|| memcmp( &file_header, &header_, sizeof( header_ ) ) != 0 || memcmp( &file_index_header, &index_header, sizeof( index_header ) ) != 0 )
+		{
+			fprintf( stderr, "%s is not a compatible genealogy\n", filename.c_str() );
+			close();
+			return false;
+		}
+
+		struct stat data_stat;
+		if ( fstat( fileno( data_file_ ), &data_stat ) != 0 )
+		{
+			close();
+			return false;
+		}
+
+		// keep the complete generations before the checkpoint's; a delta generation's size is the end offset in its table
+		const size_t genome_bytes = header_.genome_size_ * header_.chromosome_size_ * sizeof( _DataType );
+		unsigned long long data_offset = sizeof( header_ );
+		unsigned long long num_generations = 0;
+		unsigned long long raw_bytes = 0;
+		GenealogyDefs::IndexEntry entry;
+		while ( fread( &entry, sizeof( entry ), 1, index_file_ ) == 1 && entry.generation_ < generation && entry.offset_ == data_offset )
+		{
+			unsigned long long size = (unsigned long long) entry.num_individuals_ * genome_bytes;
+			if ( !entry.keyframe_ )
+			{
+				unsigned int end_offset;
+				if ( pread( fileno( data_file_ ), &end_offset, sizeof( end_offset ), entry.offset_ + entry.num_individuals_ * sizeof( unsigned int ) ) != sizeof( end_offset ) ) break;
+				size = end_offset;
+			}
+			if ( entry.offset_ + size > (unsigned long long) data_stat.st_size ) break;
+
+			data_offset = entry.offset_ + size;
+			raw_bytes += (unsigned long long) entry.num_individuals_ * genome_bytes;
+			++num_generations;
+		}
+
+		if ( ftruncate( fileno( data_file_ ), data_offset ) != 0 || ftruncate( fileno( index_file_ ), sizeof( index_header ) + num_generations * sizeof( entry ) ) != 0
+				|| fseeko( data_file_, data_offset, SEEK_SET ) != 0 || fseeko( index_file_, 0, SEEK_END ) != 0 )
+		{
+			close();
+			return false;
+		}
+
+		reset( keyframe_interval, data_offset, num_generations, raw_bytes );
+		return true;
+	}
+
+	// record the process's current population; call it after every step()
+	bool append( const _GeneticProcess & process )
+	{
+		if ( !data_file_ ) return false;
+		ScopedTrace trace( "genealogy append", "genealogy" );
+
+		const _PopulationVector & population = process.population();
+		const std::vector<_ParentIndices> & parent_indices = process.parentIndices();
+		const std::vector<_SizeType> & crossover_points = process.crossoverPoints();
+		const size_t genes_per_genome = header_.genome_size_ * header_.chromosome_size_;
+
+		current_genes_.resize( population.size() * genes_per_genome );
+		for ( size_t i = 0; i < population.size(); ++i )
+		{
+			GenomeArchiveDefs::packGenome( population[i], &current_genes_[i * genes_per_genome] );
+		}
+
+		// deltas need the generation right before this one and known parents for everyone
+		bool keyframe = previous_genes_.empty() || process.generation() != previous_generation_ + 1 || ( keyframe_interval_ > 0 && generations_since_keyframe_ + 1 >= keyframe_interval_ );
+		for ( size_t i = 0; i < population.size() && !keyframe; ++i )
+		{
+			keyframe = parent_indices[i].first == _GeneticProcess::NO_PARENT || parent_indices[i].second == _GeneticProcess::NO_PARENT;
+		}
+
+		if ( keyframe ) block_.assign( (const char *) &current_genes_[0], (const char *) &current_genes_[0] + current_genes_.size() * sizeof( _DataType ) );
+		else packDeltas( parent_indices, crossover_points, population.size() );
+
+		GenealogyDefs::IndexEntry entry;
+		memset( &entry, 0, sizeof( entry ) );
+		entry.generation_ = process.generation();
+		entry.offset_ = data_offset_;
+		entry.num_individuals_ = population.size();
+		entry.keyframe_ = keyframe;
+
+		// the index entry goes out last so readers never see a generation that isn't there yet
+		if ( !block_.empty() && fwrite( &block_[0], 1, block_.size(), data_file_ ) != block_.size() ) return false;
+		if ( fflush( data_file_ ) != 0 ) return false;
+		if ( fwrite( &entry, sizeof( entry ), 1, index_file_ ) != 1 || fflush( index_file_ ) != 0 ) return false;
+
+		data_offset_ += block_.size();
+		raw_bytes_ += current_genes_.size() * sizeof( _DataType );
+		++num_generations_;
+		generations_since_keyframe_ = keyframe ? 0 : generations_since_keyframe_ + 1;
+		previous_generation_ = process.generation();
+		previous_genes_.swap( current_genes_ );
+		return true;
+	}
+
+	void close()
+	{
+		if ( data_file_ ) fclose( data_file_ );
+		if ( index_file_ ) fclose( index_file_ );
+		data_file_ = NULL;
+		index_file_ = NULL;
+	}
+
+	unsigned long long numGenerations() const
+	{
+		return num_generations_;
+	}
+
+	// bytes of generation data written so far, and what full copies of the same genomes would have taken
+	unsigned long long dataBytes() const
+	{
+		return data_offset_ - sizeof( header_ );
+	}
+
+	unsigned long long rawBytes() const
+	{
+		return raw_bytes_;
+	}
+
+protected:
+	static GenealogyDefs::Header makeHeader( const typename _Genome::Descriptor & descriptor )
+	{
+		GenealogyDefs::Header header;
+		memset( &header, 0, sizeof( header ) );
+		memcpy( header.magic_, GenealogyDefs::MAGIC, sizeof( header.magic_ ) );
+		header.version_ = GenealogyDefs::VERSION;
+		header.gene_size_ = sizeof( _DataType );
+		header.genome_size_ = descriptor.size_;
+		header.chromosome_size_ = descriptor.chromosome_descriptor_.size_;
+		return header;
+	}
+
+	static GenealogyDefs::IndexHeader makeIndexHeader()
+	{
+		GenealogyDefs::IndexHeader index_header;
+		memset( &index_header, 0, sizeof( index_header ) );
+		memcpy( index_header.magic_, GenealogyDefs::INDEX_MAGIC, sizeof( index_header.magic_ ) );
+		index_header.version_ = GenealogyDefs::VERSION;
+		index_header.entry_size_ = sizeof( GenealogyDefs::IndexEntry );
+		return index_header;
+	}
+
+	// the next append() writes a keyframe, since there is no previous generation to diff against
+	void reset( unsigned int keyframe_interval, unsigned long long data_offset, unsigned long long num_generations, unsigned long long raw_bytes )
+	{
+		keyframe_interval_ = keyframe_interval;
+		data_offset_ = data_offset;
+		num_generations_ = num_generations;
+		generations_since_keyframe_ = 0;
+		raw_bytes_ = raw_bytes;
+		previous_genes_.clear();
+	}
+
+	void packDeltas( const std::vector<_ParentIndices> & parent_indices, const std::vector<_SizeType> & crossover_points, size_t num_individuals )
+	{
+		const size_t genes_per_genome = header_.genome_size_ * header_.chromosome_size_;
+		const size_t table_size = ( num_individuals + 1 ) * sizeof( unsigned int );
+		const size_t mutation_size = sizeof( unsigned int ) + sizeof( _DataType );
+
+		block_.resize( table_size );
+		for ( size_t i = 0; i < num_individuals; ++i )
+		{
+			const unsigned int record_offset = block_.size();
+			memcpy( &block_[i * sizeof( unsigned int )], &record_offset, sizeof( record_offset ) );
+
+			GenealogyDefs::RecordHeader record_header;
+			record_header.parents_[0] = parent_indices[i].first;
+			record_header.parents_[1] = parent_indices[i].second;
+			record_header.crossover_point_ = crossover_points[i];
+			record_header.num_mutations_ = 0;
+			const size_t header_offset = block_.size();
+			block_.resize( header_offset + sizeof( record_header ) );
+
+			// compare against the chromosomes crossover copied from each parent
+			const _DataType * child = &current_genes_[i * genes_per_genome];
+			const _DataType * head = &previous_genes_[parent_indices[i].first * genes_per_genome];
+			const _DataType * tail = &previous_genes_[parent_indices[i].second * genes_per_genome];
+			const size_t split = (size_t) record_header.crossover_point_ * header_.chromosome_size_;
+			for ( size_t position = 0; position < genes_per_genome; ++position )
+			{
+				const _DataType & inherited = position < split ? head[position] : tail[position];
+				if ( memcmp( &child[position], &inherited, sizeof( _DataType ) ) == 0 ) continue;
+
+				const unsigned int stored_position = position;
+				const size_t mutation_offset = block_.size();
+				block_.resize( mutation_offset + mutation_size );
+				memcpy( &block_[mutation_offset], &stored_position, sizeof( stored_position ) );
+				memcpy( &block_[mutation_offset + sizeof( stored_position )], &child[position], sizeof( _DataType ) );
+				++record_header.num_mutations_;
+			}
+			memcpy( &block_[header_offset], &record_header, sizeof( record_header ) );
+		}
+
+		const unsigned int end_offset = block_.size();
+		memcpy( &block_[num_individuals * sizeof( unsigned int )], &end_offset, sizeof( end_offset ) );
+	}
+};
+
+// memory-maps a genealogy and reconstructs any recorded individual, or traces where each of its genes came from
+template<class _GenomeType>
+class GenealogyReader
+{
+public:
+	typedef _GenomeType _Genome;
+	typedef _Genome * _GenomePtr;
+	typedef typename _Genome::__DataType _DataType;
+	typedef typename _Genome::Descriptor _Descriptor;
+	typedef typename _Genome::_Chromosome _Chromosome;
+
+	// an individual in the genealogy: index entry and position in that generation
+	typedef std::pair<unsigned long long, unsigned int> _Individual;
+
+protected:
+	GenerationHistoryDefs::MappedFile data_;
+	GenerationHistoryDefs::MappedFile index_;
+	const GenealogyDefs::Header * header_;
+	const GenealogyDefs::IndexEntry * entries_;
+	unsigned long long num_generations_;
+
+public:
+	GenealogyReader() :
+		header_( NULL ), entries_( NULL ), num_generations_( 0 )
+	{
+		//
+	}
+
+	virtual ~GenealogyReader()
+	{
+		close();
+	}
+
+	bool open( const std::string & filename )
+	{
+		close();
+		data_.fd_ = ::open( filename.c_str(), O_RDONLY );
+		index_.fd_ = ::open( GenerationHistoryDefs::indexFilename( filename ).c_str(), O_RDONLY );
+		if ( data_.fd_ < 0 || index_.fd_ < 0 || !refresh() )
+		{
+			close();
+			return false;
+		}
+
+		const GenealogyDefs::IndexHeader * index_header = (const GenealogyDefs::IndexHeader *) index_.data_;
+		if ( memcmp( header_->magic_, GenealogyDefs::MAGIC, sizeof( header_->magic_ ) ) != 0 || header_->version_ != GenealogyDefs::VERSION || header_->gene_size_ != sizeof( _DataType )
+				|| memcmp( index_header->magic_, GenealogyDefs::INDEX_MAGIC, sizeof( index_header->magic_ ) ) != 0 || index_header->entry_size_ != sizeof( GenealogyDefs::IndexEntry ) )
+		{
+			fprintf( stderr, "%s is not a compatible genealogy\n", filename.c_str() );
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	// remap both files to pick up generations written since the last call
+	bool refresh()
+	{
+		if ( !index_.map() || index_.size_ < sizeof( GenealogyDefs::IndexHeader ) ) return false;
+		if ( !data_.map() || data_.size_ < sizeof( GenealogyDefs::Header ) ) return false;
+
+		header_ = (const GenealogyDefs::Header *) data_.data_;
+		entries_ = (const GenealogyDefs::IndexEntry *) ( index_.data_ + sizeof( GenealogyDefs::IndexHeader ) );
+		num_generations_ = ( index_.size_ - sizeof( GenealogyDefs::IndexHeader ) ) / sizeof( GenealogyDefs::IndexEntry );
+		return true;
+	}
+
+	void close()
+	{
+		data_.close();
+		index_.close();
+		header_ = NULL;
+		entries_ = NULL;
+		num_generations_ = 0;
+	}
+
+	bool isOpen() const
+	{
+		return header_ != NULL;
+	}
+
+	_Descriptor descriptor() const
+	{
+		return _Descriptor( header_->genome_size_, typename _Chromosome::Descriptor( header_->chromosome_size_ ) );
+	}
+
+	unsigned int genesPerGenome() const
+	{
+		return header_->genome_size_ * header_->chromosome_size_;
+	}
+
+	unsigned long long numGenerations() const
+	{
+		return num_generations_;
+	}
+
+	const GenealogyDefs::IndexEntry & entry( unsigned long long entry_index ) const
+	{
+		return entries_[entry_index];
+	}
+
+	// the entry recorded for the given process generation, or numGenerations() if there is none
+	unsigned long long findGeneration( unsigned long long generation ) const
+	{
+		if ( num_generations_ == 0 || generation < entries_[0].generation_ ) return num_generations_;
+		// generations are consecutive between keyframes; a restart (e.g. from a checkpoint) can leave a gap, so fall back to a search
+		const unsigned long long direct = generation - entries_[0].generation_;
+		if ( direct < num_generations_ && entries_[direct].generation_ == generation ) return direct;
+		for ( unsigned long long entry_index = 0; entry_index < num_generations_; ++entry_index )
+		{
+			if ( entries_[entry_index].generation_ == generation ) return entry_index;
+		}
+		return num_generations_;
+	}
+
+	bool isKeyframe( unsigned long long entry_index ) const
+	{
+		return entries_[entry_index].keyframe_ != 0;
+	}
+
+	// the recorded delta of an individual in a delta generation
+	GenealogyDefs::RecordHeader record( unsigned long long entry_index, unsigned int individual ) const
+	{
+		GenealogyDefs::RecordHeader record_header;
+		memcpy( &record_header, recordData( entry_index, individual ), sizeof( record_header ) );
+		return record_header;
+	}
+
+	// parents in the previous entry; individuals in keyframes have none
+	bool parents( const _Individual & individual, _Individual & first, _Individual & second ) const
+	{
+		if ( isKeyframe( individual.first ) ) return false;
+		const GenealogyDefs::RecordHeader record_header = record( individual.first, individual.second );
+		first = _Individual( individual.first - 1, record_header.parents_[0] );
+		second = _Individual( individual.first - 1, record_header.parents_[1] );
+		return true;
+	}
+
+	// the individual whose mutation (or keyframe) introduced the gene at position into the given individual's genome
+	_Individual geneOrigin( _Individual individual, unsigned int position ) const
+	{
+		const unsigned int chromosome = position / header_->chromosome_size_;
+		while ( !isKeyframe( individual.first ) )
+		{
+			const GenealogyDefs::RecordHeader record_header = record( individual.first, individual.second );
+			if ( findMutation( individual.first, individual.second, record_header, position ) ) return individual;
+			individual = _Individual( individual.first - 1, record_header.parents_[chromosome < record_header.crossover_point_ ? 0 : 1] );
+		}
+		return individual;
+	}
+
+	// rebuild the genes of a recorded individual; genes must hold genesPerGenome() values
+	// each chromosome is followed back through the parent that supplied it until all of its genes have been found
+	void reconstruct( const _Individual & individual, _DataType * genes ) const
+	{
+		const unsigned int chromosome_size = header_->chromosome_size_;
+		std::vector<char> found( chromosome_size );
+
+		for ( unsigned int chromosome = 0; chromosome < header_->genome_size_; ++chromosome )
+		{
+			const unsigned int first_position = chromosome * chromosome_size;
+			unsigned int remaining = chromosome_size;
+			std::fill( found.begin(), found.end(), 0 );
+
+			_Individual current = individual;
+			while ( remaining > 0 && !isKeyframe( current.first ) )
+			{
+				const GenealogyDefs::RecordHeader record_header = record( current.first, current.second );
+				const char * mutation = recordData( current.first, current.second ) + sizeof( record_header );
+				for ( unsigned int i = 0; i < record_header.num_mutations_; ++i, mutation += MUTATION_SIZE )
+				{
+					unsigned int position;
+					memcpy( &position, mutation, sizeof( position ) );
+					if ( position < first_position ) continue;
+					if ( position >= first_position + chromosome_size ) break;
+					if ( found[position - first_position] ) continue;
+
+					memcpy( &genes[position], mutation + sizeof( position ), sizeof( _DataType ) );
+					found[position - first_position] = 1;
+					--remaining;
+				}
+				current = _Individual( current.first - 1, record_header.parents_[chromosome < record_header.crossover_point_ ? 0 : 1] );
+			}
+
+			if ( remaining == 0 ) continue;
+			const _DataType * keyframe_genes = keyframeGenes( current.first, current.second );
+			for ( unsigned int gene = 0; gene < chromosome_size; ++gene )
+			{
+				if ( !found[gene] ) genes[first_position + gene] = keyframe_genes[first_position + gene];
+			}
+		}
+	}
+
+	// the caller owns the result
+	_GenomePtr createGenome( const _Individual & individual ) const
+	{
+		std::vector<_DataType> genes( genesPerGenome() );
+		reconstruct( individual, &genes[0] );
+		return GenomeArchiveDefs::unpackGenome<_Genome>( descriptor(), &genes[0] );
+	}
+
+protected:
+	const static size_t MUTATION_SIZE = sizeof( unsigned int ) + sizeof( _DataType );
+
+	const char * generationData( unsigned long long entry_index ) const
+	{
+		return data_.data_ + entries_[entry_index].offset_;
+	}
+
+	const char * recordData( unsigned long long entry_index, unsigned int individual ) const
+	{
+		unsigned int record_offset;
+		memcpy( &record_offset, generationData( entry_index ) + individual * sizeof( unsigned int ), sizeof( record_offset ) );
+		return generationData( entry_index ) + record_offset;
+	}
+
+	const _DataType * keyframeGenes( unsigned long long entry_index, unsigned int individual ) const
+	{
+		return (const _DataType *) generationData( entry_index ) + (size_t) individual * genesPerGenome();
+	}
+
+	// mutations are sorted by position, so bisect them
+	bool findMutation( unsigned long long entry_index, unsigned int individual, const GenealogyDefs::RecordHeader & record_header, unsigned int position ) const
+	{
+		const char * mutations = recordData( entry_index, individual ) + sizeof( record_header );
+		unsigned int low = 0, high = record_header.num_mutations_;
+		while ( low < high )
+		{
+			const unsigned int middle = low + ( high - low ) / 2;
+			unsigned int middle_position;
+			memcpy( &middle_position, mutations + middle * MUTATION_SIZE, sizeof( middle_position ) );
+			if ( middle_position < position ) low = middle + 1;
+			else high = middle;
+		}
+		if ( low == record_header.num_mutations_ ) return false;
+		unsigned int found_position;
+		memcpy( &found_position, mutations + low * MUTATION_SIZE, sizeof( found_position ) );
+		return found_position == position;
+	}
+};
+
+#endif /* GENEALOGY_H_ */
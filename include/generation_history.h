@@ -0,0 +1,678 @@
+/*******************************************************************************
+ *
+ *      generation_history
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef GENERATION_HISTORY_H_
+#define GENERATION_HISTORY_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "genetic_process.h"
+#include "genome_archive.h"
+
+/*
+ * Generation history
+ *
+ * an append-only log of whole generations, split into a data file and an index file (data file name + ".idx")
+ *
+ * data file header (32 bytes):
+ *   char[8]  magic "CSHISTRY"
+ *   uint32   version
+ *   uint32   gene size in bytes (sizeof( _DataType ))
+ *   uint32   chromosomes per genome
+ *   uint32   genes per chromosome
+ *   uint32   record size in bytes
+ *   uint32   reserved
+ * data records (one per individual, fixed size, generation after generation):
+ *   double      fitness
+ *   uint32      first parent's position in the previous generation (0xffffffff if unknown)
+ *   uint32      second parent's position
+ *   _DataType[] genes, chromosome by chromosome
+ *
+ * index file header (16 bytes):
+ *   char[8]  magic "CSHSTIDX"
+ *   uint32   version
+ *   uint32   entry size in bytes
+ * index entries (one per logged generation, fixed size, in generation order):
+ *   uint64   generation
+ *   uint64   offset of the generation's first record in the data file
+ *   uint32   number of individuals
+ *   uint32   reserved
+ *   double   min, max, avg fitness
+ *
+ * a generation's index entry is only written once all of its records are in the data file, so the files can be mapped and
+ * read while a run is still appending to them: everything the index points at is complete
+ *
+ * all values are stored in host byte order
+ */
+namespace GenerationHistoryDefs
+{
+	const static char MAGIC[8] = { 'C', 'S', 'H', 'I', 'S', 'T', 'R', 'Y' };
+	const static char INDEX_MAGIC[8] = { 'C', 'S', 'H', 'S', 'T', 'I', 'D', 'X' };
+	const static unsigned int VERSION = 1;
+	const static unsigned int NO_PARENT = 0xffffffff;
+
+	struct Header
+	{
+		char magic_[8];
+		unsigned int version_;
+		unsigned int gene_size_;
+		unsigned int genome_size_;
+		unsigned int chromosome_size_;
+		unsigned int record_size_;
+		unsigned int reserved_;
+	};
+
+	struct RecordHeader
+	{
+		double fitness_;
+		unsigned int parents_[2];
+	};
+
+	struct IndexHeader
+	{
+		char magic_[8];
+		unsigned int version_;
+		unsigned int entry_size_;
+	};
+
+	struct IndexEntry
+	{
+		unsigned long long generation_;
+		unsigned long long offset_;
+		unsigned int num_individuals_;
+		unsigned int reserved_;
+		double min_fitness_;
+		double max_fitness_;
+		double avg_fitness_;
+	};
+
+	// a read-only mapping of a file that may still be growing
+	struct MappedFile
+	{
+		int fd_;
+		const char * data_;
+		size_t size_;
+
+		MappedFile() :
+			fd_( -1 ), data_( NULL ), size_( 0 )
+		{
+			//
+		}
+
+		// (re)map the whole file as it is now
+		bool map()
+		{
+			struct stat file_stat;
+			if ( fstat( fd_, &file_stat ) != 0 || file_stat.st_size == 0 ) return false;
+			if ( data_ && (size_t) file_stat.st_size == size_ ) return true;
+
+			unmap();
+			void * mapping = mmap( NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd_, 0 );
+			if ( mapping == MAP_FAILED ) return false;
+			data_ = (const char *) mapping;
+			size_ = file_stat.st_size;
+			return true;
+		}
+
+		void unmap()
+		{
+			if ( data_ ) munmap( (void *) data_, size_ );
+			data_ = NULL;
+			size_ = 0;
+		}
+
+		void close()
+		{
+			unmap();
+			if ( fd_ >= 0 ) ::close( fd_ );
+			fd_ = -1;
+		}
+	};
+
+	static inline std::string indexFilename( const std::string & filename )
+	{
+		return filename + ".idx";
+	}
+}
+
+// appends generations of a GeneticProcess to a history log
+// append() packs the population on the calling thread; a writer thread batches whatever has been queued since its last pass
+// into one write per file, so the GA only stalls if it gets more than MAX_QUEUED_BYTES ahead of the disk
+template<class _GeneticProcessType>
+class GenerationHistoryWriter
+{
+public:
+	typedef _GeneticProcessType _GeneticProcess;
+	typedef typename _GeneticProcess::_Genome _Genome;
+	typedef typename _GeneticProcess::_DataType _DataType;
+	typedef typename _GeneticProcess::_PopulationVector _PopulationVector;
+	typedef typename _GeneticProcess::_ParentIndices _ParentIndices;
+
+	const static size_t MAX_QUEUED_BYTES = 64 << 20;
+
+protected:
+	struct Batch
+	{
+		GenerationHistoryDefs::IndexEntry entry_;
+		std::vector<char> records_;
+	};
+
+	FILE * data_file_;
+	FILE * index_file_;
+	GenerationHistoryDefs::Header header_;
+	unsigned long long data_offset_;
+	unsigned long long num_generations_;
+	// the generation appended (or kept by resume()) last
+	unsigned long long last_generation_;
+	bool has_last_generation_;
+
+	std::thread writer_;
+	std::mutex mutex_;
+	std::condition_variable queue_changed_;
+	std::deque<Batch *> queue_;
+	size_t queued_bytes_;
+	bool stopping_;
+	bool failed_;
+
+public:
+	GenerationHistoryWriter() :
+		data_file_( NULL ), index_file_( NULL ), data_offset_( 0 ), num_generations_( 0 ), last_generation_( 0 ), has_last_generation_( false ), queued_bytes_( 0 ),
+				stopping_( false ), failed_( false )
+	{
+		//
+	}
+
+	virtual ~GenerationHistoryWriter()
+	{
+		close();
+	}
+
+	// creates (or truncates) the data and index files
+	bool open( const std::string & filename, const typename _Genome::Descriptor & descriptor )
+	{
+		close();
+		has_last_generation_ = false;
+		data_file_ = fopen( filename.c_str(), "wb" );
+		index_file_ = fopen( GenerationHistoryDefs::indexFilename( filename ).c_str(), "wb" );
+		if ( !data_file_ || !index_file_ )
+		{
+			closeFiles();
+			return false;
+		}
+
+		header_ = makeHeader( descriptor );
+		const GenerationHistoryDefs::IndexHeader index_header = makeIndexHeader();
+		if ( fwrite( &header_, sizeof( header_ ), 1, data_file_ ) != 1 || fwrite( &index_header, sizeof( index_header ), 1, index_file_ ) != 1 || fflush( data_file_ ) != 0
+				|| fflush( index_file_ ) != 0 )
+		{
+			closeFiles();
+			return false;
+		}
+
+		startWriter( sizeof( header_ ), 0 );
+		return true;
+	}
+
+	// continues the history of a resumed run: generations logged after the checkpoint's are cut from both files and the log
+	// is appended to from there; a history that doesn't exist yet is created
+	bool resume( const std::string & filename, const typename _Genome::Descriptor & descriptor, unsigned long long generation )
+	{
+		close();
+		has_last_generation_ = false;
+		if ( access( filename.c_str(), F_OK ) != 0 && access( GenerationHistoryDefs::indexFilename( filename ).c_str(), F_OK ) != 0 ) return open( filename, descriptor );
+
+		data_file_ = fopen( filename.c_str(), "r+b" );
+		index_file_ = fopen( GenerationHistoryDefs::indexFilename( filename ).c_str(), "r+b" );
+		if ( !data_file_ || !index_file_ )
+		{
+			closeFiles();
+			return false;
+		}
+
+		// never append to a log of differently shaped genomes
+		header_ = makeHeader( descriptor );
+		const GenerationHistoryDefs::IndexHeader index_header = makeIndexHeader();
+		GenerationHistoryDefs::Header file_header;
+		GenerationHistoryDefs::IndexHeader file_index_header;
+		if ( fread( &file_header, sizeof( file_header ), 1, data_file_ ) != 1 || fread( &file_index_header, sizeof( file_index_header ), 1, index_file_ ) != 1
+				|| memcmp( &file_header, &header_, sizeof( header_ ) ) != 0 || memcmp( &file_index_header, &index_header, sizeof( index_header ) ) != 0 )
+		{
+			fprintf( stderr, "%s is not a compatible generation history\n", filename.c_str() );
+			closeFiles();
+			return false;
+		}
+
+		struct stat data_stat;
+		if ( fstat( fileno( data_file_ ), &data_stat ) != 0 )
+		{
+			closeFiles();
+			return false;
+		}
+
+		// keep the complete entries up to the checkpoint's generation; anything after them (including a generation that was
+		// only partly written when the run stopped) goes
+		unsigned long long data_offset = sizeof( header_ );
+		unsigned long long num_generations = 0;
+		GenerationHistoryDefs::IndexEntry entry;
+		while ( fread( &entry, sizeof( entry ), 1, index_file_ ) == 1 && entry.generation_ <= generation && entry.offset_ == data_offset
+				&& entry.offset_ + (unsigned long long) entry.num_individuals_ * header_.record_size_ <= (unsigned long long) data_stat.st_size )
+		{
+			data_offset = entry.offset_ + (unsigned long long) entry.num_individuals_ * header_.record_size_;
+			last_generation_ = entry.generation_;
+			has_last_generation_ = true;
+			++num_generations;
+		}
+
+		if ( ftruncate( fileno( data_file_ ), data_offset ) != 0 || ftruncate( fileno( index_file_ ), sizeof( index_header ) + num_generations * sizeof( entry ) ) != 0
+				|| fseeko( data_file_, data_offset, SEEK_SET ) != 0 || fseeko( index_file_, 0, SEEK_END ) != 0 )
+		{
+			closeFiles();
+			return false;
+		}
+
+		startWriter( data_offset, num_generations );
+		return true;
+	}
+
+	// log the process's current population; call it once the population has been evaluated
+	bool append( const _GeneticProcess & process )
+	{
+		if ( !data_file_ ) return false;
+		ScopedTrace trace( "history append", "history" );
+
+		const _PopulationVector & population = process.population();
+		const std::vector<_ParentIndices> & parent_indices = process.parentIndices();
+		const typename _GeneticProcess::PopulationStatistics & stats = process.populationStatistics();
+
+		Batch * batch = new Batch();
+		memset( &batch->entry_, 0, sizeof( batch->entry_ ) );
+		batch->entry_.generation_ = process.generation();
+		batch->entry_.num_individuals_ = population.size();
+		batch->entry_.min_fitness_ = stats.min_fitness_;
+		batch->entry_.max_fitness_ = stats.max_fitness_;
+		batch->entry_.avg_fitness_ = stats.avg_fitness_;
+
+		batch->records_.resize( population.size() * header_.record_size_ );
+		char * record = batch->records_.empty() ? NULL : &batch->records_[0];
+		for ( size_t i = 0; i < population.size(); ++i, record += header_.record_size_ )
+		{
+			GenerationHistoryDefs::RecordHeader record_header;
+			record_header.fitness_ = population[i]->fitness();
+			record_header.parents_[0] = i < parent_indices.size() ? parentIndex( parent_indices[i].first ) : GenerationHistoryDefs::NO_PARENT;
+			record_header.parents_[1] = i < parent_indices.size() ? parentIndex( parent_indices[i].second ) : GenerationHistoryDefs::NO_PARENT;
+			memcpy( record, &record_header, sizeof( record_header ) );
+			GenomeArchiveDefs::packGenome( population[i], (_DataType *) ( record + sizeof( record_header ) ) );
+		}
+
+		std::unique_lock<std::mutex> lock( mutex_ );
+		queue_changed_.wait( lock, [this]()
+		{	return queued_bytes_ < MAX_QUEUED_BYTES || failed_;} );
+		if ( failed_ )
+		{
+			delete batch;
+			return false;
+		}
+		queued_bytes_ += batch->records_.size();
+		queue_.push_back( batch );
+		last_generation_ = batch->entry_.generation_;
+		has_last_generation_ = true;
+		queue_changed_.notify_all();
+		return true;
+	}
+
+	// blocks until everything appended so far has been written
+	bool flush()
+	{
+		std::unique_lock<std::mutex> lock( mutex_ );
+		queue_changed_.wait( lock, [this]()
+		{	return queue_.empty() || failed_;} );
+		return !failed_;
+	}
+
+	// writes out anything still queued; returns whether every generation made it to disk
+	bool close()
+	{
+		if ( !writer_.joinable() ) return !failed_;
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			stopping_ = true;
+		}
+		queue_changed_.notify_all();
+		writer_.join();
+		closeFiles();
+		return !failed_;
+	}
+
+	// generations written so far
+	unsigned long long numGenerations() const
+	{
+		return num_generations_;
+	}
+
+	// whether the last generation appended (or kept by resume()) is this one
+	bool endsAt( unsigned long long generation ) const
+	{
+		return has_last_generation_ && last_generation_ == generation;
+	}
+
+protected:
+	static GenerationHistoryDefs::Header makeHeader( const typename _Genome::Descriptor & descriptor )
+	{
+		GenerationHistoryDefs::Header header;
+		memset( &header, 0, sizeof( header ) );
+		memcpy( header.magic_, GenerationHistoryDefs::MAGIC, sizeof( header.magic_ ) );
+		header.version_ = GenerationHistoryDefs::VERSION;
+		header.gene_size_ = sizeof( _DataType );
+		header.genome_size_ = descriptor.size_;
+		header.chromosome_size_ = descriptor.chromosome_descriptor_.size_;
+		header.record_size_ = sizeof( GenerationHistoryDefs::RecordHeader ) + header.genome_size_ * header.chromosome_size_ * sizeof( _DataType );
+		return header;
+	}
+
+	static GenerationHistoryDefs::IndexHeader makeIndexHeader()
+	{
+		GenerationHistoryDefs::IndexHeader index_header;
+		memset( &index_header, 0, sizeof( index_header ) );
+		memcpy( index_header.magic_, GenerationHistoryDefs::INDEX_MAGIC, sizeof( index_header.magic_ ) );
+		index_header.version_ = GenerationHistoryDefs::VERSION;
+		index_header.entry_size_ = sizeof( GenerationHistoryDefs::IndexEntry );
+		return index_header;
+	}
+
+	void startWriter( unsigned long long data_offset, unsigned long long num_generations )
+	{
+		data_offset_ = data_offset;
+		num_generations_ = num_generations;
+		stopping_ = false;
+		failed_ = false;
+		writer_ = std::thread( &GenerationHistoryWriter::writerLoop, this );
+	}
+
+	static unsigned int parentIndex( typename _GeneticProcess::_SizeType index )
+	{
+		return index == _GeneticProcess::NO_PARENT ? GenerationHistoryDefs::NO_PARENT : index;
+	}
+
+	void closeFiles()
+	{
+		if ( data_file_ ) fclose( data_file_ );
+		if ( index_file_ ) fclose( index_file_ );
+		data_file_ = NULL;
+		index_file_ = NULL;
+	}
+
+	void writerLoop()
+	{
+		TraceLog::instance().setThreadName( "history writer" );
+
+		std::deque<Batch *> batches;
+		for ( ;; )
+		{
+			{
+				std::unique_lock<std::mutex> lock( mutex_ );
+				queue_changed_.wait( lock, [this]()
+				{	return !queue_.empty() || stopping_;} );
+				if ( queue_.empty() ) return;
+				batches.swap( queue_ );
+			}
+
+			const bool success = writeBatches( batches );
+
+			std::lock_guard<std::mutex> lock( mutex_ );
+			for ( typename std::deque<Batch *>::iterator it = batches.begin(); it != batches.end(); ++it )
+			{
+				queued_bytes_ -= ( *it )->records_.size();
+				delete *it;
+			}
+			batches.clear();
+			if ( !success && !failed_ )
+			{
+				fprintf( stderr, "Failed to write generation history\n" );
+				failed_ = true;
+			}
+			queue_changed_.notify_all();
+			if ( failed_ ) return;
+		}
+	}
+
+	// records first, then the index entries that point at them
+	bool writeBatches( std::deque<Batch *> & batches )
+	{
+		ScopedTrace trace( "history write", "history", "generations", batches.size() );
+
+		for ( typename std::deque<Batch *>::iterator it = batches.begin(); it != batches.end(); ++it )
+		{
+			Batch & batch = **it;
+			batch.entry_.offset_ = data_offset_;
+			if ( !batch.records_.empty() && fwrite( &batch.records_[0], 1, batch.records_.size(), data_file_ ) != batch.records_.size() ) return false;
+			data_offset_ += batch.records_.size();
+		}
+		if ( fflush( data_file_ ) != 0 ) return false;
+
+		for ( typename std::deque<Batch *>::iterator it = batches.begin(); it != batches.end(); ++it )
+		{
+			if ( fwrite( &( *it )->entry_, sizeof( GenerationHistoryDefs::IndexEntry ), 1, index_file_ ) != 1 ) return false;
+		}
+		if ( fflush( index_file_ ) != 0 ) return false;
+
+		num_generations_ += batches.size();
+		return true;
+	}
+};
+
+// memory-maps a generation history; any generation or individual is found in constant time and genomes are read in place
+// refresh() picks up generations appended since open() when the log is still being written
+template<class _GenomeType>
+class GenerationHistoryReader
+{
+public:
+	typedef _GenomeType _Genome;
+	typedef _Genome * _GenomePtr;
+	typedef typename _Genome::__DataType _DataType;
+	typedef typename _Genome::__FitnessType _FitnessType;
+	typedef typename _Genome::Descriptor _Descriptor;
+	typedef typename _Genome::_Chromosome _Chromosome;
+
+protected:
+	GenerationHistoryDefs::MappedFile data_;
+	GenerationHistoryDefs::MappedFile index_;
+	const GenerationHistoryDefs::Header * header_;
+	const GenerationHistoryDefs::IndexEntry * entries_;
+	unsigned long long num_generations_;
+
+public:
+	GenerationHistoryReader() :
+		header_( NULL ), entries_( NULL ), num_generations_( 0 )
+	{
+		//
+	}
+
+	virtual ~GenerationHistoryReader()
+	{
+		close();
+	}
+
+	bool open( const std::string & filename )
+	{
+		close();
+		data_.fd_ = ::open( filename.c_str(), O_RDONLY );
+		index_.fd_ = ::open( GenerationHistoryDefs::indexFilename( filename ).c_str(), O_RDONLY );
+		if ( data_.fd_ < 0 || index_.fd_ < 0 || !refresh() )
+		{
+			close();
+			return false;
+		}
+
+		if ( memcmp( header_->magic_, GenerationHistoryDefs::MAGIC, sizeof( header_->magic_ ) ) != 0 || header_->version_ != GenerationHistoryDefs::VERSION
+				|| header_->gene_size_ != sizeof( _DataType ) )
+		{
+			fprintf( stderr, "%s is not a compatible generation history\n", filename.c_str() );
+			close();
+			return false;
+		}
+
+		const GenerationHistoryDefs::IndexHeader * index_header = (const GenerationHistoryDefs::IndexHeader *) index_.data_;
+		if ( memcmp( index_header->magic_, GenerationHistoryDefs::INDEX_MAGIC, sizeof( index_header->magic_ ) ) != 0 || index_header->version_ != GenerationHistoryDefs::VERSION
+				|| index_header->entry_size_ != sizeof( GenerationHistoryDefs::IndexEntry ) )
+		{
+			fprintf( stderr, "%s is not a compatible generation history index\n", GenerationHistoryDefs::indexFilename( filename ).c_str() );
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	// remap both files to pick up generations written since the last call; pointers returned earlier become invalid
+	bool refresh()
+	{
+		// the index is mapped first: the data for every entry it holds was written before the entry itself
+		if ( !index_.map() || index_.size_ < sizeof( GenerationHistoryDefs::IndexHeader ) ) return false;
+		if ( !data_.map() || data_.size_ < sizeof( GenerationHistoryDefs::Header ) ) return false;
+
+		header_ = (const GenerationHistoryDefs::Header *) data_.data_;
+		entries_ = (const GenerationHistoryDefs::IndexEntry *) ( index_.data_ + sizeof( GenerationHistoryDefs::IndexHeader ) );
+		num_generations_ = ( index_.size_ - sizeof( GenerationHistoryDefs::IndexHeader ) ) / sizeof( GenerationHistoryDefs::IndexEntry );
+
+		// an entry is only trusted if its records are all mapped
+		while ( num_generations_ > 0 && entries_[num_generations_ - 1].offset_ + (unsigned long long) entries_[num_generations_ - 1].num_individuals_ * header_->record_size_ > data_.size_ )
+		{
+			--num_generations_;
+		}
+		return true;
+	}
+
+	void close()
+	{
+		data_.close();
+		index_.close();
+		header_ = NULL;
+		entries_ = NULL;
+		num_generations_ = 0;
+	}
+
+	bool isOpen() const
+	{
+		return header_ != NULL;
+	}
+
+	_Descriptor descriptor() const
+	{
+		return _Descriptor( header_->genome_size_, typename _Chromosome::Descriptor( header_->chromosome_size_ ) );
+	}
+
+	// number of generations logged; entries are numbered 0 .. numGenerations() - 1 in the order they were appended
+	unsigned long long numGenerations() const
+	{
+		return num_generations_;
+	}
+
+	const GenerationHistoryDefs::IndexEntry & entry( unsigned long long entry_index ) const
+	{
+		return entries_[entry_index];
+	}
+
+	// the entry logged for the given process generation, or numGenerations() if it was never logged
+	// a log written every generation is found directly; otherwise the (ordered) entries are bisected
+	unsigned long long findGeneration( unsigned long long generation ) const
+	{
+		if ( num_generations_ == 0 ) return num_generations_;
+		const unsigned long long direct = generation - entries_[0].generation_;
+		if ( generation >= entries_[0].generation_ && direct < num_generations_ && entries_[direct].generation_ == generation ) return direct;
+
+		unsigned long long low = 0, high = num_generations_;
+		while ( low < high )
+		{
+			const unsigned long long middle = low + ( high - low ) / 2;
+			if ( entries_[middle].generation_ < generation ) low = middle + 1;
+			else high = middle;
+		}
+		return low < num_generations_ && entries_[low].generation_ == generation ? low : num_generations_;
+	}
+
+	unsigned int numIndividuals( unsigned long long entry_index ) const
+	{
+		return entries_[entry_index].num_individuals_;
+	}
+
+	_FitnessType fitness( unsigned long long entry_index, unsigned int individual ) const
+	{
+		return recordHeader( entry_index, individual ).fitness_;
+	}
+
+	// positions of the individual's parents in the previous generation, GenerationHistoryDefs::NO_PARENT if unknown
+	std::pair<unsigned int, unsigned int> parents( unsigned long long entry_index, unsigned int individual ) const
+	{
+		const GenerationHistoryDefs::RecordHeader record_header = recordHeader( entry_index, individual );
+		return std::pair<unsigned int, unsigned int>( record_header.parents_[0], record_header.parents_[1] );
+	}
+
+	// points straight into the mapping; valid until the next refresh() or close()
+	const _DataType * genes( unsigned long long entry_index, unsigned int individual ) const
+	{
+		return (const _DataType *) ( record( entry_index, individual ) + sizeof( GenerationHistoryDefs::RecordHeader ) );
+	}
+
+	// the caller owns the result
+	_GenomePtr createGenome( unsigned long long entry_index, unsigned int individual ) const
+	{
+		return GenomeArchiveDefs::unpackGenome<_Genome>( descriptor(), genes( entry_index, individual ) );
+	}
+
+protected:
+	const char * record( unsigned long long entry_index, unsigned int individual ) const
+	{
+		return data_.data_ + entries_[entry_index].offset_ + (unsigned long long) individual * header_->record_size_;
+	}
+
+	GenerationHistoryDefs::RecordHeader recordHeader( unsigned long long entry_index, unsigned int individual ) const
+	{
+		GenerationHistoryDefs::RecordHeader record_header;
+		memcpy( &record_header, record( entry_index, individual ), sizeof( record_header ) );
+		return record_header;
+	}
+};
+
+#endif /* GENERATION_HISTORY_H_ */
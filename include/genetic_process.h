@@ -43,6 +43,12 @@
 #include <stdio.h>
 #include <sstream>
 #include "global_flags.h"
+#include "async_log.h"
+#include "process_metrics.h"
+#include "trace_events.h"
+#include "worker_pool.h"
+#include "memory_accounting.h"
+#include "quantile_sketch.h"
 #include <typeinfo>
 
 /*
@@ -58,9 +64,56 @@
 
 namespace GeneticProcessUtil
 {
+	// the process's random number generator (xoshiro256**); unlike std::rand its state can be saved and restored, which
+	// checkpoints need to resume a run exactly where it stopped. shared by everything that runs on the GA thread
+	struct RandomState
+	{
+		unsigned long long s_[4];
+	};
+
+	inline RandomState & randomState()
+	{
+		static RandomState state = { { 0x9E3779B97F4A7C15ull, 0xBF58476D1CE4E5B9ull, 0x94D049BB133111EBull, 0x2545F4914F6CDD1Dull } };
+		return state;
+	}
+
+	inline void seedRandom( unsigned long long seed )
+	{
+		// splitmix64 spreads the seed over the whole state
+		RandomState & state = randomState();
+		for ( unsigned int i = 0; i < 4; ++i )
+		{
+			unsigned long long z = ( seed += 0x9E3779B97F4A7C15ull );
+			z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+			z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+			state.s_[i] = z ^ ( z >> 31 );
+		}
+	}
+
+	inline unsigned long long nextRandom()
+	{
+		unsigned long long * s = randomState().s_;
+		const unsigned long long x = s[1] * 5;
+		const unsigned long long result = ( ( x << 7 ) | ( x >> 57 ) ) * 9;
+		const unsigned long long t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = ( s[3] << 45 ) | ( s[3] >> 19 );
+		return result;
+	}
+
+	// drop-in for std::rand(): uniform in [0, RAND_MAX]
+	inline int irand()
+	{
+		return (int) ( nextRandom() % ( (unsigned long long) RAND_MAX + 1 ) );
+	}
+
 	static double drand()
 	{
-		return (double) std::rand() / RAND_MAX;
+		return (double) irand() / RAND_MAX;
 	}
 
 	// return a random number between "low" and "high"; if "nonzero" is true then this value will never be zero
@@ -128,24 +181,27 @@ public:
 		data_ = data;
 	}
 
-	virtual void tryMutate()
+	// returns true if the gene was mutated
+	virtual bool tryMutate()
 	{
 		if ( GeneticProcessUtil::drand() <= mutation_rate_ )
 		{
-			__DEBUG__VERBOSE__ printf( "--mutating gene %s\n", this->toString().c_str() );
+			__DEBUG__VERBOSE__ logPrintf( "--mutating gene %s\n", this->toString().c_str() );
 			if ( enable_dynamic_mutation_rate_ ) mutation_rate_ = GeneticProcessUtil::rand( min_mutation_rate_, max_mutation_rate_ );
 			this->mutate();
+			return true;
 		}
+		return false;
 	}
 
 	virtual void mutate()
 	{
-		__DEBUG__VERBOSE__ printf( "Cannot mutate GeneBase\n" );
+		__DEBUG__VERBOSE__ logPrintf( "Cannot mutate GeneBase\n" );
 	}
 
 	virtual void randomize()
 	{
-		__DEBUG__VERBOSE__ printf( "Cannot randomize GeneBase\n" );
+		__DEBUG__VERBOSE__ logPrintf( "Cannot randomize GeneBase\n" );
 	}
 
 	const _DataType & data() const
@@ -301,18 +357,22 @@ public:
 		}
 	}
 
-	virtual void mutate( double mutation_rate = 0.001 )
+	// returns the number of genes that were mutated
+	virtual _SizeType mutate( double mutation_rate = 0.001 )
 	{
-		__DEBUG__VERBOSE__ printf( "Mutating chromosome with mutation rate %f\n", mutation_rate );
+		__DEBUG__VERBOSE__ logPrintf( "Mutating chromosome with mutation rate %f\n", mutation_rate );
+		_SizeType num_mutated = 0;
 		_GeneIterator it = genes_.begin();
 		for ( _SizeType i = 0; it != genes_.end(); ++it, ++i )
 		{
-			( *it )->tryMutate();
+			if ( ( *it )->tryMutate() ) ++num_mutated;
 		}
+		return num_mutated;
 	}
 
 	virtual void randomize()
 	{
+		MemoryScope memory_scope( MemorySubsystem::genes );
 		_GeneIterator it = genes_.begin();
 		for ( ; it != genes_.end(); ++it )
 		{
@@ -325,7 +385,12 @@ public:
 
 	virtual _ChromosomePtr copy()
 	{
-		_ChromosomePtr new_chromosome = new _Chromosome( descriptor_, _GeneVector( descriptor_.size_ ) );
+		_ChromosomePtr new_chromosome;
+		{
+			MemoryScope memory_scope( MemorySubsystem::chromosomes );
+			new_chromosome = new _Chromosome( descriptor_, _GeneVector( descriptor_.size_ ) );
+		}
+		MemoryScope memory_scope( MemorySubsystem::genes );
 		_GeneIterator old_gene_it = begin();
 		_GeneIterator new_gene_it = new_chromosome->genes_.begin();
 
@@ -337,8 +402,8 @@ public:
 			*new_gene_it = new_gene;
 		}
 
-		// __DEBUG__VERBOSE__ printf( "Old chromosome %s\n", toString().c_str() );
-		// __DEBUG__VERBOSE__ printf( "New chromosome %s\n", new_chromosome->toString().c_str() );
+		// __DEBUG__VERBOSE__ logPrintf( "Old chromosome %s\n", toString().c_str() );
+		// __DEBUG__VERBOSE__ logPrintf( "New chromosome %s\n", new_chromosome->toString().c_str() );
 
 		//std::copy( genes_.begin(), genes_.end(), new_chromosome->genes_.begin() );
 		return new_chromosome;
@@ -427,6 +492,14 @@ public:
 		return chromosomes_;
 	}
 
+	// hand the chromosomes over to the caller, leaving this genome empty (and safe to delete)
+	_ChromosomeVector releaseChromosomes()
+	{
+		_ChromosomeVector chromosomes;
+		chromosomes.swap( chromosomes_ );
+		return chromosomes;
+	}
+
 	virtual ~Genome()
 	{
 		for ( _ChromosomeIterator it = begin(); it != end(); ++it )
@@ -445,7 +518,7 @@ public:
 		 const _Gene & gene1 = *current_chromosome->begin();
 		 const _Gene & gene2 = * ( current_chromosome->begin() + 1 );
 		 _FitnessType chromosome_fitness = gene1.data() - gene2.data();
-		 __DEBUG__VERBOSE__ printf( "chromosome %s fitness: %f\n", current_chromosome->toString().c_str(), chromosome_fitness );
+		 __DEBUG__VERBOSE__ logPrintf( "chromosome %s fitness: %f\n", current_chromosome->toString().c_str(), chromosome_fitness );
 		 fitness_ += chromosome_fitness;
 		 for ( _GeneIterator gene_it = current_chromosome->begin(); gene_it != current_chromosome->end(); ++gene_it )
 		 {
@@ -461,16 +534,24 @@ public:
 		return fitness_;
 	}
 
-	// performs mutation and returns the mutated genome
-	virtual void mutate( double mutation_rate = 0.001 )
+	// restore a fitness calculated earlier (e.g. from a checkpoint) without evaluating again, or replace it with a reshaped one
+	void setFitness( const _FitnessType & fitness )
 	{
-		__DEBUG__VERBOSE__ printf( "Mutating genome with mutation rate %f\n", mutation_rate );
+		fitness_ = fitness;
+	}
+
+	// performs mutation in place and returns the number of genes that were mutated
+	virtual _SizeType mutate( double mutation_rate = 0.001 )
+	{
+		__DEBUG__VERBOSE__ logPrintf( "Mutating genome with mutation rate %f\n", mutation_rate );
+		_SizeType num_mutated = 0;
 		_ChromosomeIterator it = chromosomes_.begin();
 		for ( ; it != chromosomes_.end(); ++it )
 		{
 			_ChromosomePtr current_chromosome = *it;
-			current_chromosome->mutate( mutation_rate );
+			num_mutated += current_chromosome->mutate( mutation_rate );
 		}
+		return num_mutated;
 	}
 
 	virtual void randomize()
@@ -479,7 +560,11 @@ public:
 		for ( ; it != chromosomes_.end(); ++it )
 		{
 			if ( *it ) delete *it;
-			_ChromosomePtr new_chromosome = new _Chromosome( descriptor_.chromosome_descriptor_ );
+			_ChromosomePtr new_chromosome;
+			{
+				MemoryScope memory_scope( MemorySubsystem::chromosomes );
+				new_chromosome = new _Chromosome( descriptor_.chromosome_descriptor_ );
+			}
 			new_chromosome->randomize();
 			*it = new_chromosome;
 		}
@@ -494,9 +579,13 @@ public:
 	{
 		if ( copy_length == 0 ) copy_length = chromosomes_.size();
 
-		__DEBUG__VERBOSE__ printf( "--genome copy from chr%u to chr%u\n", start, start + copy_length );
+		__DEBUG__VERBOSE__ logPrintf( "--genome copy from chr%u to chr%u\n", start, start + copy_length );
 
-		_GenomePtr new_genome = new _Genome( descriptor_ );
+		_GenomePtr new_genome;
+		{
+			MemoryScope memory_scope( MemorySubsystem::genomes );
+			new_genome = new _Genome( descriptor_ );
+		}
 		// new_genome->chromosomes_.reserve( copy_length );
 
 		_ChromosomeIterator old_it = begin() + start;
@@ -569,24 +658,31 @@ public:
 
 	typedef std::pair<_GenomePtr, _GenomePtr> _GeneticPair;
 
+	// positions of an individual's parents in the previous generation; the first parent supplied the chromosomes before the
+	// crossover point, the second those after it
+	typedef std::pair<_SizeType, _SizeType> _ParentIndices;
+
 	struct Family
 	{
 		_GeneticPair parents_;
 		_GeneticPair children_;
+		// chromosomes before this point come from the child's own parent (first for the first child, second for the second)
+		_SizeType crossover_point_;
 
-		Family()
+		Family() :
+			crossover_point_( 0 )
 		{
 			//
 		}
 
-		Family( _GeneticPair parents, _GeneticPair children ) :
-			parents_( parents ), children_( children )
+		Family( _GeneticPair parents, _GeneticPair children, _SizeType crossover_point = 0 ) :
+			parents_( parents ), children_( children ), crossover_point_( crossover_point )
 		{
 			//
 		}
 
-		Family( _GenomePtr parent1, _GenomePtr parent2, _GenomePtr child1, _GenomePtr child2 ) :
-			parents_( _GeneticPair( parent1, parent2 ) ), children_( _GeneticPair( child1, child2 ) )
+		Family( _GenomePtr parent1, _GenomePtr parent2, _GenomePtr child1, _GenomePtr child2, _SizeType crossover_point = 0 ) :
+			parents_( _GeneticPair( parent1, parent2 ) ), children_( _GeneticPair( child1, child2 ) ), crossover_point_( crossover_point )
 		{
 			//
 		}
@@ -599,16 +695,27 @@ public:
 		double mutation_rate_;
 		long random_seed_;
 		typename _Genome::Descriptor genome_descriptor_;
+		// threads used to evaluate the population; selection, crossover and mutation always run on the calling thread
+		unsigned int num_threads_;
 
-		Descriptor( _SizeType population_size, double mutation_rate, long random_seed, typename _Genome::Descriptor genome_descriptor ) :
-			population_size_( population_size ), mutation_rate_( mutation_rate ), random_seed_( random_seed ), genome_descriptor_( genome_descriptor )
+		Descriptor( _SizeType population_size, double mutation_rate, long random_seed, typename _Genome::Descriptor genome_descriptor, unsigned int num_threads = 1 ) :
+			population_size_( population_size ), mutation_rate_( mutation_rate ), random_seed_( random_seed ), genome_descriptor_( genome_descriptor ), num_threads_( num_threads )
 		{
-			std::srand( random_seed_ );
+			GeneticProcessUtil::seedRandom( random_seed_ );
 		}
 	};
 
 	typedef Family _Family;
 
+	typedef ProcessMetrics::Phase _Phase;
+	typedef ProcessMetrics::Counter _Counter;
+
+	// the population is split into this many chunks per evaluation thread so uneven genomes still balance out
+	const static unsigned int CHUNKS_PER_THREAD = 4;
+
+	// parent index of individuals with no known parents (the initial population, restored or failed selections)
+	const static _SizeType NO_PARENT = (_SizeType) -1;
+
 	struct PopulationStatistics
 	{
 		_FitnessType total_fitness_;
@@ -616,6 +723,11 @@ public:
 		_FitnessType min_fitness_;
 		_FitnessType max_fitness_;
 		_FitnessType avg_fitness_;
+		// within QuantileSketch's relative accuracy, read off fitnessSketch()
+		_FitnessType p10_fitness_;
+		_FitnessType p50_fitness_;
+		_FitnessType p90_fitness_;
+		_FitnessType p99_fitness_;
 
 		PopulationStatistics()
 		{
@@ -623,6 +735,41 @@ public:
 		}
 	};
 
+	// observes every evaluation of the population, e.g. to keep the best individuals of a run
+	// individualEvaluated() is called from the evaluation threads, each with its own worker index below the num_workers passed
+	// to beginEvaluation(); the other two are called on the thread that evaluates the population
+	class EvaluationListener
+	{
+	public:
+		virtual ~EvaluationListener()
+		{
+			//
+		}
+
+		virtual void beginEvaluation( unsigned int num_workers )
+		{
+			//
+		}
+
+		virtual void individualEvaluated( unsigned int worker, _GenomePtr genome, const _FitnessType & fitness )
+		{
+			//
+		}
+
+		// reshape the fitness of the population (e.g. reward novelty) once every individual has been evaluated; selection
+		// uses the reshaped values. return true if any fitness was changed
+		virtual bool adjustFitness( GeneticProcess & process )
+		{
+			return false;
+		}
+
+		// the population statistics are up to date by the time this is called
+		virtual void endEvaluation( GeneticProcess & process )
+		{
+			//
+		}
+	};
+
 	struct Flags
 	{
 		bool population_evaluated_;
@@ -638,20 +785,83 @@ protected:
 	_PopulationVector population_;
 	Descriptor descriptor_;
 	PopulationStatistics population_stats_;
+	// distribution of the fitness of the population as last evaluated
+	QuantileSketch fitness_sketch_;
+	// one per chunk of evaluateParallel(), kept between evaluations so they don't reallocate
+	std::vector<QuantileSketch> chunk_sketches_;
 	Flags flags_;
+	ProcessMetrics metrics_;
+	// only created when evaluating on more than one thread
+	WorkerPool * worker_pool_;
+	// number of generations stepped since the initial population
+	unsigned long long generation_;
+	// parents of each pair returned by the last selectBestParents()
+	std::vector<_ParentIndices> selected_parents_;
+	// parents of each individual in the current population
+	std::vector<_ParentIndices> parent_indices_;
+	// and the crossover point it was made with
+	std::vector<_SizeType> crossover_points_;
+	// not owned
+	std::vector<EvaluationListener *> evaluation_listeners_;
 
 public:
 	GeneticProcess( Descriptor descriptor, _PopulationVector population = _PopulationVector() ) :
-		descriptor_( descriptor )
+		descriptor_( descriptor ), worker_pool_( NULL ), generation_( 0 )
 	{
 		if ( population.size() > 0 ) population_ = population;
 		else population_.resize( descriptor_.population_size_ );
+		parent_indices_.assign( population_.size(), _ParentIndices( NO_PARENT, NO_PARENT ) );
+		crossover_points_.assign( population_.size(), 0 );
 
+		if ( descriptor_.num_threads_ > 1 ) worker_pool_ = new WorkerPool( descriptor_.num_threads_ - 1 );
 	}
 
 	virtual ~GeneticProcess()
 	{
-		//
+		if ( worker_pool_ ) delete worker_pool_;
+	}
+
+	const Descriptor & descriptor() const
+	{
+		return descriptor_;
+	}
+
+	unsigned long long generation() const
+	{
+		return generation_;
+	}
+
+	bool populationEvaluated() const
+	{
+		return flags_.population_evaluated_;
+	}
+
+	// replace the whole state of the process (e.g. from a checkpoint); the process takes ownership of the population
+	// the statistics are only used if evaluated is true, otherwise the population is evaluated on the next step
+	// an evaluated population is decoded again (on the worker pool, if there is one), as whatever genomes derive from their
+	// genes when evaluated (e.g. AudioGenome's wave descriptors) isn't part of a checkpoint; the fitness stays as given, since
+	// listeners may have reshaped it
+	virtual void restore( unsigned long long generation, const _PopulationVector & population, const PopulationStatistics & population_stats, bool evaluated )
+	{
+		for ( _PopulationIterator it = population_.begin(); it != population_.end(); ++it )
+		{
+			if ( *it ) delete *it;
+		}
+		population_ = population;
+		parent_indices_.assign( population_.size(), _ParentIndices( NO_PARENT, NO_PARENT ) );
+		crossover_points_.assign( population_.size(), 0 );
+		population_stats_ = population_stats;
+		flags_.population_evaluated_ = evaluated;
+		generation_ = generation;
+		// the sketch isn't part of the statistics passed in, but the restored population carries its fitness
+		fitness_sketch_.clear();
+		if ( evaluated )
+		{
+			decodePopulation();
+			for ( _PopulationIterator it = population_.begin(); it != population_.end(); ++it )
+				fitness_sketch_.add( ( *it )->fitness() );
+			updateQuantiles();
+		}
 	}
 
 	_PopulationVector & population()
@@ -659,13 +869,74 @@ public:
 		return population_;
 	}
 
+	const _PopulationVector & population() const
+	{
+		return population_;
+	}
+
+	// parents of each individual, by position in the previous generation's population
+	const std::vector<_ParentIndices> & parentIndices() const
+	{
+		return parent_indices_;
+	}
+
+	// crossover point each individual was made with; parentIndices() says which parent supplied which side
+	const std::vector<_SizeType> & crossoverPoints() const
+	{
+		return crossover_points_;
+	}
+
+	const PopulationStatistics & populationStatistics() const
+	{
+		return population_stats_;
+	}
+
+	// e.g. for other quantiles or a histogram of the fitness
+	const QuantileSketch & fitnessSketch() const
+	{
+		return fitness_sketch_;
+	}
+
+	// the process doesn't take ownership; the listener must outlive it or be removed first
+	void addEvaluationListener( EvaluationListener * listener )
+	{
+		evaluation_listeners_.push_back( listener );
+	}
+
+	void removeEvaluationListener( EvaluationListener * listener )
+	{
+		evaluation_listeners_.erase( std::remove( evaluation_listeners_.begin(), evaluation_listeners_.end(), listener ), evaluation_listeners_.end() );
+	}
+
+	// per-phase timers and counters for step(); use metrics().openDump() to write them out after every generation
+	ProcessMetrics & metrics()
+	{
+		return metrics_;
+	}
+
 	virtual void initializePopulation()
 	{
-		__DEBUG__QUIET__ printf( "Initializing population...\n" );
+		initializePopulation( _PopulationVector() );
+	}
+
+	// start from the given genomes (e.g. elites of an earlier run) and fill the rest of the population with random ones
+	// the process takes ownership of the seeds; any beyond the population size are deleted
+	virtual void initializePopulation( const _PopulationVector & seeds )
+	{
+		__DEBUG__QUIET__ logPrintf( "Initializing population from %zu seeds...\n", seeds.size() );
 		_PopulationIterator it = population_.begin();
+		for ( typename _PopulationVector::const_iterator seed_it = seeds.begin(); seed_it != seeds.end(); ++seed_it )
+		{
+			if ( it != population_.end() ) *it++ = *seed_it;
+			else delete *seed_it;
+		}
 		for ( ; it != population_.end(); ++it )
 		{
-			_GenomePtr new_genome = new _Genome( descriptor_.genome_descriptor_ );
+			_GenomePtr new_genome;
+			{
+				MemoryScope memory_scope( MemorySubsystem::genomes );
+				new_genome = new _Genome( descriptor_.genome_descriptor_ );
+			}
 			new_genome->randomize();
 			*it = new_genome;
 		}
@@ -679,7 +950,7 @@ public:
 		for ( _SizeType i = 0; it != population_.end(); ++it, ++i )
 		{
 			_GenomePtr current_genome = *it;
-			__DEBUG__QUIET__ printf( "%u: %p\n%s\n", i, current_genome, current_genome ? current_genome->toString().c_str() : "NULL_GENOME" );
+			__DEBUG__QUIET__ logPrintf( "%u: %p\n%s\n", i, current_genome, current_genome ? current_genome->toString().c_str() : "NULL_GENOME" );
 		}
 	}
 
@@ -694,49 +965,208 @@ public:
 
 	virtual void evaluatePopulation( bool unconditional_evaluation = false )
 	{
-		__DEBUG__NORMAL__ printf( "Evaluating population of %u individuals... %u\n", population_.size(), unconditional_evaluation );
+		__DEBUG__NORMAL__ logPrintf( "Evaluating population of %zu individuals... %u\n", population_.size(), unconditional_evaluation );
 		if ( !flags_.population_evaluated_ || unconditional_evaluation )
 		{
+			const unsigned long long phase_start = metrics_.startPhase();
+			ScopedTrace trace( "evaluate", "ga", "individuals", population_.size() );
 			population_stats_.total_fitness_ = 0;
-			_PopulationIterator it = population_.begin();
+			fitness_sketch_.clear();
 
-			_FitnessType current_fitness;
+			const bool parallel = worker_pool_ && population_.size() > 1;
+			for ( typename std::vector<EvaluationListener *>::iterator listener_it = evaluation_listeners_.begin(); listener_it != evaluation_listeners_.end(); ++listener_it )
+			{
+				( *listener_it )->beginEvaluation( parallel ? worker_pool_->numWorkers() : 1 );
+			}
 
-			for ( ; it != population_.end(); ++it )
+			if ( parallel ) evaluateParallel();
+			else
 			{
-				current_fitness = evaluateIndividual( *it );
-				if ( it == population_.begin() )
+				_PopulationIterator it = population_.begin();
+
+				_FitnessType current_fitness;
+
+				for ( ; it != population_.end(); ++it )
 				{
-					population_stats_.min_fitness_ = current_fitness;
-					population_stats_.max_fitness_ = current_fitness;
+					current_fitness = evaluateIndividual( *it );
+					notifyEvaluated( 0, *it, current_fitness );
+					if ( it == population_.begin() )
+					{
+						population_stats_.min_fitness_ = current_fitness;
+						population_stats_.max_fitness_ = current_fitness;
+					}
+					if ( current_fitness < population_stats_.min_fitness_ ) population_stats_.min_fitness_ = current_fitness;
+					if ( current_fitness > population_stats_.max_fitness_ ) population_stats_.max_fitness_ = current_fitness;
+					population_stats_.total_fitness_ += current_fitness;
+					fitness_sketch_.add( current_fitness );
 				}
-				if ( current_fitness < population_stats_.min_fitness_ ) population_stats_.min_fitness_ = current_fitness;
-				if ( current_fitness > population_stats_.max_fitness_ ) population_stats_.max_fitness_ = current_fitness;
-				population_stats_.total_fitness_ += current_fitness;
 			}
+
+			bool fitness_adjusted = false;
+			for ( typename std::vector<EvaluationListener *>::iterator listener_it = evaluation_listeners_.begin(); listener_it != evaluation_listeners_.end(); ++listener_it )
+			{
+				fitness_adjusted |= ( *listener_it )->adjustFitness( *this );
+			}
+			if ( fitness_adjusted ) gatherStatistics();
+			updateQuantiles();
+
 			population_stats_.avg_fitness_ = population_stats_.total_fitness_ / (_FitnessType) population_.size();
 
-			__DEBUG__VERBOSE__ printf( "Total fitness: %f\n", population_stats_.total_fitness_ );
+			__DEBUG__VERBOSE__ logPrintf( "Total fitness: %f\n", population_stats_.total_fitness_ );
 
 			population_stats_.total_fitness_ += -1 * (_FitnessType) population_.size() * ( population_stats_.min_fitness_ - 1 );
 
-			__DEBUG__VERBOSE__ printf( "Total fitness: %f\n", population_stats_.total_fitness_ );
+			__DEBUG__VERBOSE__ logPrintf( "Total fitness: %f\n", population_stats_.total_fitness_ );
 
 			population_stats_.total_fitness_proportion_ = (_FitnessType) RAND_MAX / population_stats_.total_fitness_;
 
 			flags_.population_evaluated_ = true;
+
+			for ( typename std::vector<EvaluationListener *>::iterator listener_it = evaluation_listeners_.begin(); listener_it != evaluation_listeners_.end(); ++listener_it )
+			{
+				( *listener_it )->endEvaluation( *this );
+			}
+
+			metrics_.count( _Counter::genes_evaluated, (unsigned long long) population_.size() * descriptor_.genome_descriptor_.size_ * descriptor_.genome_descriptor_.chromosome_descriptor_.size_ );
+			metrics_.stopPhase( _Phase::evaluation, phase_start );
 		}
 		else
 		{
-			__DEBUG__NORMAL__ printf( "--statistics already gathered:\n" );
+			__DEBUG__NORMAL__ logPrintf( "--statistics already gathered:\n" );
+		}
+		__DEBUG__QUIET__ logPrintf( "--population stats:\nmin: %f\nmax: %f\navg: %f\n\n", population_stats_.min_fitness_, population_stats_.max_fitness_, population_stats_.avg_fitness_ );
+	}
+
+protected:
+	// min, max, total and sketch of the fitness of the population as it stands
+	void gatherStatistics()
+	{
+		population_stats_.total_fitness_ = 0;
+		fitness_sketch_.clear();
+		for ( _PopulationIterator it = population_.begin(); it != population_.end(); ++it )
+		{
+			const _FitnessType current_fitness = ( *it )->fitness();
+			if ( it == population_.begin() || current_fitness < population_stats_.min_fitness_ ) population_stats_.min_fitness_ = current_fitness;
+			if ( it == population_.begin() || current_fitness > population_stats_.max_fitness_ ) population_stats_.max_fitness_ = current_fitness;
+			population_stats_.total_fitness_ += current_fitness;
+			fitness_sketch_.add( current_fitness );
+		}
+	}
+
+	// evaluate every individual again for what it derives from its genes, keeping the fitness it has; in the same chunks as
+	// evaluateParallel() when there's a worker pool
+	void decodePopulation()
+	{
+		ScopedTrace trace( "decode population", "ga", "individuals", population_.size() );
+		const size_t num_chunks = worker_pool_ && population_.size() > 1 ? std::min<size_t>( population_.size(), worker_pool_->numWorkers() * CHUNKS_PER_THREAD ) : 1;
+		const size_t chunk_size = ( population_.size() + num_chunks - 1 ) / num_chunks;
+		auto decode_chunk = [this, chunk_size]( unsigned int chunk, unsigned int )
+		{
+			const size_t end = std::min( ( chunk + 1 ) * chunk_size, population_.size() );
+			for ( size_t i = chunk * chunk_size; i < end; ++i )
+			{
+				const _FitnessType fitness = population_[i]->fitness();
+				evaluateIndividual( population_[i] );
+				population_[i]->setFitness( fitness );
+			}
+		};
+
+		if ( num_chunks > 1 ) worker_pool_->run( num_chunks, decode_chunk );
+		else decode_chunk( 0, 0 );
+	}
+
+	// read the quantiles off the sketch into the statistics and the metrics, clamped to the range of the population's fitness
+	// (the sketch only knows a value to within its relative accuracy)
+	void updateQuantiles()
+	{
+		population_stats_.p10_fitness_ = clampFitness( (_FitnessType) fitness_sketch_.quantile( 0.1 ) );
+		population_stats_.p50_fitness_ = clampFitness( (_FitnessType) fitness_sketch_.quantile( 0.5 ) );
+		population_stats_.p90_fitness_ = clampFitness( (_FitnessType) fitness_sketch_.quantile( 0.9 ) );
+		population_stats_.p99_fitness_ = clampFitness( (_FitnessType) fitness_sketch_.quantile( 0.99 ) );
+
+		const double quantiles[ProcessMetrics::FitnessQuantile::NUM_QUANTILES] = { (double) population_stats_.min_fitness_, (double) population_stats_.p10_fitness_,
+				(double) population_stats_.p50_fitness_, (double) population_stats_.p90_fitness_, (double) population_stats_.p99_fitness_, (double) population_stats_.max_fitness_ };
+		metrics_.setFitnessQuantiles( quantiles );
+	}
+
+	_FitnessType clampFitness( _FitnessType fitness ) const
+	{
+		return std::min( std::max( fitness, population_stats_.min_fitness_ ), population_stats_.max_fitness_ );
+	}
+
+	void notifyEvaluated( unsigned int worker, _GenomePtr genome, const _FitnessType & fitness )
+	{
+		for ( typename std::vector<EvaluationListener *>::iterator listener_it = evaluation_listeners_.begin(); listener_it != evaluation_listeners_.end(); ++listener_it )
+		{
+			( *listener_it )->individualEvaluated( worker, genome, fitness );
 		}
-		__DEBUG__QUIET__ printf( "--population stats:\nmin: %f\nmax: %f\navg: %f\n\n", population_stats_.min_fitness_, population_stats_.max_fitness_, population_stats_.avg_fitness_ );
 	}
 
+	// evaluates fixed chunks of the population on the worker pool and merges the per-chunk statistics in chunk order
+	// the fitness sketches merge by adding bucket counts, so the quantiles don't depend on the chunking either
+	// as long as a genome's fitness only depends on its genes, the statistics are those of a serial evaluation (up to the
+	// rounding of the total) whatever the number of threads
+	void evaluateParallel()
+	{
+		const unsigned int num_chunks = std::min<size_t>( population_.size(), worker_pool_->numWorkers() * CHUNKS_PER_THREAD );
+		const size_t chunk_size = ( population_.size() + num_chunks - 1 ) / num_chunks;
+
+		std::vector<PopulationStatistics> chunk_stats( num_chunks );
+		// one flag per chunk, written by whichever thread evaluates it (not a vector<bool>, whose elements share bytes)
+		std::vector<char> chunk_used( num_chunks, false );
+		if ( chunk_sketches_.size() < num_chunks ) chunk_sketches_.resize( num_chunks );
+
+		worker_pool_->run( num_chunks, [this, chunk_size, &chunk_stats, &chunk_used]( unsigned int chunk, unsigned int worker )
+		{
+			const size_t begin = chunk * chunk_size;
+			const size_t end = std::min( begin + chunk_size, population_.size() );
+			if ( begin >= end ) return;
+
+			ScopedTrace trace( "evaluate chunk", "ga", "individuals", end - begin );
+
+			PopulationStatistics & stats = chunk_stats[chunk];
+			QuantileSketch & sketch = chunk_sketches_[chunk];
+			stats.total_fitness_ = 0;
+			sketch.clear();
+			for ( size_t i = begin; i < end; ++i )
+			{
+				const _FitnessType current_fitness = evaluateIndividual( population_[i] );
+				notifyEvaluated( worker, population_[i], current_fitness );
+				if ( i == begin || current_fitness < stats.min_fitness_ ) stats.min_fitness_ = current_fitness;
+				if ( i == begin || current_fitness > stats.max_fitness_ ) stats.max_fitness_ = current_fitness;
+				stats.total_fitness_ += current_fitness;
+				sketch.add( current_fitness );
+			}
+			chunk_used[chunk] = true;
+		} );
+
+		bool first = true;
+		for ( unsigned int chunk = 0; chunk < num_chunks; ++chunk )
+		{
+			if ( !chunk_used[chunk] ) continue;
+			const PopulationStatistics & stats = chunk_stats[chunk];
+			if ( first || stats.min_fitness_ < population_stats_.min_fitness_ ) population_stats_.min_fitness_ = stats.min_fitness_;
+			if ( first || stats.max_fitness_ > population_stats_.max_fitness_ ) population_stats_.max_fitness_ = stats.max_fitness_;
+			population_stats_.total_fitness_ += stats.total_fitness_;
+			fitness_sketch_.merge( chunk_sketches_[chunk] );
+			first = false;
+		}
+	}
+
+public:
 	// assumes evaluatePopulation() has been run and the relevant statistics have been gathered
+	// note: selectBestParents() draws through rouletteSelectIndex(), which is what to override to change how parents are picked
 	virtual _GenomePtr rouletteSelect()
 	{
-		__DEBUG__NORMAL__ printf( "--starting roulette\n" );
+		const _SizeType index = rouletteSelectIndex();
+		return index != NO_PARENT ? population_[index] : NULL;
+	}
+
+	// as rouletteSelect(), but returns the position of the selected individual (NO_PARENT on failure)
+	virtual _SizeType rouletteSelectIndex()
+	{
+		__DEBUG__NORMAL__ logPrintf( "--starting roulette\n" );
+		metrics_.count( _Counter::selection_draws );
 		// total area = RAND_MAX
 		// ball position = rand()
 		// we have N individuals, each with a fitness F
@@ -744,47 +1174,52 @@ public:
 		// so the area for each individual is ( RAND_MAX / T ) * i_N->F
 
 
-		_FitnessType selection = (_FitnessType) std::rand();
+		_FitnessType selection = (_FitnessType) GeneticProcessUtil::irand();
 		_FitnessType total = 0;
 
-		_PopulationIterator it = population_.begin();
 		_FitnessType lower_bound = -population_stats_.min_fitness_ + 1;
-		for ( ; it != population_.end(); ++it )
+		for ( _SizeType i = 0; i < population_.size(); ++i )
 		{
-			_GenomePtr current_genome = *it;
-			_FitnessType slice = ( lower_bound + current_genome->fitness() ) * population_stats_.total_fitness_proportion_;
-			__DEBUG__NORMAL__ printf( "total: %f\nslice: %f\n", total, slice );
-			if ( total <= selection && selection < total + slice ) return current_genome;
+			_FitnessType slice = ( lower_bound + population_[i]->fitness() ) * population_stats_.total_fitness_proportion_;
+			__DEBUG__NORMAL__ logPrintf( "total: %f\nslice: %f\n", total, slice );
+			if ( total <= selection && selection < total + slice ) return i;
 			total += slice;
 		}
 
-		__DEBUG__QUIET__ printf( "roulette select failed!\n" );
+		__DEBUG__QUIET__ logPrintf( "roulette select failed!\n" );
 
-		return NULL;
+		return NO_PARENT;
 	}
 
 	const virtual _PopulationVector & step( _SizeType num_generations = 1, bool pre_evaluate = false, bool post_evaluate = true )
 	{
-		__DEBUG__QUIET__ printf( "\n--stepping for %u generations--\n", num_generations );
+		__DEBUG__QUIET__ logPrintf( "\n--stepping for %u generations--\n", num_generations );
 		for ( _SizeType i = 0; i < num_generations; ++i )
 		{
-			__DEBUG__QUIET__ printf( "--currently on generation %u--\n", i );
+			__DEBUG__QUIET__ logPrintf( "--currently on generation %u--\n", i );
+			metrics_.beginGeneration();
+			MemoryAccounting::instance().beginGeneration();
+			ScopedTrace trace( "generation", "ga", "generation", generation_ + 1 );
 			std::vector<_GeneticPair> best_parents = selectBestParents( pre_evaluate );
 
 			__DEBUG__NORMAL__
 			{
-				printf( "--selected best parents:\n" );
+				logPrintf( "--selected best parents:\n" );
 				for ( typename std::vector<_GeneticPair>::iterator it = best_parents.begin(); it != best_parents.end(); ++it )
 				{
-					printf( "{%s}\n{%s}\n-----\n", it->first->toString().c_str(), it->second->toString().c_str() );
+					logPrintf( "{%s}\n{%s}\n-----\n", it->first->toString().c_str(), it->second->toString().c_str() );
 				}
 			}
 
 			createNewGeneration( best_parents );
+			++generation_;
 
 			if ( post_evaluate ) evaluatePopulation();
+
+			metrics_.endGeneration();
+			MemoryAccounting::instance().endGeneration();
 		}
-		__DEBUG__QUIET__ printf( "--stepping complete\n\n" );
+		__DEBUG__QUIET__ logPrintf( "--stepping complete\n\n" );
 		return population_;
 	}
 
@@ -796,6 +1231,9 @@ public:
 	{
 		if ( pre_evaluate ) evaluatePopulation();
 
+		const unsigned long long phase_start = metrics_.startPhase();
+		ScopedTrace trace( "select", "ga" );
+
 		// std::sort_heap( population_.front(), population_.back(), _Genome::compare );
 
 		// we can only ever have an even number of parents (from which we produce an even number of children)
@@ -804,30 +1242,36 @@ public:
 
 		_SizeType num_pairs = ceil( descriptor_.population_size_ / 2 );
 		parent_pairs.reserve( num_pairs );
+		selected_parents_.clear();
+		selected_parents_.reserve( num_pairs );
 
 		for ( _SizeType i = 0; i < num_pairs; ++i )
 		{
 			// we want parents to breed more than once but we don't want a parent to breed with itself
-			_GenomePtr parent1 = rouletteSelect();
-			_GenomePtr parent2 = NULL;
+			_SizeType parent1 = rouletteSelectIndex();
+			_SizeType parent2 = NO_PARENT;
 			unsigned int timeout = 0;
 			do
 			{
-				parent2 = rouletteSelect();
+				parent2 = rouletteSelectIndex();
 				++timeout;
 			}
 			while ( parent1 == parent2 && timeout < 20 );
 
-			parent_pairs.push_back( _GeneticPair( parent1, parent2 ) );
+			parent_pairs.push_back( _GeneticPair( parent1 != NO_PARENT ? population_[parent1] : NULL, parent2 != NO_PARENT ? population_[parent2] : NULL ) );
+			selected_parents_.push_back( _ParentIndices( parent1, parent2 ) );
 		}
 
+		metrics_.stopPhase( _Phase::selection, phase_start );
+
 		return parent_pairs;
 	}
 
 	// performs all steps necessary to generate a new population including deleting the old one
 	virtual void createNewGeneration( std::vector<_GeneticPair> parent_pairs )
 	{
-		__DEBUG__VERBOSE__ printf( "--creating new generation from %zu parent pairs--\n", parent_pairs.size() );
+		__DEBUG__VERBOSE__ logPrintf( "--creating new generation from %zu parent pairs--\n", parent_pairs.size() );
+		const unsigned long long allocations_start = MemoryAccounting::threadAllocations();
 		// for each pair, make a pair of new children via:
 		// crossover
 		// mutation
@@ -836,24 +1280,39 @@ public:
 		std::vector<_Family> new_families;
 		new_families.reserve( parent_pairs.size() );
 
-		// make the new children
-		typename std::vector<_GeneticPair>::iterator it = parent_pairs.begin();
-		for ( ; it != parent_pairs.end(); ++it )
+		// make the new children; each family is crossed over and mutated in turn (the order of the random draws is part of
+		// what a seed reproduces), so the two phases are timed per family and share one trace span
+		unsigned long long phase_start = metrics_.startPhase();
 		{
-			_GeneticPair current_parent_pair = *it;
-			_Family current_family = crossover( current_parent_pair );
-			current_family.children_.first->mutate( descriptor_.mutation_rate_ );
-			current_family.children_.second->mutate( descriptor_.mutation_rate_ );
+			ScopedTrace trace( "crossover+mutate", "ga" );
+			unsigned long long num_mutated = 0;
+			typename std::vector<_GeneticPair>::iterator it = parent_pairs.begin();
+			for ( ; it != parent_pairs.end(); ++it )
+			{
+				_Family current_family = crossover( *it );
+				phase_start = metrics_.switchPhase( _Phase::crossover, phase_start );
 
-			new_families.push_back( current_family );
+				num_mutated += current_family.children_.first->mutate( descriptor_.mutation_rate_ );
+				num_mutated += current_family.children_.second->mutate( descriptor_.mutation_rate_ );
+				new_families.push_back( current_family );
+				phase_start = metrics_.switchPhase( _Phase::mutation, phase_start );
+			}
+			metrics_.count( _Counter::genes_mutated, num_mutated );
 		}
 
 		// delete the parents and put the children into the population
+		phase_start = metrics_.startPhase();
+		ScopedTrace trace( "replace", "ga" );
+
+		// the selected parent indices only describe these pairs if they came from the last selectBestParents()
+		const bool parents_known = selected_parents_.size() == parent_pairs.size();
+		parent_indices_.assign( population_.size(), _ParentIndices( NO_PARENT, NO_PARENT ) );
+		crossover_points_.assign( population_.size(), 0 );
 
 		_SizeType population_counter = 0;
 		typename std::vector<_Family>::iterator new_families_it = new_families.begin();
 		_PopulationIterator population_it = population_.begin();
-		for ( ; new_families_it != new_families.end(); ++new_families_it )
+		for ( _SizeType family = 0; new_families_it != new_families.end(); ++new_families_it, ++family )
 		{
 			_Family current_family = *new_families_it;
 
@@ -865,29 +1324,38 @@ public:
 				current_genome = ( i == 0 ) ? current_family.children_.first : current_family.children_.second;
 
 				*population_it = current_genome;
+
+				// the second child takes its head from the second parent
+				if ( parents_known ) parent_indices_[population_counter] = ( i == 0 ) ? selected_parents_[family] : _ParentIndices( selected_parents_[family].second, selected_parents_[family].first );
+				crossover_points_[population_counter] = current_family.crossover_point_;
 			}
 		}
+		selected_parents_.clear();
 
 		// since we just changed the population, set this flag to reflect that
 		flags_.population_evaluated_ = false;
+
+		metrics_.count( _Counter::allocations, MemoryAccounting::threadAllocations() - allocations_start );
+
+		metrics_.stopPhase( _Phase::replacement, phase_start );
 	}
 
 	// performs crossover and returns the entire family
 	// note: performs crossover only on whole chromosomes so no chromosomes are ever split
 	virtual _Family crossover( const _GeneticPair & parents )
 	{
-		__DEBUG__VERBOSE__ printf( "--crossing over parents:\n{%s}\n{%s}\n", parents.first->toString().c_str(), parents.second->toString().c_str() );
+		__DEBUG__VERBOSE__ logPrintf( "--crossing over parents:\n{%s}\n{%s}\n", parents.first->toString().c_str(), parents.second->toString().c_str() );
 		_SizeType crossover_point = GeneticProcessUtil::rand( (_SizeType) 0, descriptor_.genome_descriptor_.size_ - 1 );
 
-		__DEBUG__VERBOSE__ printf( "--selected crossover point %u\n", crossover_point );
+		__DEBUG__VERBOSE__ logPrintf( "--selected crossover point %u\n", crossover_point );
 
 		// copy everything before the crossover point from the parents into the children
-		_Family result( parents, _GeneticPair( parents.first->copy( 0, crossover_point ), parents.second->copy( 0, crossover_point ) ) );
+		_Family result( parents, _GeneticPair( parents.first->copy( 0, crossover_point ), parents.second->copy( 0, crossover_point ) ), crossover_point );
 
-		__DEBUG__VERBOSE__ printf( "--child1's first data chunk: %s\n", result.children_.first->toString().c_str() );
-		__DEBUG__VERBOSE__ printf( "--child2's first data chunk: %s\n", result.children_.second->toString().c_str() );
+		__DEBUG__VERBOSE__ logPrintf( "--child1's first data chunk: %s\n", result.children_.first->toString().c_str() );
+		__DEBUG__VERBOSE__ logPrintf( "--child2's first data chunk: %s\n", result.children_.second->toString().c_str() );
 
-		__DEBUG__VERBOSE__ printf( "--copied parents genetic data into children; beginning crossover\n" );
+		__DEBUG__VERBOSE__ logPrintf( "--copied parents genetic data into children; beginning crossover\n" );
 
 		std::pair<_ChromosomeIterator, _ChromosomeIterator> child_chromosome_it( result.children_.first->begin() + crossover_point, result.children_.second->begin() + crossover_point );
 		std::pair<_ChromosomeIterator, _ChromosomeIterator> parent_chromosome_it( result.parents_.first->begin() + crossover_point, result.parents_.second->begin() + crossover_point );
@@ -896,12 +1364,20 @@ public:
 		// iterate through every remaining chromosome and swap
 		for ( ; child_chromosome_it.first != result.children_.first->end(); ++child_chromosome_it.first, ++child_chromosome_it.second, ++parent_chromosome_it.first, ++parent_chromosome_it.second )
 		{
+			// a crossover point of 0 copied the whole parents above, so there may be a chromosome to replace
+			if ( *child_chromosome_it.first ) delete *child_chromosome_it.first;
+			if ( *child_chromosome_it.second ) delete *child_chromosome_it.second;
 			* ( child_chromosome_it.first ) = ( *parent_chromosome_it.second )->copy();
 			* ( child_chromosome_it.second ) = ( *parent_chromosome_it.first )->copy();
 		}
 
-		__DEBUG__VERBOSE__ printf( "--child1's full data: %s\n", result.children_.first->toString().c_str() );
-		__DEBUG__VERBOSE__ printf( "--child2's full data: %s\n", result.children_.second->toString().c_str() );
+		__DEBUG__VERBOSE__ logPrintf( "--child1's full data: %s\n", result.children_.first->toString().c_str() );
+		__DEBUG__VERBOSE__ logPrintf( "--child2's full data: %s\n", result.children_.second->toString().c_str() );
+
+		// copy( 0, 0 ) copies the whole genome, so a crossover point of 0 copies (and frees) every chromosome before swapping them all
+		const _SizeType genome_size = descriptor_.genome_descriptor_.size_;
+		const unsigned long long chromosomes_copied = 2 * ( ( crossover_point == 0 ? genome_size : crossover_point ) + ( genome_size - crossover_point ) );
+		metrics_.count( _Counter::crossover_copies, chromosomes_copied );
 
 		return result;
 	}
@@ -0,0 +1,354 @@
+/*******************************************************************************
+ *
+ *      genome_archive
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef GENOME_ARCHIVE_H_
+#define GENOME_ARCHIVE_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "genetic_process.h"
+
+/*
+ * Packed genome archive
+ *
+ * header (32 bytes):
+ *   char[8]  magic "CSGENOME"
+ *   uint32   version
+ *   uint32   gene size in bytes (sizeof( _DataType ))
+ *   uint32   chromosomes per genome
+ *   uint32   genes per chromosome
+ *   uint64   number of genomes
+ * records (one per genome, fixed size):
+ *   double      fitness
+ *   _DataType[] genes, chromosome by chromosome
+ *
+ * all values are stored in host byte order; the gene data type must be trivially copyable
+ */
+namespace GenomeArchiveDefs
+{
+	const static char MAGIC[8] = { 'C', 'S', 'G', 'E', 'N', 'O', 'M', 'E' };
+	const static unsigned int VERSION = 1;
+
+	struct Header
+	{
+		char magic_[8];
+		unsigned int version_;
+		unsigned int gene_size_;
+		unsigned int genome_size_;
+		unsigned int chromosome_size_;
+		unsigned long long num_genomes_;
+	};
+
+	// copy all genes of a genome into a contiguous array of genome_size * chromosome_size values
+	template<class _GenomeType>
+	static void packGenome( _GenomeType * genome, typename _GenomeType::__DataType * genes )
+	{
+		typedef typename _GenomeType::_ChromosomeIterator _ChromosomeIterator;
+		typedef typename _GenomeType::_GeneIterator _GeneIterator;
+
+		for ( _ChromosomeIterator chromosome_it = genome->begin(); chromosome_it != genome->end(); ++chromosome_it )
+		{
+			for ( _GeneIterator gene_it = ( *chromosome_it )->begin(); gene_it != ( *chromosome_it )->end(); ++gene_it, ++genes )
+			{
+				*genes = ( *gene_it )->data_;
+			}
+		}
+	}
+
+	// build a new genome from a contiguous array of genes; the caller owns the result
+	template<class _GenomeType>
+	static _GenomeType * unpackGenome( const typename _GenomeType::Descriptor & descriptor, const typename _GenomeType::__DataType * genes )
+	{
+		typedef typename _GenomeType::_Chromosome _Chromosome;
+		typedef typename _GenomeType::_ChromosomeVector _ChromosomeVector;
+		typedef typename _GenomeType::_GeneVector _GeneVector;
+		typedef typename _GenomeType::_Gene _Gene;
+
+		_ChromosomeVector chromosomes( descriptor.size_ );
+		for ( typename _ChromosomeVector::iterator chromosome_it = chromosomes.begin(); chromosome_it != chromosomes.end(); ++chromosome_it )
+		{
+			_GeneVector gene_ptrs( descriptor.chromosome_descriptor_.size_ );
+			for ( typename _GeneVector::iterator gene_it = gene_ptrs.begin(); gene_it != gene_ptrs.end(); ++gene_it, ++genes )
+			{
+				*gene_it = new _Gene();
+				( *gene_it )->data_ = *genes;
+			}
+			*chromosome_it = new _Chromosome( descriptor.chromosome_descriptor_, gene_ptrs );
+		}
+		return new _GenomeType( descriptor, chromosomes );
+	}
+}
+
+// appends genomes to a packed archive; records are streamed straight to disk
+template<class _GenomeType>
+class GenomeArchiveWriter
+{
+public:
+	typedef _GenomeType _Genome;
+	typedef _Genome * _GenomePtr;
+	typedef typename _Genome::__DataType _DataType;
+	typedef typename _Genome::__FitnessType _FitnessType;
+	typedef typename _Genome::Descriptor _Descriptor;
+
+protected:
+	FILE * file_;
+	GenomeArchiveDefs::Header header_;
+	std::vector<_DataType> genes_;
+
+	void writeHeader()
+	{
+		fseek( file_, 0, SEEK_SET );
+		fwrite( &header_, sizeof( header_ ), 1, file_ );
+		fseek( file_, 0, SEEK_END );
+	}
+
+public:
+	GenomeArchiveWriter() :
+		file_( NULL )
+	{
+		//
+	}
+
+	virtual ~GenomeArchiveWriter()
+	{
+		close();
+	}
+
+	bool open( const std::string & filename, const _Descriptor & descriptor )
+	{
+		close();
+		file_ = fopen( filename.c_str(), "wb" );
+		if ( !file_ ) return false;
+
+		memset( &header_, 0, sizeof( header_ ) );
+		memcpy( header_.magic_, GenomeArchiveDefs::MAGIC, sizeof( header_.magic_ ) );
+		header_.version_ = GenomeArchiveDefs::VERSION;
+		header_.gene_size_ = sizeof( _DataType );
+		header_.genome_size_ = descriptor.size_;
+		header_.chromosome_size_ = descriptor.chromosome_descriptor_.size_;
+		header_.num_genomes_ = 0;
+		genes_.resize( header_.genome_size_ * header_.chromosome_size_ );
+
+		writeHeader();
+		return true;
+	}
+
+	bool write( _GenomePtr genome )
+	{
+		return write( genome, genome->fitness() );
+	}
+
+	bool write( _GenomePtr genome, const _FitnessType & fitness )
+	{
+		if ( !file_ ) return false;
+		GenomeArchiveDefs::packGenome( genome, &genes_[0] );
+		return write( &genes_[0], fitness );
+	}
+
+	// genes must hold genome_size * chromosome_size values
+	bool write( const _DataType * genes, const _FitnessType & fitness )
+	{
+		if ( !file_ ) return false;
+		const double stored_fitness = fitness;
+		if ( fwrite( &stored_fitness, sizeof( stored_fitness ), 1, file_ ) != 1 ) return false;
+		if ( fwrite( genes, sizeof( _DataType ), genes_.size(), file_ ) != genes_.size() ) return false;
+		++header_.num_genomes_;
+		return true;
+	}
+
+	void close()
+	{
+		if ( !file_ ) return;
+		writeHeader();
+		fclose( file_ );
+		file_ = NULL;
+	}
+
+	unsigned long long numGenomes() const
+	{
+		return header_.num_genomes_;
+	}
+};
+
+// memory-maps a packed archive; genomes are read in place and only turned into Genome objects on request
+template<class _GenomeType>
+class GenomeArchiveReader
+{
+public:
+	typedef _GenomeType _Genome;
+	typedef _Genome * _GenomePtr;
+	typedef typename _Genome::__DataType _DataType;
+	typedef typename _Genome::__FitnessType _FitnessType;
+	typedef typename _Genome::Descriptor _Descriptor;
+	typedef typename _Genome::_Chromosome _Chromosome;
+
+protected:
+	int fd_;
+	const char * data_;
+	size_t size_;
+	const GenomeArchiveDefs::Header * header_;
+	size_t record_size_;
+
+public:
+	GenomeArchiveReader() :
+		fd_( -1 ), data_( NULL ), size_( 0 ), header_( NULL ), record_size_( 0 )
+	{
+		//
+	}
+
+	virtual ~GenomeArchiveReader()
+	{
+		close();
+	}
+
+	bool open( const std::string & filename )
+	{
+		close();
+		fd_ = ::open( filename.c_str(), O_RDONLY );
+		if ( fd_ < 0 ) return false;
+
+		struct stat file_stat;
+		if ( fstat( fd_, &file_stat ) != 0 || (size_t) file_stat.st_size < sizeof( GenomeArchiveDefs::Header ) )
+		{
+			close();
+			return false;
+		}
+
+		size_ = file_stat.st_size;
+		void * mapping = mmap( NULL, size_, PROT_READ, MAP_SHARED, fd_, 0 );
+		if ( mapping == MAP_FAILED )
+		{
+			data_ = NULL;
+			close();
+			return false;
+		}
+		data_ = (const char *) mapping;
+		header_ = (const GenomeArchiveDefs::Header *) data_;
+
+		if ( memcmp( header_->magic_, GenomeArchiveDefs::MAGIC, sizeof( header_->magic_ ) ) != 0 || header_->version_ != GenomeArchiveDefs::VERSION || header_->gene_size_
+				!= sizeof( _DataType ) )
+		{
+			fprintf( stderr, "%s is not a compatible genome archive\n", filename.c_str() );
+			close();
+			return false;
+		}
+
+		record_size_ = sizeof( double ) + (size_t) genesPerGenome() * sizeof( _DataType );
+		if ( sizeof( GenomeArchiveDefs::Header ) + header_->num_genomes_ * record_size_ > size_ )
+		{
+			fprintf( stderr, "%s is truncated\n", filename.c_str() );
+			close();
+			return false;
+		}
+
+		// records are only ever read front to back
+		madvise( mapping, size_, MADV_SEQUENTIAL );
+		return true;
+	}
+
+	void close()
+	{
+		if ( data_ ) munmap( (void *) data_, size_ );
+		if ( fd_ >= 0 ) ::close( fd_ );
+		fd_ = -1;
+		data_ = NULL;
+		header_ = NULL;
+		size_ = 0;
+	}
+
+	bool isOpen() const
+	{
+		return data_ != NULL;
+	}
+
+	unsigned long long numGenomes() const
+	{
+		return header_ ? header_->num_genomes_ : 0;
+	}
+
+	unsigned int genesPerGenome() const
+	{
+		return header_->genome_size_ * header_->chromosome_size_;
+	}
+
+	_Descriptor descriptor() const
+	{
+		return _Descriptor( header_->genome_size_, typename _Chromosome::Descriptor( header_->chromosome_size_ ) );
+	}
+
+	_FitnessType fitness( unsigned long long index ) const
+	{
+		double stored_fitness;
+		memcpy( &stored_fitness, record( index ), sizeof( stored_fitness ) );
+		return stored_fitness;
+	}
+
+	// points straight into the mapping; valid until close()
+	const _DataType * genes( unsigned long long index ) const
+	{
+		return (const _DataType *) ( record( index ) + sizeof( double ) );
+	}
+
+	// the caller owns the result
+	_GenomePtr createGenome( unsigned long long index ) const
+	{
+		return GenomeArchiveDefs::unpackGenome<_Genome>( descriptor(), genes( index ) );
+	}
+
+	// drop the mapped pages of records [first, first + count) that are no longer needed, so a pass over an archive larger
+	// than memory keeps its resident set flat; the records can still be read afterwards (they're paged in again)
+	void release( unsigned long long first, unsigned long long count ) const
+	{
+		const size_t page_size = sysconf( _SC_PAGESIZE );
+		// only whole pages inside the range, so neighbouring records that are still in use stay mapped
+		const size_t begin = ( ( record( first ) - data_ ) + page_size - 1 ) / page_size * page_size;
+		const size_t end = ( record( first + count ) - data_ ) / page_size * page_size;
+		if ( end > begin ) madvise( (void *) ( data_ + begin ), end - begin, MADV_DONTNEED );
+	}
+
+protected:
+	const char * record( unsigned long long index ) const
+	{
+		return data_ + sizeof( GenomeArchiveDefs::Header ) + index * record_size_;
+	}
+};
+
+#endif /* GENOME_ARCHIVE_H_ */
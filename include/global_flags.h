@@ -36,6 +36,10 @@
 #ifndef GLOBAL_FLAGS_H_
 #define GLOBAL_FLAGS_H_
 
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
 namespace flags
 {
 	namespace io
@@ -47,7 +51,38 @@ namespace flags
 			const static int NORMAL = 2;
 			const static int VERBOSE = 3;
 
+			// highest level compiled in; anything above it is removed by the compiler
 			const static int LEVEL = VERBOSE;
+
+			// default runtime level, unless overridden by the CHROMOSOUND_LOG_LEVEL environment variable
+			const static int DEFAULT_LEVEL = QUIET;
+
+			// accepts silent/quiet/normal/verbose or 0-3; returns -1 for anything else
+			inline int parseLevel( const char * name )
+			{
+				if ( !name ) return -1;
+				if ( strcmp( name, "silent" ) == 0 || strcmp( name, "0" ) == 0 ) return SILENT;
+				if ( strcmp( name, "quiet" ) == 0 || strcmp( name, "1" ) == 0 ) return QUIET;
+				if ( strcmp( name, "normal" ) == 0 || strcmp( name, "2" ) == 0 ) return NORMAL;
+				if ( strcmp( name, "verbose" ) == 0 || strcmp( name, "3" ) == 0 ) return VERBOSE;
+				return -1;
+			}
+
+			inline std::atomic<int> & runtimeLevel()
+			{
+				static std::atomic<int> level( parseLevel( getenv( "CHROMOSOUND_LOG_LEVEL" ) ) >= 0 ? parseLevel( getenv( "CHROMOSOUND_LOG_LEVEL" ) ) : DEFAULT_LEVEL );
+				return level;
+			}
+
+			inline int level()
+			{
+				return runtimeLevel().load( std::memory_order_relaxed );
+			}
+
+			inline void setLevel( int level )
+			{
+				runtimeLevel().store( level, std::memory_order_relaxed );
+			}
 		}
 	}
 }
@@ -55,10 +90,11 @@ namespace flags
 #ifndef __DEBUG__LEVELS__
 #define __DEBUG__LEVELS__
 
-#define __DEBUG__SILENT__  if( flags::io::debug::LEVEL >= flags::io::debug::SILENT )
-#define __DEBUG__QUIET__  if( flags::io::debug::LEVEL >= flags::io::debug::QUIET )
-#define __DEBUG__NORMAL__  if( flags::io::debug::LEVEL >= flags::io::debug::NORMAL )
-#define __DEBUG__VERBOSE__  if( flags::io::debug::LEVEL >= flags::io::debug::VERBOSE )
+// the statement following the macro (and so every argument it formats) only runs when its level is enabled
+#define __DEBUG__SILENT__  if( flags::io::debug::LEVEL >= flags::io::debug::SILENT && flags::io::debug::level() >= flags::io::debug::SILENT )
+#define __DEBUG__QUIET__  if( flags::io::debug::LEVEL >= flags::io::debug::QUIET && flags::io::debug::level() >= flags::io::debug::QUIET )
+#define __DEBUG__NORMAL__  if( flags::io::debug::LEVEL >= flags::io::debug::NORMAL && flags::io::debug::level() >= flags::io::debug::NORMAL )
+#define __DEBUG__VERBOSE__  if( flags::io::debug::LEVEL >= flags::io::debug::VERBOSE && flags::io::debug::level() >= flags::io::debug::VERBOSE )
 
 #endif
 
@@ -0,0 +1,274 @@
+/*******************************************************************************
+ *
+ *      hall_of_fame
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef HALL_OF_FAME_H_
+#define HALL_OF_FAME_H_
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include "genetic_process.h"
+#include "genome_archive.h"
+
+// the best distinct individuals seen over a whole run, kept after the GA has deleted them
+//
+// the evaluation threads offer every individual they evaluate to a candidate buffer of their own (no locks, no sharing),
+// which only keeps that worker's best capacity individuals and skips anything below the current hall at a glance. when
+// the population has been evaluated the buffers are merged into the hall on the GA thread, deduplicated by a hash of the
+// genes, and the result is published as an immutable snapshot. readers (e.g. playback) grab the latest snapshot at any time
+// and keep it as long as they like. the snapshot pointer is swapped with std::atomic_load/store, which libstdc++ guards with
+// a lock, so a reader may wait for a publish (or the other way round), but only for the copy of the pointer
+template<class _GeneticProcessType>
+class HallOfFame: public _GeneticProcessType::EvaluationListener
+{
+public:
+	typedef _GeneticProcessType _GeneticProcess;
+	typedef typename _GeneticProcess::_Genome _Genome;
+	typedef typename _GeneticProcess::_GenomePtr _GenomePtr;
+	typedef typename _GeneticProcess::_DataType _DataType;
+	typedef typename _GeneticProcess::_FitnessType _FitnessType;
+	typedef typename _GeneticProcess::_ChromosomeIterator _ChromosomeIterator;
+	typedef typename _GeneticProcess::_GeneIterator _GeneIterator;
+
+	struct Descriptor
+	{
+		// number of individuals kept
+		unsigned int capacity_;
+
+		Descriptor( unsigned int capacity = 10 ) :
+			capacity_( capacity )
+		{
+			//
+		}
+	};
+
+	struct Entry
+	{
+		// FNV-1a over the packed genes
+		unsigned long long hash_;
+		_FitnessType fitness_;
+		// generation the individual was first seen in
+		unsigned long long generation_;
+		std::vector<_DataType> genes_;
+	};
+
+	// best first
+	struct Snapshot
+	{
+		// generation the snapshot was published after
+		unsigned long long generation_;
+		std::vector<Entry> entries_;
+	};
+
+	typedef std::shared_ptr<const Snapshot> _SnapshotPtr;
+
+protected:
+	struct Candidate
+	{
+		_GenomePtr genome_;
+		_FitnessType fitness_;
+		unsigned long long hash_;
+	};
+
+	// one per evaluation thread, each on its own cache lines
+	struct alignas( 64 ) WorkerCandidates
+	{
+		std::vector<Candidate> candidates_;
+	};
+
+	Descriptor descriptor_;
+	typename _Genome::Descriptor genome_descriptor_;
+	std::vector<WorkerCandidates> workers_;
+	// fitness an individual must reach to have a chance of getting in
+	std::atomic<double> threshold_;
+	// only touched by the GA thread
+	std::vector<Entry> entries_;
+	_SnapshotPtr snapshot_;
+
+public:
+	HallOfFame( Descriptor descriptor, typename _Genome::Descriptor genome_descriptor ) :
+		descriptor_( descriptor ), genome_descriptor_( genome_descriptor ), threshold_( -std::numeric_limits<double>::infinity() ), snapshot_( std::make_shared<Snapshot>() )
+	{
+		//
+	}
+
+	virtual ~HallOfFame()
+	{
+		//
+	}
+
+	// the latest published hall; safe to call from any thread at any time
+	_SnapshotPtr snapshot() const
+	{
+		return std::atomic_load( &snapshot_ );
+	}
+
+	// the caller owns the result
+	_GenomePtr createGenome( const Entry & entry ) const
+	{
+		return GenomeArchiveDefs::unpackGenome<_Genome>( genome_descriptor_, &entry.genes_[0] );
+	}
+
+	void beginEvaluation( unsigned int num_workers )
+	{
+		if ( workers_.size() < num_workers ) workers_.resize( num_workers );
+		for ( size_t i = 0; i < workers_.size(); ++i )
+		{
+			workers_[i].candidates_.clear();
+			workers_[i].candidates_.reserve( descriptor_.capacity_ );
+		}
+	}
+
+	void individualEvaluated( unsigned int worker, _GenomePtr genome, const _FitnessType & fitness )
+	{
+		if ( descriptor_.capacity_ == 0 || fitness < threshold_.load( std::memory_order_relaxed ) ) return;
+
+		Candidate candidate;
+		candidate.genome_ = genome;
+		candidate.fitness_ = fitness;
+		candidate.hash_ = hash( genome );
+
+		std::vector<Candidate> & candidates = workers_[worker].candidates_;
+		for ( typename std::vector<Candidate>::iterator it = candidates.begin(); it != candidates.end(); ++it )
+		{
+			if ( it->hash_ != candidate.hash_ ) continue;
+			if ( candidate.fitness_ > it->fitness_ )
+			{
+				// a better candidate may belong further down the heap
+				*it = candidate;
+				std::make_heap( candidates.begin(), candidates.end(), better );
+			}
+			return;
+		}
+
+		// the buffer is a heap with the worst candidate on top
+		if ( candidates.size() < descriptor_.capacity_ )
+		{
+			candidates.push_back( candidate );
+			std::push_heap( candidates.begin(), candidates.end(), better );
+		}
+		else if ( better( candidate, candidates.front() ) )
+		{
+			std::pop_heap( candidates.begin(), candidates.end(), better );
+			candidates.back() = candidate;
+			std::push_heap( candidates.begin(), candidates.end(), better );
+		}
+	}
+
+	// merge the workers' candidates into the hall and publish it if it changed
+	void endEvaluation( _GeneticProcess & process )
+	{
+		ScopedTrace trace( "hall of fame", "ga" );
+		bool changed = false;
+
+		for ( size_t worker = 0; worker < workers_.size(); ++worker )
+		{
+			std::vector<Candidate> & candidates = workers_[worker].candidates_;
+			for ( typename std::vector<Candidate>::iterator it = candidates.begin(); it != candidates.end(); ++it )
+			{
+				changed |= admit( *it, process.generation() );
+			}
+			candidates.clear();
+		}
+
+		if ( !changed ) return;
+
+		std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+		snapshot->generation_ = process.generation();
+		snapshot->entries_ = entries_;
+		std::atomic_store( &snapshot_, _SnapshotPtr( snapshot ) );
+
+		if ( entries_.size() == descriptor_.capacity_ ) threshold_.store( entries_.back().fitness_, std::memory_order_relaxed );
+	}
+
+protected:
+	// strict ordering: fitter first, ties broken by hash so the hall doesn't depend on which thread saw what
+	static bool better( const Candidate & a, const Candidate & b )
+	{
+		return a.fitness_ > b.fitness_ || ( a.fitness_ == b.fitness_ && a.hash_ < b.hash_ );
+	}
+
+	static bool betterEntry( const Entry & a, const Entry & b )
+	{
+		return a.fitness_ > b.fitness_ || ( a.fitness_ == b.fitness_ && a.hash_ < b.hash_ );
+	}
+
+	static unsigned long long hash( _GenomePtr genome )
+	{
+		unsigned long long result = 14695981039346656037ULL;
+		for ( _ChromosomeIterator chromosome_it = genome->begin(); chromosome_it != genome->end(); ++chromosome_it )
+		{
+			for ( _GeneIterator gene_it = ( *chromosome_it )->begin(); gene_it != ( *chromosome_it )->end(); ++gene_it )
+			{
+				const unsigned char * bytes = (const unsigned char *) &( *gene_it )->data_;
+				for ( size_t i = 0; i < sizeof( _DataType ); ++i )
+				{
+					result = ( result ^ bytes[i] ) * 1099511628211ULL;
+				}
+			}
+		}
+		return result;
+	}
+
+	// returns true if the hall changed
+	bool admit( const Candidate & candidate, unsigned long long generation )
+	{
+		// the same genes may come back (e.g. from a parent that was copied over); keep the best fitness they reached
+		for ( typename std::vector<Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it )
+		{
+			if ( it->hash_ != candidate.hash_ ) continue;
+			if ( candidate.fitness_ <= it->fitness_ ) return false;
+			it->fitness_ = candidate.fitness_;
+			std::sort( entries_.begin(), entries_.end(), betterEntry );
+			return true;
+		}
+
+		Entry entry;
+		entry.hash_ = candidate.hash_;
+		entry.fitness_ = candidate.fitness_;
+		entry.generation_ = generation;
+		if ( entries_.size() == descriptor_.capacity_ && !betterEntry( entry, entries_.back() ) ) return false;
+
+		entry.genes_.resize( genome_descriptor_.size_ * genome_descriptor_.chromosome_descriptor_.size_ );
+		GenomeArchiveDefs::packGenome( candidate.genome_, &entry.genes_[0] );
+		entries_.insert( std::upper_bound( entries_.begin(), entries_.end(), entry, betterEntry ), entry );
+		if ( entries_.size() > descriptor_.capacity_ ) entries_.pop_back();
+		return true;
+	}
+};
+
+#endif /* HALL_OF_FAME_H_ */
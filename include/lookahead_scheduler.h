@@ -0,0 +1,181 @@
+/*******************************************************************************
+ *
+ *      lookahead_scheduler
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef LOOKAHEAD_SCHEDULER_H_
+#define LOOKAHEAD_SCHEDULER_H_
+
+#include <deque>
+
+// decides when the genetic process should produce a new generation and when a produced generation should be handed to the audio queue
+// - the amount of audio waiting to be played is tracked in milliseconds (not in buffers) so the lookahead is independent of note lengths
+// - generations are produced speculatively (up to max_generations_ahead_) while the queued audio is far ahead
+// - a produced generation is only queued once the queued audio drops below the low watermark, which bounds the
+//   latency between a generation being evolved and it being heard to roughly low_watermark_ms_ plus one generation
+// _GenerationType is whatever the caller needs to hand a generation to its audio queue (e.g. the population's wave descriptors)
+template<class _GenerationType>
+class LookaheadScheduler
+{
+public:
+	typedef _GenerationType _Generation;
+
+	struct Descriptor
+	{
+	public:
+		// queue the next pending generation when the queued audio drops below this
+		float low_watermark_ms_;
+		// don't produce any more generations when queued + pending audio exceeds this
+		float high_watermark_ms_;
+		// never hold more than this many produced-but-unqueued generations
+		unsigned int max_generations_ahead_;
+		// bounds for the suggested polling interval
+		float min_poll_interval_ms_;
+		float max_poll_interval_ms_;
+
+		Descriptor( float low_watermark_ms = 1000, float high_watermark_ms = 4000, unsigned int max_generations_ahead = 4, float min_poll_interval_ms = 10,
+				float max_poll_interval_ms = 250 ) :
+			low_watermark_ms_( low_watermark_ms ), high_watermark_ms_( high_watermark_ms ), max_generations_ahead_( max_generations_ahead ), min_poll_interval_ms_( min_poll_interval_ms ),
+					max_poll_interval_ms_( max_poll_interval_ms )
+		{
+			//
+		}
+	};
+
+protected:
+	Descriptor descriptor_;
+	// durations of every buffer handed to the audio queue that hasn't finished playing yet, in queue order
+	std::deque<float> queued_durations_ms_;
+	float queued_ms_;
+	// generations that have been produced but not yet queued, and how long each of them plays for
+	std::deque<_Generation> pending_generations_;
+	std::deque<float> pending_durations_ms_;
+	float pending_ms_;
+
+public:
+	LookaheadScheduler( Descriptor descriptor = Descriptor() ) :
+		descriptor_( descriptor ), queued_ms_( 0 ), pending_ms_( 0 )
+	{
+		//
+	}
+
+	const Descriptor & descriptor() const
+	{
+		return descriptor_;
+	}
+
+	// milliseconds of audio waiting in the audio queue
+	float queuedMs() const
+	{
+		return queued_ms_ > 0 ? queued_ms_ : 0;
+	}
+
+	// milliseconds of audio that has been produced but not yet queued
+	float pendingMs() const
+	{
+		return pending_ms_ > 0 ? pending_ms_ : 0;
+	}
+
+	unsigned int numPendingGenerations() const
+	{
+		return pending_generations_.size();
+	}
+
+	unsigned int numQueuedBuffers() const
+	{
+		return queued_durations_ms_.size();
+	}
+
+	// true if the genetic process should step now; this is either required (nothing pending and we're below the low
+	// watermark) or speculative (we're still below the high watermark and have room for another generation)
+	bool wantsGeneration() const
+	{
+		if ( pending_generations_.size() >= descriptor_.max_generations_ahead_ ) return false;
+		if ( pending_generations_.empty() && queuedMs() < descriptor_.low_watermark_ms_ ) return true;
+		return queuedMs() + pendingMs() < descriptor_.high_watermark_ms_;
+	}
+
+	// true if the front pending generation should be handed to the audio queue now
+	bool hasReadyGeneration() const
+	{
+		return !pending_generations_.empty() && queuedMs() < descriptor_.low_watermark_ms_;
+	}
+
+	// store a freshly-produced generation until it's needed
+	void pushGeneration( const _Generation & generation, float duration_ms )
+	{
+		pending_generations_.push_back( generation );
+		pending_durations_ms_.push_back( duration_ms );
+		pending_ms_ += duration_ms;
+	}
+
+	// remove the front pending generation; the caller is expected to call bufferQueued() for each buffer it queues
+	_Generation popGeneration()
+	{
+		_Generation generation = pending_generations_.front();
+		pending_generations_.pop_front();
+		pending_ms_ -= pending_durations_ms_.front();
+		pending_durations_ms_.pop_front();
+		if ( pending_generations_.empty() ) pending_ms_ = 0;
+		return generation;
+	}
+
+	void bufferQueued( float duration_ms )
+	{
+		queued_durations_ms_.push_back( duration_ms );
+		queued_ms_ += duration_ms;
+	}
+
+	// the audio queue reported that the oldest num_buffers buffers finished playing
+	void buffersPlayed( unsigned int num_buffers )
+	{
+		for ( unsigned int i = 0; i < num_buffers && !queued_durations_ms_.empty(); ++i )
+		{
+			queued_ms_ -= queued_durations_ms_.front();
+			queued_durations_ms_.pop_front();
+		}
+		if ( queued_durations_ms_.empty() ) queued_ms_ = 0;
+	}
+
+	// how long the caller can sleep before the queue is expected to cross the low watermark
+	float getPollIntervalMs() const
+	{
+		float interval = queuedMs() - descriptor_.low_watermark_ms_;
+		if ( wantsGeneration() || hasReadyGeneration() ) interval = descriptor_.min_poll_interval_ms_;
+		if ( interval < descriptor_.min_poll_interval_ms_ ) interval = descriptor_.min_poll_interval_ms_;
+		if ( interval > descriptor_.max_poll_interval_ms_ ) interval = descriptor_.max_poll_interval_ms_;
+		return interval;
+	}
+};
+
+#endif /* LOOKAHEAD_SCHEDULER_H_ */
@@ -0,0 +1,273 @@
+/*******************************************************************************
+ *
+ *      memory_accounting
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef MEMORY_ACCOUNTING_H_
+#define MEMORY_ACCOUNTING_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <atomic>
+
+// heap accounting by subsystem
+// code tags its allocations by opening a MemoryScope; the tag is a thread_local, so tagging costs two stores whether or not
+// accounting is compiled in. the counting itself lives in src/memory_accounting.cpp, which replaces the global operator new and
+// delete; link it into a program to turn accounting on (MemoryAccounting::enabled() tells whether it is)
+//
+// per generation the accounting tracks allocations, bytes and the peak; with a budget set, every generation after the warmup
+// that allocates more than the budget is counted as a violation, so tools can fail a run whose steady state allocates
+struct MemorySubsystem
+{
+	typedef unsigned int _Storage;
+	const static _Storage other = 0;
+	const static _Storage genes = 1;
+	const static _Storage chromosomes = 2;
+	const static _Storage genomes = 3;
+	const static _Storage wave_descriptors = 4;
+	const static _Storage audio_buffers = 5;
+	const static _Storage NUM_SUBSYSTEMS = 6;
+
+	static const char * name( _Storage subsystem )
+	{
+		static const char * names[NUM_SUBSYSTEMS] = { "other", "genes", "chromosomes", "genomes", "wave_descriptors", "audio_buffers" };
+		return subsystem < NUM_SUBSYSTEMS ? names[subsystem] : "unknown";
+	}
+};
+
+class MemoryAccounting
+{
+public:
+	struct Counters
+	{
+		std::atomic<unsigned long long> allocations_;
+		std::atomic<unsigned long long> deallocations_;
+		std::atomic<long long> current_bytes_;
+		std::atomic<long long> peak_bytes_;
+
+		Counters() :
+			allocations_( 0 ), deallocations_( 0 ), current_bytes_( 0 ), peak_bytes_( 0 )
+		{
+			//
+		}
+	};
+
+	struct GenerationReport
+	{
+		unsigned long long generation_;
+		unsigned long long allocations_;
+		long long current_bytes_;
+		long long peak_bytes_;
+	};
+
+protected:
+	bool enabled_;
+	Counters subsystems_[MemorySubsystem::NUM_SUBSYSTEMS];
+	Counters total_;
+
+	// peak of the total since the current generation began
+	std::atomic<long long> generation_peak_bytes_;
+	unsigned long long generation_start_allocations_;
+	unsigned long long generation_;
+	GenerationReport last_generation_;
+
+	long long budget_allocations_;
+	unsigned long long warmup_generations_;
+	unsigned long long num_violations_;
+
+	MemoryAccounting() :
+		enabled_( false ), generation_peak_bytes_( 0 ), generation_start_allocations_( 0 ), generation_( 0 ), budget_allocations_( -1 ), warmup_generations_( 0 ), num_violations_( 0 )
+	{
+		last_generation_.generation_ = 0;
+		last_generation_.allocations_ = 0;
+		last_generation_.current_bytes_ = 0;
+		last_generation_.peak_bytes_ = 0;
+	}
+
+public:
+	static MemoryAccounting & instance()
+	{
+		static MemoryAccounting memory_accounting;
+		return memory_accounting;
+	}
+
+	static MemorySubsystem::_Storage & currentSubsystem()
+	{
+		static thread_local MemorySubsystem::_Storage subsystem = MemorySubsystem::other;
+		return subsystem;
+	}
+
+	// allocations made by the calling thread since it started; the difference across a block of code is what that code
+	// allocated, whatever the other threads were doing. stays 0 unless accounting is linked in
+	static unsigned long long & threadAllocations()
+	{
+		static thread_local unsigned long long allocations = 0;
+		return allocations;
+	}
+
+	bool enabled() const
+	{
+		return enabled_;
+	}
+
+	// called by the replacement operator new/delete
+	void setEnabled( bool enabled )
+	{
+		enabled_ = enabled;
+	}
+
+	void allocated( MemorySubsystem::_Storage subsystem, size_t size )
+	{
+		++threadAllocations();
+		add( subsystems_[subsystem], size );
+		const long long total = add( total_, size );
+		long long peak = generation_peak_bytes_.load( std::memory_order_relaxed );
+		while ( total > peak && !generation_peak_bytes_.compare_exchange_weak( peak, total, std::memory_order_relaxed ) )
+			;
+	}
+
+	void deallocated( MemorySubsystem::_Storage subsystem, size_t size )
+	{
+		remove( subsystems_[subsystem], size );
+		remove( total_, size );
+	}
+
+	const Counters & subsystem( MemorySubsystem::_Storage subsystem ) const
+	{
+		return subsystems_[subsystem];
+	}
+
+	const Counters & total() const
+	{
+		return total_;
+	}
+
+	// fail generations after the first warmup_generations that allocate more than max_allocations times; -1 turns the check off
+	void setBudget( long long max_allocations, unsigned long long warmup_generations = 1 )
+	{
+		budget_allocations_ = max_allocations;
+		warmup_generations_ = warmup_generations;
+	}
+
+	unsigned long long numViolations() const
+	{
+		return num_violations_;
+	}
+
+	void beginGeneration()
+	{
+		generation_start_allocations_ = total_.allocations_.load( std::memory_order_relaxed );
+		generation_peak_bytes_ = total_.current_bytes_.load( std::memory_order_relaxed );
+	}
+
+	// returns false if the generation broke the budget
+	bool endGeneration()
+	{
+		++generation_;
+		last_generation_.generation_ = generation_;
+		last_generation_.allocations_ = total_.allocations_.load( std::memory_order_relaxed ) - generation_start_allocations_;
+		last_generation_.current_bytes_ = total_.current_bytes_.load( std::memory_order_relaxed );
+		last_generation_.peak_bytes_ = generation_peak_bytes_.load( std::memory_order_relaxed );
+
+		if ( !enabled_ || budget_allocations_ < 0 || generation_ <= warmup_generations_ ) return true;
+		if ( last_generation_.allocations_ <= (unsigned long long) budget_allocations_ ) return true;
+		++num_violations_;
+		fprintf( stderr, "memory: generation %llu made %llu allocations, over the budget of %lld\n", generation_, last_generation_.allocations_, budget_allocations_ );
+		return false;
+	}
+
+	const GenerationReport & lastGeneration() const
+	{
+		return last_generation_;
+	}
+
+	void print( FILE * file ) const
+	{
+		if ( !enabled_ )
+		{
+			fprintf( file, "--memory accounting not linked in\n" );
+			return;
+		}
+		fprintf( file, "--memory (last generation %llu: %llu allocations, %.2f MB current, %.2f MB peak)\n", last_generation_.generation_, last_generation_.allocations_,
+				last_generation_.current_bytes_ / 1048576.0, last_generation_.peak_bytes_ / 1048576.0 );
+		fprintf( file, "%18s %14s %14s %12s %12s\n", "subsystem", "allocations", "frees", "current MB", "peak MB" );
+		for ( MemorySubsystem::_Storage i = 0; i < MemorySubsystem::NUM_SUBSYSTEMS; ++i )
+			printCounters( file, MemorySubsystem::name( i ), subsystems_[i] );
+		printCounters( file, "total", total_ );
+		if ( budget_allocations_ >= 0 ) fprintf( file, "budget: %lld allocations/generation after %llu warmup generations, %llu violations\n", budget_allocations_, warmup_generations_, num_violations_ );
+	}
+
+protected:
+	static long long add( Counters & counters, size_t size )
+	{
+		counters.allocations_.fetch_add( 1, std::memory_order_relaxed );
+		const long long current = counters.current_bytes_.fetch_add( size, std::memory_order_relaxed ) + size;
+		long long peak = counters.peak_bytes_.load( std::memory_order_relaxed );
+		while ( current > peak && !counters.peak_bytes_.compare_exchange_weak( peak, current, std::memory_order_relaxed ) )
+			;
+		return current;
+	}
+
+	static void remove( Counters & counters, size_t size )
+	{
+		counters.deallocations_.fetch_add( 1, std::memory_order_relaxed );
+		counters.current_bytes_.fetch_sub( size, std::memory_order_relaxed );
+	}
+
+	static void printCounters( FILE * file, const char * name, const Counters & counters )
+	{
+		fprintf( file, "%18s %14llu %14llu %12.2f %12.2f\n", name, counters.allocations_.load(), counters.deallocations_.load(), counters.current_bytes_.load() / 1048576.0,
+				counters.peak_bytes_.load() / 1048576.0 );
+	}
+};
+
+// tags every allocation made by this thread until the scope ends; scopes nest
+class MemoryScope
+{
+protected:
+	MemorySubsystem::_Storage previous_;
+
+public:
+	MemoryScope( MemorySubsystem::_Storage subsystem ) :
+		previous_( MemoryAccounting::currentSubsystem() )
+	{
+		MemoryAccounting::currentSubsystem() = subsystem;
+	}
+
+	~MemoryScope()
+	{
+		MemoryAccounting::currentSubsystem() = previous_;
+	}
+};
+
+#endif /* MEMORY_ACCOUNTING_H_ */
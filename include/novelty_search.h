@@ -0,0 +1,255 @@
+/*******************************************************************************
+ *
+ *      novelty_search
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef NOVELTY_SEARCH_H_
+#define NOVELTY_SEARCH_H_
+
+#include <vector>
+#include <algorithm>
+#include "genetic_process.h"
+#include "worker_pool.h"
+#include "vp_tree.h"
+
+// novelty search: rewards individuals for behaving differently from what the run has produced before instead of (or as well
+// as) for their fitness, so the population can't collapse onto a single way of scoring well
+//
+// an individual's novelty is its mean distance to the k nearest behaviours among the archive and the rest of the current
+// population (behaviours come from _Genome::behaviour(), see AudioGenome). the most novel individuals of every generation
+// join the archive, which keeps the newest max_archive_size_ behaviours. the archive is indexed by a vantage-point tree;
+// behaviours added since the tree was built are searched by brute force until there are enough of them to make a rebuild
+// worth it, so queries stay logarithmic in the archive size and each behaviour is only indexed O(1) times on average
+//
+// add it to a GeneticProcess with addEvaluationListener(); it replaces every fitness with
+//   fitness_weight_ * fitness + novelty_weight_ * novelty
+template<class _GeneticProcessType>
+class NoveltySearch: public _GeneticProcessType::EvaluationListener
+{
+public:
+	typedef _GeneticProcessType _GeneticProcess;
+	typedef typename _GeneticProcess::_Genome _Genome;
+	typedef typename _GeneticProcess::_GenomePtr _GenomePtr;
+	typedef typename _GeneticProcess::_FitnessType _FitnessType;
+	typedef typename _GeneticProcess::_PopulationVector _PopulationVector;
+	typedef VpTree::_Neighbour _Neighbour;
+
+	const static unsigned int DIMENSION = _Genome::BEHAVIOUR_SIZE;
+
+	struct Descriptor
+	{
+		// neighbours novelty is measured against
+		unsigned int k_;
+		// behaviours kept in the archive; the oldest are replaced once it is full
+		unsigned int max_archive_size_;
+		// most novel individuals of each generation added to the archive
+		unsigned int additions_per_generation_;
+		double fitness_weight_;
+		double novelty_weight_;
+		// threads used to describe and score the population
+		unsigned int num_threads_;
+
+		Descriptor( unsigned int k = 15, unsigned int max_archive_size = 100000, unsigned int additions_per_generation = 4, double fitness_weight = 0, double novelty_weight = 1,
+				unsigned int num_threads = 1 ) :
+			k_( k ), max_archive_size_( max_archive_size ), additions_per_generation_( additions_per_generation ), fitness_weight_( fitness_weight ), novelty_weight_( novelty_weight ),
+					num_threads_( num_threads )
+		{
+			//
+		}
+	};
+
+	// the archive is only rebuilt once this many behaviours (or an eighth of the tree, if more) are waiting to be indexed
+	const static unsigned int MIN_REBUILD_SIZE = 256;
+	// individuals per task when spreading the population over threads
+	const static unsigned int CHUNK_SIZE = 64;
+
+protected:
+	Descriptor descriptor_;
+	WorkerPool worker_pool_;
+
+	// the archive: a ring of behaviours, the oldest replaced first
+	std::vector<float> archive_;
+	unsigned int archive_size_;
+	unsigned int next_archive_slot_;
+	VpTree archive_tree_;
+	// slots written since archive_tree_ was built
+	std::vector<unsigned int> pending_;
+
+	// the current population's behaviours and novelty
+	std::vector<float> behaviours_;
+	VpTree population_tree_;
+	std::vector<double> novelty_;
+	double mean_novelty_;
+
+public:
+	NoveltySearch( Descriptor descriptor = Descriptor() ) :
+		descriptor_( descriptor ), worker_pool_( descriptor.num_threads_ > 1 ? descriptor.num_threads_ - 1 : 0 ), archive_size_( 0 ), next_archive_slot_( 0 ),
+				archive_tree_( DIMENSION ), population_tree_( DIMENSION ), mean_novelty_( 0 )
+	{
+		//
+	}
+
+	virtual ~NoveltySearch()
+	{
+		//
+	}
+
+	unsigned int archiveSize() const
+	{
+		return archive_size_;
+	}
+
+	// mean novelty of the last population scored
+	double meanNovelty() const
+	{
+		return mean_novelty_;
+	}
+
+	// novelty of each individual of the last population scored, in population order
+	const std::vector<double> & novelty() const
+	{
+		return novelty_;
+	}
+
+	bool adjustFitness( _GeneticProcess & process )
+	{
+		ScopedTrace trace( "novelty", "ga" );
+		const _PopulationVector & population = process.population();
+		const unsigned int num_individuals = population.size();
+		const unsigned int num_chunks = ( num_individuals + CHUNK_SIZE - 1 ) / CHUNK_SIZE;
+
+		behaviours_.resize( (size_t) num_individuals * DIMENSION );
+		worker_pool_.run( num_chunks, [this, &population, num_individuals]( unsigned int chunk, unsigned int )
+		{
+			const unsigned int end = std::min( ( chunk + 1 ) * CHUNK_SIZE, num_individuals );
+			for ( unsigned int i = chunk * CHUNK_SIZE; i < end; ++i )
+			{
+				population[i]->behaviour( &behaviours_[(size_t) i * DIMENSION] );
+			}
+		} );
+		population_tree_.build( &behaviours_[0], num_individuals );
+
+		novelty_.resize( num_individuals );
+		worker_pool_.run( num_chunks, [this, &population, num_individuals]( unsigned int chunk, unsigned int )
+		{
+			std::vector<_Neighbour> neighbours;
+			const unsigned int end = std::min( ( chunk + 1 ) * CHUNK_SIZE, num_individuals );
+			for ( unsigned int i = chunk * CHUNK_SIZE; i < end; ++i )
+			{
+				novelty_[i] = score( &behaviours_[(size_t) i * DIMENSION], i, neighbours );
+				population[i]->setFitness( descriptor_.fitness_weight_ * population[i]->fitness() + descriptor_.novelty_weight_ * novelty_[i] );
+			}
+		} );
+
+		mean_novelty_ = 0;
+		for ( unsigned int i = 0; i < num_individuals; ++i )
+		{
+			mean_novelty_ += novelty_[i];
+		}
+		mean_novelty_ = num_individuals > 0 ? mean_novelty_ / num_individuals : 0;
+
+		archiveMostNovel( num_individuals );
+		return true;
+	}
+
+protected:
+	// mean distance to the k nearest behaviours in the archive and the population, not counting the individual itself
+	double score( const float * behaviour, unsigned int individual, std::vector<_Neighbour> & neighbours ) const
+	{
+		neighbours.clear();
+		const unsigned int k = descriptor_.k_;
+
+		// one extra from the population, in case it's the individual itself
+		population_tree_.search( behaviour, k + 1, neighbours );
+		std::vector<_Neighbour>::iterator self = neighbours.end();
+		for ( std::vector<_Neighbour>::iterator it = neighbours.begin(); it != neighbours.end(); ++it )
+		{
+			if ( it->second == individual ) self = it;
+		}
+		if ( self != neighbours.end() ) neighbours.erase( self );
+		else if ( neighbours.size() > k ) neighbours.erase( std::max_element( neighbours.begin(), neighbours.end() ) );
+		std::make_heap( neighbours.begin(), neighbours.end() );
+
+		// the ids of archive neighbours don't matter from here on
+		archive_tree_.search( behaviour, k, neighbours );
+		for ( std::vector<unsigned int>::const_iterator it = pending_.begin(); it != pending_.end(); ++it )
+		{
+			VpTree::offer( neighbours, k, VpTree::squaredDistance( behaviour, &archive_[(size_t) *it * DIMENSION], DIMENSION ), *it );
+		}
+
+		if ( neighbours.empty() ) return 0;
+		double total_distance = 0;
+		for ( std::vector<_Neighbour>::const_iterator it = neighbours.begin(); it != neighbours.end(); ++it )
+		{
+			total_distance += sqrt( it->first );
+		}
+		return total_distance / neighbours.size();
+	}
+
+	// add the generation's most novel behaviours to the archive (ties go to the earlier individual)
+	void archiveMostNovel( unsigned int num_individuals )
+	{
+		if ( descriptor_.max_archive_size_ == 0 ) return;
+		if ( archive_.empty() ) archive_.resize( (size_t) descriptor_.max_archive_size_ * DIMENSION );
+
+		std::vector<unsigned int> order( num_individuals );
+		for ( unsigned int i = 0; i < num_individuals; ++i )
+		{
+			order[i] = i;
+		}
+		const unsigned int num_additions = std::min( descriptor_.additions_per_generation_, num_individuals );
+		std::partial_sort( order.begin(), order.begin() + num_additions, order.end(), [this]( unsigned int a, unsigned int b )
+		{
+			return novelty_[a] > novelty_[b] || ( novelty_[a] == novelty_[b] && a < b );
+		} );
+
+		for ( unsigned int i = 0; i < num_additions; ++i )
+		{
+			const unsigned int slot = next_archive_slot_;
+			std::copy( &behaviours_[(size_t) order[i] * DIMENSION], &behaviours_[(size_t) order[i] * DIMENSION] + DIMENSION, &archive_[(size_t) slot * DIMENSION] );
+			next_archive_slot_ = ( next_archive_slot_ + 1 ) % descriptor_.max_archive_size_;
+			if ( archive_size_ < descriptor_.max_archive_size_ ) ++archive_size_;
+			pending_.push_back( slot );
+		}
+
+		// the tree keeps copies of the behaviours, so a replaced slot is only forgotten by the next rebuild
+		if ( pending_.size() >= std::max<size_t>( MIN_REBUILD_SIZE, archive_tree_.size() / 8 ) )
+		{
+			ScopedTrace trace( "novelty archive rebuild", "ga", "behaviours", archive_size_ );
+			archive_tree_.build( &archive_[0], archive_size_ );
+			pending_.clear();
+		}
+	}
+};
+
+#endif /* NOVELTY_SEARCH_H_ */
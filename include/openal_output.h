@@ -0,0 +1,146 @@
+/*******************************************************************************
+ *
+ *      openal_output
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef OPENAL_OUTPUT_H_
+#define OPENAL_OUTPUT_H_
+
+#include <AL/alut.h>
+#include "alut_util.h"
+#include "audio_output.h"
+
+// plays audio through a single OpenAL source with a queue of buffers
+class OpenALAudioOutput : public AudioOutput
+{
+protected:
+	ALuint sound_source_;
+	bool initialized_;
+
+public:
+	OpenALAudioOutput() :
+		sound_source_( 0 ), initialized_( false )
+	{
+		//
+	}
+
+	~OpenALAudioOutput()
+	{
+		close();
+	}
+
+	bool open( const AudioFormat & format )
+	{
+		if ( format.num_channels_ < 1 || format.num_channels_ > 2 ) return false;
+		if ( !alutInit( NULL, NULL ) )
+		{
+			fprintf( stderr, "ALUT error: %s\n", alutGetErrorString( alutGetError() ) );
+			return false;
+		}
+		initialized_ = true;
+		alGenSources( 1, &sound_source_ );
+		return AudioOutput::open( format );
+	}
+
+	void close()
+	{
+		if ( !initialized_ ) return;
+
+		// stop playback and release whatever is still queued
+		update();
+		ALint num_buffers_queued;
+		alGetSourcei( sound_source_, AL_BUFFERS_QUEUED, &num_buffers_queued );
+		alSourceStop( sound_source_ );
+		if ( num_buffers_queued > 0 )
+		{
+			ALuint buffer[num_buffers_queued];
+			alSourceUnqueueBuffers( sound_source_, num_buffers_queued, &buffer[0] );
+			alDeleteBuffers( num_buffers_queued, &buffer[0] );
+		}
+		alDeleteSources( 1, &sound_source_ );
+
+		if ( !alutExit() ) fprintf( stderr, "ALUT error: %s\n", alutGetErrorString( alutGetError() ) );
+		initialized_ = false;
+	}
+
+	bool queueBuffer( const _SampleType * samples, unsigned int num_frames )
+	{
+		ALuint buffer;
+		alGenBuffers( 1, &buffer );
+		alBufferData( buffer, format_.num_channels_ == 2 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16, samples, num_frames * format_.num_channels_ * sizeof( _SampleType ), format_.sample_rate_ );
+		alutCheckAndQueueBuffer( sound_source_, buffer );
+
+		// the source stops by itself if its queue ever runs dry; restart it once there's audio again
+		ALint source_state;
+		alGetSourcei( sound_source_, AL_SOURCE_STATE, &source_state );
+		if ( source_state != AL_PLAYING )
+		{
+			if ( num_buffers_queued_ > 0 ) ++num_underruns_;
+			alSourcePlay( sound_source_ );
+		}
+
+		return AudioOutput::queueBuffer( samples, num_frames );
+	}
+
+	unsigned int update()
+	{
+		ALint num_buffers_processed;
+		alGetSourcei( sound_source_, AL_BUFFERS_PROCESSED, &num_buffers_processed );
+		if ( num_buffers_processed <= 0 ) return 0;
+
+		// unload the front buffers and delete them since we can't reuse them nicely
+		ALuint buffer[num_buffers_processed];
+		alSourceUnqueueBuffers( sound_source_, num_buffers_processed, &buffer[0] );
+		alDeleteBuffers( num_buffers_processed, &buffer[0] );
+		return num_buffers_processed;
+	}
+
+	unsigned int numQueuedBuffers() const
+	{
+		ALint num_buffers_queued;
+		alGetSourcei( sound_source_, AL_BUFFERS_QUEUED, &num_buffers_queued );
+		return num_buffers_queued;
+	}
+
+	bool isRealTime() const
+	{
+		return true;
+	}
+
+	std::string name() const
+	{
+		return "openal";
+	}
+};
+
+#endif /* OPENAL_OUTPUT_H_ */
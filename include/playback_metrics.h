@@ -0,0 +1,295 @@
+/*******************************************************************************
+ *
+ *      playback_metrics
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef PLAYBACK_METRICS_H_
+#define PLAYBACK_METRICS_H_
+
+#include <stdio.h>
+#include <time.h>
+#include <deque>
+#include <vector>
+#include <string>
+
+namespace PlaybackMetricsUtil
+{
+	// monotonic time in milliseconds
+	static double now()
+	{
+		struct timespec ts;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+	}
+}
+
+// fixed log2-spaced buckets: bucket 0 holds values below 1, bucket i holds [2^(i-1), 2^i)
+class Histogram
+{
+public:
+	const static unsigned int NUM_BUCKETS = 32;
+
+protected:
+	unsigned long counts_[NUM_BUCKETS];
+	unsigned long count_;
+	double sum_;
+	double min_;
+	double max_;
+
+public:
+	Histogram()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		for ( unsigned int i = 0; i < NUM_BUCKETS; ++i )
+			counts_[i] = 0;
+		count_ = 0;
+		sum_ = 0;
+		min_ = 0;
+		max_ = 0;
+	}
+
+	static unsigned int getBucket( double value )
+	{
+		unsigned int bucket = 0;
+		for ( double bound = 1; value >= bound && bucket < NUM_BUCKETS - 1; bound *= 2 )
+			++bucket;
+		return bucket;
+	}
+
+	// upper bound of the given bucket
+	static double getBucketBound( unsigned int bucket )
+	{
+		return bucket == 0 ? 1 : (double) ( 1ul << bucket );
+	}
+
+	void add( double value )
+	{
+		if ( count_ == 0 || value < min_ ) min_ = value;
+		if ( count_ == 0 || value > max_ ) max_ = value;
+		++counts_[getBucket( value )];
+		++count_;
+		sum_ += value;
+	}
+
+	unsigned long count() const
+	{
+		return count_;
+	}
+
+	double mean() const
+	{
+		return count_ > 0 ? sum_ / count_ : 0;
+	}
+
+	double min() const
+	{
+		return min_;
+	}
+
+	double max() const
+	{
+		return max_;
+	}
+
+	unsigned long bucketCount( unsigned int bucket ) const
+	{
+		return counts_[bucket];
+	}
+
+	// approximate quantile: the upper bound of the bucket the q-th value falls into
+	double quantile( double q ) const
+	{
+		if ( count_ == 0 ) return 0;
+		const double target = q * count_;
+		unsigned long cumulative = 0;
+		for ( unsigned int i = 0; i < NUM_BUCKETS; ++i )
+		{
+			cumulative += counts_[i];
+			if ( cumulative >= target ) return getBucketBound( i ) < max_ ? getBucketBound( i ) : max_;
+		}
+		return max_;
+	}
+
+	void print( FILE * file, const std::string & name, const std::string & unit ) const
+	{
+		fprintf( file, "%s: n=%lu mean=%.2f%s min=%.2f%s p50<=%.0f%s p99<=%.0f%s max=%.2f%s\n", name.c_str(), count_, mean(), unit.c_str(), min_, unit.c_str(), quantile( 0.5 ), unit.c_str(),
+				quantile( 0.99 ), unit.c_str(), max_, unit.c_str() );
+		for ( unsigned int i = 0; i < NUM_BUCKETS; ++i )
+		{
+			if ( counts_[i] == 0 ) continue;
+			fprintf( file, "  < %8.0f%s: %lu\n", getBucketBound( i ), unit.c_str(), counts_[i] );
+		}
+	}
+};
+
+// follows every generation from the end of its evaluation until its first sample is played, and keeps an eye on the output queue
+// the first sample of a generation is played once every buffer queued before it has finished playing
+class PlaybackMetrics
+{
+protected:
+	struct GenerationTimes
+	{
+		unsigned int generation_;
+		double evaluated_;
+		double rendered_;
+		double enqueued_;
+		// number of buffers queued before this generation's first buffer
+		unsigned long first_buffer_;
+		bool has_rendered_;
+		bool has_enqueued_;
+
+		GenerationTimes( unsigned int generation, double evaluated ) :
+			generation_( generation ), evaluated_( evaluated ), rendered_( 0 ), enqueued_( 0 ), first_buffer_( 0 ), has_rendered_( false ), has_enqueued_( false )
+		{
+			//
+		}
+	};
+
+	std::deque<GenerationTimes> in_flight_;
+	unsigned long num_buffers_played_;
+	unsigned long num_underruns_;
+	unsigned long num_queue_samples_;
+	bool was_empty_;
+
+public:
+	// stage latencies, in milliseconds
+	Histogram evaluate_to_render_;
+	Histogram render_to_enqueue_;
+	Histogram enqueue_to_play_;
+	Histogram evaluate_to_play_;
+	// output queue depth in milliseconds of audio, sampled every time sampleQueue() is called
+	Histogram queue_depth_;
+
+	PlaybackMetrics() :
+		num_buffers_played_( 0 ), num_underruns_( 0 ), num_queue_samples_( 0 ), was_empty_( false )
+	{
+		//
+	}
+
+	// the genetic process finished (evaluating) a generation
+	void generationEvaluated( unsigned int generation )
+	{
+		in_flight_.push_back( GenerationTimes( generation, PlaybackMetricsUtil::now() ) );
+	}
+
+	// the first buffer of the generation has been rendered
+	void generationRendered( unsigned int generation )
+	{
+		GenerationTimes * times = find( generation );
+		if ( !times || times->has_rendered_ ) return;
+		times->rendered_ = PlaybackMetricsUtil::now();
+		times->has_rendered_ = true;
+		evaluate_to_render_.add( times->rendered_ - times->evaluated_ );
+	}
+
+	// the first buffer of the generation has been queued; num_buffers_before is the total number of buffers queued before it
+	void generationEnqueued( unsigned int generation, unsigned long num_buffers_before )
+	{
+		GenerationTimes * times = find( generation );
+		if ( !times || times->has_enqueued_ ) return;
+		times->enqueued_ = PlaybackMetricsUtil::now();
+		times->first_buffer_ = num_buffers_before;
+		times->has_enqueued_ = true;
+		if ( times->has_rendered_ ) render_to_enqueue_.add( times->enqueued_ - times->rendered_ );
+		update();
+	}
+
+	// the output reported num_buffers more buffers as finished
+	void buffersPlayed( unsigned int num_buffers )
+	{
+		num_buffers_played_ += num_buffers;
+		update();
+	}
+
+	// record the current queue depth; a queue that runs dry while it's being watched counts as an underrun
+	void sampleQueue( float queued_ms, bool expecting_audio = true )
+	{
+		++num_queue_samples_;
+		queue_depth_.add( queued_ms );
+		const bool is_empty = queued_ms <= 0;
+		if ( is_empty && !was_empty_ && expecting_audio && num_buffers_played_ > 0 ) ++num_underruns_;
+		was_empty_ = is_empty;
+	}
+
+	// underruns detected by the output itself (e.g. an OpenAL source that stopped). numUnderruns() reports the larger of this
+	// and the count from sampleQueue(): the output sees every dropout while sampling only sees the ones that last until the next
+	// poll, but outputs that can't detect dropouts (e.g. the null output) report 0
+	void outputUnderruns( unsigned long num_underruns )
+	{
+		if ( num_underruns > num_underruns_ ) num_underruns_ = num_underruns;
+	}
+
+	unsigned long numUnderruns() const
+	{
+		return num_underruns_;
+	}
+
+	void print( FILE * file ) const
+	{
+		fprintf( file, "--playback metrics (%lu buffers played, %lu underruns, %lu queue samples)\n", num_buffers_played_, num_underruns_, num_queue_samples_ );
+		evaluate_to_render_.print( file, "evaluate->render", "ms" );
+		render_to_enqueue_.print( file, "render->enqueue", "ms" );
+		enqueue_to_play_.print( file, "enqueue->first sample played", "ms" );
+		evaluate_to_play_.print( file, "evaluate->first sample played", "ms" );
+		queue_depth_.print( file, "queue depth", "ms" );
+	}
+
+protected:
+	GenerationTimes * find( unsigned int generation )
+	{
+		for ( typename std::deque<GenerationTimes>::iterator it = in_flight_.begin(); it != in_flight_.end(); ++it )
+		{
+			if ( it->generation_ == generation ) return &*it;
+		}
+		return NULL;
+	}
+
+	// retire every queued generation whose first buffer has started playing
+	void update()
+	{
+		const double now = PlaybackMetricsUtil::now();
+		while ( !in_flight_.empty() && in_flight_.front().has_enqueued_ && in_flight_.front().first_buffer_ <= num_buffers_played_ )
+		{
+			const GenerationTimes & times = in_flight_.front();
+			enqueue_to_play_.add( now - times.enqueued_ );
+			evaluate_to_play_.add( now - times.evaluated_ );
+			in_flight_.pop_front();
+		}
+	}
+};
+
+#endif /* PLAYBACK_METRICS_H_ */
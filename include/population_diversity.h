@@ -0,0 +1,513 @@
+/*******************************************************************************
+ *
+ *      population_diversity
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef POPULATION_DIVERSITY_H_
+#define POPULATION_DIVERSITY_H_
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+#include "genetic_process.h"
+#include "worker_pool.h"
+
+// how diverse the population is, measured after every evaluation: how many genomes are unique, how many genes individuals
+// differ in (from each other and from the fittest), and how spread out the genes at each position are
+//
+// the genes are collected as each individual is evaluated, while they are still in cache (walking every gene of a large
+// population again afterwards costs as much as a cheap evaluation), and packed position by position into 16-bit gene codes,
+// numbered per position in order of appearance. everything is computed from those: the entropy and the mean pairwise
+// distance follow from how often each code occurs at each position (two random individuals differ at a position unless
+// they drew the same code), which is exact and linear in the population size where comparing pairs, even a sample of them,
+// is not. distances to the fittest individual compare the codes of four individuals at a time in 64-bit words. a position
+// with more than 65535 distinct genes (only possible in a bigger population) lumps the rest into one code as far as
+// distances and uniqueness are concerned
+//
+// add it to a GeneticProcess with addEvaluationListener(), or measure() a population directly
+template<class _GeneticProcessType>
+class PopulationDiversity: public _GeneticProcessType::EvaluationListener
+{
+public:
+	typedef _GeneticProcessType _GeneticProcess;
+	typedef typename _GeneticProcess::_Genome _Genome;
+	typedef typename _GeneticProcess::_GenomePtr _GenomePtr;
+	typedef typename _GeneticProcess::_DataType _DataType;
+	typedef typename _GeneticProcess::_FitnessType _FitnessType;
+	typedef typename _GeneticProcess::_PopulationVector _PopulationVector;
+	typedef typename _GeneticProcess::_ChromosomeIterator _ChromosomeIterator;
+	typedef typename _GeneticProcess::_GeneIterator _GeneIterator;
+	typedef unsigned short _Code;
+
+	struct Descriptor
+	{
+		// threads used to pack and measure the population
+		unsigned int num_threads_;
+
+		Descriptor( unsigned int num_threads = 1 ) :
+			num_threads_( num_threads )
+		{
+			//
+		}
+	};
+
+	struct Statistics
+	{
+		// distinct genomes; identical copies count once
+		unsigned int unique_genomes_;
+		// genes two different individuals differ in, averaged over every pair
+		double mean_distance_;
+		// genes individuals differ from the fittest one in
+		double mean_distance_to_best_;
+		// shannon entropy of the genes at a position, in bits, averaged over the positions
+		double mean_entropy_;
+		// distinct genes at a position, averaged over the positions
+		double mean_alleles_;
+
+		Statistics() :
+			unique_genomes_( 0 ), mean_distance_( 0 ), mean_distance_to_best_( 0 ), mean_entropy_( 0 ), mean_alleles_( 0 )
+		{
+			//
+		}
+	};
+
+	// individuals per task when spreading the work over threads (a multiple of CODES_PER_WORD)
+	const static unsigned int CHUNK_SIZE = 64;
+	// positions encoded together: one cache line of a genome's genes
+	const static unsigned int POSITION_BLOCK_SIZE = 8;
+	const static unsigned int CODES_PER_WORD = sizeof( unsigned long long ) / sizeof( _Code );
+	const static _Code MAX_CODE = 0xffff;
+
+protected:
+	// an open-addressing table from gene to code and count for one position; it starts small, since most positions only
+	// hold a few distinct genes, and doubles when half full
+	struct CodeTable
+	{
+		std::vector<unsigned long long> keys_;
+		std::vector<unsigned int> counts_;
+		std::vector<_Code> codes_;
+		unsigned int num_codes_;
+	};
+
+	// the individuals a worker saw evaluated: their genes (one genome after the other) and fitness
+	struct alignas( 64 ) WorkerGenes
+	{
+		std::vector<unsigned long long> keys_;
+		std::vector<_FitnessType> fitness_;
+	};
+
+	Descriptor descriptor_;
+	WorkerPool worker_pool_;
+	Statistics statistics_;
+	std::vector<WorkerGenes> workers_;
+
+	unsigned int genome_length_;
+	unsigned int num_individuals_;
+	// each individual's genes (as keys, see geneKey()) and fitness, wherever they were collected
+	std::vector<const unsigned long long *> rows_;
+	std::vector<_FitnessType> fitness_;
+	// individuals per position in codes_: their number, padded to a whole number of words
+	unsigned int stride_;
+	// the codes, position after position
+	std::vector<_Code> codes_;
+	// per worker, a table for each position of a block
+	std::vector<std::vector<CodeTable> > tables_;
+
+	// per position
+	std::vector<double> entropy_;
+	std::vector<double> same_gene_probability_;
+	std::vector<unsigned int> alleles_;
+	// per individual
+	std::vector<unsigned int> distance_to_best_;
+	std::vector<std::pair<unsigned long long, unsigned int> > hashes_;
+
+public:
+	PopulationDiversity( Descriptor descriptor = Descriptor() ) :
+		descriptor_( descriptor ), worker_pool_( descriptor.num_threads_ > 1 ? descriptor.num_threads_ - 1 : 0 ), genome_length_( 0 ), num_individuals_( 0 ), stride_( 0 )
+	{
+		//
+	}
+
+	virtual ~PopulationDiversity()
+	{
+		//
+	}
+
+	// of the last population measured
+	const Statistics & statistics() const
+	{
+		return statistics_;
+	}
+
+	void beginEvaluation( unsigned int num_workers )
+	{
+		if ( workers_.size() < num_workers ) workers_.resize( num_workers );
+		for ( size_t i = 0; i < workers_.size(); ++i )
+		{
+			workers_[i].keys_.clear();
+			workers_[i].fitness_.clear();
+		}
+	}
+
+	void individualEvaluated( unsigned int worker, _GenomePtr genome, const _FitnessType & fitness )
+	{
+		WorkerGenes & genes = workers_[worker];
+		genes.fitness_.push_back( fitness );
+		for ( _ChromosomeIterator chromosome_it = genome->begin(); chromosome_it != genome->end(); ++chromosome_it )
+		{
+			for ( _GeneIterator gene_it = ( *chromosome_it )->begin(); gene_it != ( *chromosome_it )->end(); ++gene_it )
+			{
+				genes.keys_.push_back( geneKey( ( *gene_it )->data_ ) );
+			}
+		}
+	}
+
+	// the fittest individual is the fittest as evaluated, before any listener reshaped the fitness
+	void endEvaluation( _GeneticProcess & process )
+	{
+		ScopedTrace trace( "diversity", "ga" );
+		setGenomeLength( process );
+		rows_.clear();
+		fitness_.clear();
+		for ( size_t worker = 0; worker < workers_.size(); ++worker )
+		{
+			const WorkerGenes & genes = workers_[worker];
+			for ( size_t row = 0; row < genes.fitness_.size(); ++row )
+			{
+				rows_.push_back( &genes.keys_[row * genome_length_] );
+				fitness_.push_back( genes.fitness_[row] );
+			}
+		}
+		analyse();
+		__DEBUG__NORMAL__ logPrintf( "--population diversity:\nunique: %u\ndistance: %f\nto best: %f\nentropy: %f\nalleles: %f\n\n", statistics_.unique_genomes_, statistics_.mean_distance_,
+				statistics_.mean_distance_to_best_, statistics_.mean_entropy_, statistics_.mean_alleles_ );
+	}
+
+	// measure a population without having watched it being evaluated
+	void measure( const _GeneticProcess & process )
+	{
+		ScopedTrace trace( "diversity", "ga" );
+		setGenomeLength( process );
+		const _PopulationVector & population = process.population();
+		const unsigned int num_individuals = population.size();
+
+		if ( workers_.empty() ) workers_.resize( 1 );
+		std::vector<unsigned long long> & keys = workers_[0].keys_;
+		keys.resize( (size_t) num_individuals * genome_length_ );
+		rows_.resize( num_individuals );
+		fitness_.resize( num_individuals );
+		const unsigned int num_chunks = ( num_individuals + CHUNK_SIZE - 1 ) / CHUNK_SIZE;
+		worker_pool_.run( num_chunks, [this, &population, &keys, num_individuals]( unsigned int chunk, unsigned int )
+		{
+			const unsigned int end = std::min( ( chunk + 1 ) * CHUNK_SIZE, num_individuals );
+			for ( unsigned int i = chunk * CHUNK_SIZE; i < end; ++i )
+			{
+				unsigned long long * key = &keys[(size_t) i * genome_length_];
+				rows_[i] = key;
+				fitness_[i] = population[i]->fitness();
+				for ( _ChromosomeIterator chromosome_it = population[i]->begin(); chromosome_it != population[i]->end(); ++chromosome_it )
+				{
+					for ( _GeneIterator gene_it = ( *chromosome_it )->begin(); gene_it != ( *chromosome_it )->end(); ++gene_it, ++key )
+					{
+						*key = geneKey( ( *gene_it )->data_ );
+					}
+				}
+			}
+		} );
+		analyse();
+	}
+
+protected:
+	void setGenomeLength( const _GeneticProcess & process )
+	{
+		const typename _Genome::Descriptor & genome_descriptor = process.descriptor().genome_descriptor_;
+		genome_length_ = genome_descriptor.size_ * genome_descriptor.chromosome_descriptor_.size_;
+	}
+
+	void analyse()
+	{
+		num_individuals_ = rows_.size();
+		statistics_ = Statistics();
+		if ( num_individuals_ == 0 || genome_length_ == 0 ) return;
+
+		stride_ = ( num_individuals_ + CODES_PER_WORD - 1 ) / CODES_PER_WORD * CODES_PER_WORD;
+		codes_.resize( (size_t) genome_length_ * stride_ );
+		entropy_.resize( genome_length_ );
+		same_gene_probability_.resize( genome_length_ );
+		alleles_.resize( genome_length_ );
+		distance_to_best_.assign( stride_, 0 );
+		hashes_.resize( num_individuals_ );
+		tables_.resize( worker_pool_.numWorkers() );
+
+		const unsigned int num_blocks = ( genome_length_ + POSITION_BLOCK_SIZE - 1 ) / POSITION_BLOCK_SIZE;
+		worker_pool_.run( num_blocks, [this]( unsigned int block, unsigned int worker )
+		{
+			encodeBlock( block * POSITION_BLOCK_SIZE, std::min( ( block + 1 ) * POSITION_BLOCK_SIZE, genome_length_ ), tables_[worker] );
+		} );
+
+		const unsigned int num_chunks = ( stride_ + CHUNK_SIZE - 1 ) / CHUNK_SIZE;
+		worker_pool_.run( num_chunks, [this]( unsigned int chunk, unsigned int )
+		{
+			hashGenomes( chunk * CHUNK_SIZE, std::min( ( chunk + 1 ) * CHUNK_SIZE, num_individuals_ ) );
+		} );
+
+		// the fittest individual; identical fitness is decided by the genes, so the choice doesn't depend on which thread
+		// evaluated what
+		unsigned int best = 0;
+		for ( unsigned int i = 1; i < num_individuals_; ++i )
+		{
+			if ( fitness_[i] > fitness_[best] || ( fitness_[i] == fitness_[best] && hashes_[i].first < hashes_[best].first ) ) best = i;
+		}
+
+		worker_pool_.run( num_chunks, [this, best]( unsigned int chunk, unsigned int )
+		{
+			compareWithBest( chunk * CHUNK_SIZE, std::min( ( chunk + 1 ) * CHUNK_SIZE, stride_ ), best );
+		} );
+
+		double total_distance_to_best = 0;
+		for ( unsigned int i = 0; i < num_individuals_; ++i )
+		{
+			total_distance_to_best += distance_to_best_[i];
+		}
+		statistics_.mean_distance_to_best_ = total_distance_to_best / num_individuals_;
+
+		double total_entropy = 0, total_distance = 0, total_alleles = 0;
+		for ( unsigned int position = 0; position < genome_length_; ++position )
+		{
+			total_entropy += entropy_[position];
+			total_distance += 1 - same_gene_probability_[position];
+			total_alleles += alleles_[position];
+		}
+		statistics_.mean_entropy_ = total_entropy / genome_length_;
+		statistics_.mean_distance_ = total_distance;
+		statistics_.mean_alleles_ = total_alleles / genome_length_;
+
+		statistics_.unique_genomes_ = countUnique();
+	}
+
+	// the gene itself if it fits in 64 bits, a hash of it otherwise
+	static unsigned long long geneKey( const _DataType & gene )
+	{
+		unsigned long long key = 0;
+		if ( sizeof( _DataType ) <= sizeof( key ) )
+		{
+			memcpy( &key, &gene, std::min( sizeof( _DataType ), sizeof( key ) ) );
+			return key;
+		}
+
+		key = 14695981039346656037ULL;
+		const unsigned char * bytes = (const unsigned char *) &gene;
+		for ( size_t i = 0; i < sizeof( _DataType ); ++i )
+		{
+			key = ( key ^ bytes[i] ) * 1099511628211ULL;
+		}
+		return key;
+	}
+
+	static size_t slot( unsigned long long key, size_t mask )
+	{
+		return ( ( key * 0x9E3779B97F4A7C15ull ) >> 32 ) & mask;
+	}
+
+	static void clear( CodeTable & table )
+	{
+		if ( table.keys_.empty() )
+		{
+			table.keys_.resize( 64 );
+			table.counts_.resize( 64 );
+			table.codes_.resize( 64 );
+		}
+		std::fill( table.counts_.begin(), table.counts_.end(), 0 );
+		table.num_codes_ = 0;
+	}
+
+	static _Code encode( CodeTable & table, unsigned long long key )
+	{
+		const size_t mask = table.keys_.size() - 1;
+		size_t current = slot( key, mask );
+		while ( table.counts_[current] > 0 && table.keys_[current] != key )
+			current = ( current + 1 ) & mask;
+
+		if ( table.counts_[current] == 0 )
+		{
+			table.keys_[current] = key;
+			table.codes_[current] = (_Code) std::min<unsigned int>( table.num_codes_++, MAX_CODE );
+		}
+		++table.counts_[current];
+		const _Code code = table.codes_[current];
+		if ( 2 * table.num_codes_ > table.keys_.size() ) grow( table );
+		return code;
+	}
+
+	static void grow( CodeTable & table )
+	{
+		CodeTable grown;
+		const size_t size = 2 * table.keys_.size(), mask = size - 1;
+		grown.keys_.resize( size );
+		grown.counts_.assign( size, 0 );
+		grown.codes_.resize( size );
+		grown.num_codes_ = table.num_codes_;
+		for ( size_t i = 0; i < table.keys_.size(); ++i )
+		{
+			if ( table.counts_[i] == 0 ) continue;
+			size_t current = slot( table.keys_[i], mask );
+			while ( grown.counts_[current] > 0 )
+				current = ( current + 1 ) & mask;
+			grown.keys_[current] = table.keys_[i];
+			grown.counts_[current] = table.counts_[i];
+			grown.codes_[current] = table.codes_[i];
+		}
+		std::swap( table, grown );
+	}
+
+	// the positions [begin, end) of every genome, read a cache line of genes at a time
+	void encodeBlock( unsigned int begin, unsigned int end, std::vector<CodeTable> & tables )
+	{
+		const unsigned int num_positions = end - begin;
+		tables.resize( POSITION_BLOCK_SIZE );
+		for ( unsigned int position = 0; position < num_positions; ++position )
+		{
+			clear( tables[position] );
+		}
+
+		for ( unsigned int i = 0; i < num_individuals_; ++i )
+		{
+			const unsigned long long * keys = rows_[i] + begin;
+			for ( unsigned int position = 0; position < num_positions; ++position )
+			{
+				codes_[(size_t) ( begin + position ) * stride_ + i] = encode( tables[position], keys[position] );
+			}
+		}
+
+		for ( unsigned int position = 0; position < num_positions; ++position )
+		{
+			_Code * codes = &codes_[(size_t) ( begin + position ) * stride_];
+			std::fill( codes + num_individuals_, codes + stride_, 0 );
+
+			// entropy and the chance that two different individuals have the same gene here, from the counts
+			const CodeTable & table = tables[position];
+			double entropy = 0, same_pairs = 0;
+			for ( size_t current = 0; current < table.counts_.size(); ++current )
+			{
+				if ( table.counts_[current] == 0 ) continue;
+				const double count = table.counts_[current];
+				entropy -= count / num_individuals_ * log2( count / num_individuals_ );
+				same_pairs += count * ( count - 1 );
+			}
+			entropy_[begin + position] = entropy;
+			same_gene_probability_[begin + position] = num_individuals_ > 1 ? same_pairs / ( (double) num_individuals_ * ( num_individuals_ - 1 ) ) : 1;
+			alleles_[begin + position] = table.num_codes_;
+		}
+	}
+
+	// genes differing from the fittest individual's, for the individuals [begin, end) (whole words): four individuals'
+	// codes per 64-bit word are compared with the best one's code in every lane. the top bit of a lane of the xor plus
+	// 0x7fff is set if any of its bits is, and shifted down it counts the difference in that lane
+	void compareWithBest( unsigned int begin, unsigned int end, unsigned int best )
+	{
+		const unsigned long long low_bits = 0x7fff7fff7fff7fffull, lane_ones = 0x0001000100010001ull;
+		for ( unsigned int i = begin; i < end; i += CODES_PER_WORD )
+		{
+			unsigned long long counts = 0;
+			for ( unsigned int position = 0; position < genome_length_; ++position )
+			{
+				const _Code * codes = &codes_[(size_t) position * stride_];
+				unsigned long long word;
+				memcpy( &word, codes + i, sizeof( word ) );
+
+				const unsigned long long difference = word ^ ( codes[best] * lane_ones );
+				counts += ( ( ( ( difference & low_bits ) + low_bits ) | difference ) & ~low_bits ) >> 15;
+
+				// a lane counts up to 65535
+				if ( ( position & 0x7fff ) == 0x7fff || position + 1 == genome_length_ )
+				{
+					for ( unsigned int lane = 0; lane < CODES_PER_WORD; ++lane )
+					{
+						distance_to_best_[i + lane] += ( counts >> ( 16 * lane ) ) & 0xffff;
+					}
+					counts = 0;
+				}
+			}
+		}
+	}
+
+	void hashGenomes( unsigned int begin, unsigned int end )
+	{
+		for ( unsigned int i = begin; i < end; ++i )
+		{
+			hashes_[i] = std::make_pair( 14695981039346656037ULL, i );
+		}
+		for ( unsigned int position = 0; position < genome_length_; ++position )
+		{
+			const _Code * codes = &codes_[(size_t) position * stride_];
+			for ( unsigned int i = begin; i < end; ++i )
+			{
+				hashes_[i].first = ( hashes_[i].first ^ codes[i] ) * 1099511628211ULL;
+			}
+		}
+	}
+
+	bool sameGenome( unsigned int a, unsigned int b ) const
+	{
+		for ( unsigned int position = 0; position < genome_length_; ++position )
+		{
+			if ( codes_[(size_t) position * stride_ + a] != codes_[(size_t) position * stride_ + b] ) return false;
+		}
+		return true;
+	}
+
+	// genomes with the same hash are compared in full, so collisions can't merge different genomes
+	unsigned int countUnique()
+	{
+		std::sort( hashes_.begin(), hashes_.end() );
+		unsigned int result = 0;
+		for ( unsigned int begin = 0, end; begin < num_individuals_; begin = end )
+		{
+			for ( end = begin + 1; end < num_individuals_ && hashes_[end].first == hashes_[begin].first; ++end )
+				;
+			for ( unsigned int i = begin; i < end; ++i )
+			{
+				bool seen = false;
+				for ( unsigned int j = begin; j < i && !seen; ++j )
+				{
+					seen = sameGenome( hashes_[i].second, hashes_[j].second );
+				}
+				if ( !seen ) ++result;
+			}
+		}
+		return result;
+	}
+};
+
+#endif /* POPULATION_DIVERSITY_H_ */
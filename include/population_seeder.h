@@ -0,0 +1,134 @@
+/*******************************************************************************
+ *
+ *      population_seeder
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef POPULATION_SEEDER_H_
+#define POPULATION_SEEDER_H_
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include "genetic_process.h"
+#include "genome_archive.h"
+
+// warm start: fills part of a GeneticProcess's initial population with the fittest genomes of an archive and randomizes the rest
+// genomes are built straight from the archive's mapping; if the archive holds fewer genomes than asked for, its best ones are
+// used again (mutate them to get a spread of variants rather than exact copies)
+template<class _GeneticProcessType>
+class PopulationSeeder
+{
+public:
+	typedef _GeneticProcessType _GeneticProcess;
+	typedef typename _GeneticProcess::_Genome _Genome;
+	typedef typename _GeneticProcess::_GenomePtr _GenomePtr;
+	typedef typename _GeneticProcess::_SizeType _SizeType;
+	typedef typename _GeneticProcess::_PopulationVector _PopulationVector;
+	typedef GenomeArchiveReader<_Genome> _GenomeArchiveReader;
+
+	struct Descriptor
+	{
+		// share of the population taken from the archive, 0..1
+		double fraction_;
+		// mutate every seed once, at the genes' own mutation rates
+		bool mutate_;
+
+		Descriptor( double fraction = 0.5, bool mutate = false ) :
+			fraction_( fraction ), mutate_( mutate )
+		{
+			//
+		}
+	};
+
+protected:
+	Descriptor descriptor_;
+
+public:
+	PopulationSeeder( Descriptor descriptor = Descriptor() ) :
+		descriptor_( descriptor )
+	{
+		//
+	}
+
+	// seed the process's population from the archive and evaluate it; fails if the archive's genomes have a different shape
+	bool seed( _GeneticProcess & process, const _GenomeArchiveReader & archive ) const
+	{
+		const typename _Genome::Descriptor & genome_descriptor = process.descriptor().genome_descriptor_;
+		if ( archive.descriptor().size_ != genome_descriptor.size_ || archive.descriptor().chromosome_descriptor_.size_ != genome_descriptor.chromosome_descriptor_.size_ )
+		{
+			fprintf( stderr, "Archive genomes have %u chromosomes of %u genes, the process expects %u of %u\n", archive.descriptor().size_, archive.descriptor().chromosome_descriptor_.size_,
+					genome_descriptor.size_, genome_descriptor.chromosome_descriptor_.size_ );
+			return false;
+		}
+
+		process.initializePopulation( createSeeds( archive, process.descriptor().population_size_ ) );
+		return true;
+	}
+
+	// the caller owns the result
+	_PopulationVector createSeeds( const _GenomeArchiveReader & archive, _SizeType population_size ) const
+	{
+		ScopedTrace trace( "seed", "ga" );
+
+		const double fraction = std::min( std::max( descriptor_.fraction_, 0.0 ), 1.0 );
+		const _SizeType num_seeds = archive.numGenomes() > 0 ? (_SizeType) ( fraction * population_size + 0.5 ) : 0;
+
+		// the archive's best genomes, fittest first; ties keep archive order so seeding is deterministic
+		std::vector<unsigned long long> best( archive.numGenomes() );
+		for ( unsigned long long i = 0; i < best.size(); ++i )
+		{
+			best[i] = i;
+		}
+		const size_t num_best = std::min<unsigned long long>( num_seeds, best.size() );
+		std::partial_sort( best.begin(), best.begin() + num_best, best.end(), [&archive]( unsigned long long a, unsigned long long b )
+		{
+			const double fitness_a = archive.fitness( a ), fitness_b = archive.fitness( b );
+			return fitness_a > fitness_b || ( fitness_a == fitness_b && a < b );
+		} );
+
+		_PopulationVector seeds( num_seeds );
+		for ( _SizeType i = 0; i < num_seeds; ++i )
+		{
+			{
+				MemoryScope memory_scope( MemorySubsystem::genomes );
+				seeds[i] = archive.createGenome( best[i % num_best] );
+			}
+			if ( descriptor_.mutate_ ) seeds[i]->mutate();
+		}
+
+		__DEBUG__QUIET__ logPrintf( "Seeding %u of %u individuals from %zu archived genomes\n", num_seeds, population_size, num_best );
+		return seeds;
+	}
+};
+
+#endif /* POPULATION_SEEDER_H_ */
@@ -0,0 +1,389 @@
+/*******************************************************************************
+ *
+ *      process_metrics
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef PROCESS_METRICS_H_
+#define PROCESS_METRICS_H_
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+
+namespace ProcessMetricsUtil
+{
+	// monotonic time in nanoseconds
+	static unsigned long long nowNs()
+	{
+		struct timespec ts;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+}
+
+// per-phase timers and counters for GeneticProcess::step()
+// every value is kept both for the last completed generation and as a running total, so a dump taken after any generation shows
+// where that generation's time went as well as where the whole run's time went
+// recording is a handful of clock reads and integer increments per generation (plus one increment per selection draw / mutated gene)
+// so it stays on by default
+class ProcessMetrics
+{
+public:
+	struct Phase
+	{
+		typedef unsigned int _Storage;
+		const static _Storage selection = 0;
+		const static _Storage crossover = 1;
+		const static _Storage mutation = 2;
+		const static _Storage replacement = 3;
+		const static _Storage evaluation = 4;
+		const static _Storage NUM_PHASES = 5;
+	};
+
+	struct Counter
+	{
+		typedef unsigned int _Storage;
+		// calls to rouletteSelect()
+		const static _Storage selection_draws = 0;
+		// chromosomes copied into children by crossover
+		const static _Storage crossover_copies = 1;
+		const static _Storage genes_mutated = 2;
+		const static _Storage genes_evaluated = 3;
+		// heap allocations made by crossover, mutation and replacement, as counted by MemoryAccounting (0 unless it's linked in)
+		const static _Storage allocations = 4;
+		const static _Storage NUM_COUNTERS = 5;
+	};
+
+	// quantiles of the fitness of the last evaluated population, exported as gauges
+	struct FitnessQuantile
+	{
+		typedef unsigned int _Storage;
+		const static _Storage min = 0;
+		const static _Storage p10 = 1;
+		const static _Storage p50 = 2;
+		const static _Storage p90 = 3;
+		const static _Storage p99 = 4;
+		const static _Storage max = 5;
+		const static _Storage NUM_QUANTILES = 6;
+	};
+
+	struct Format
+	{
+		typedef unsigned int _Storage;
+		// one JSON object per line, appended every generation
+		const static _Storage json = 0;
+		// Prometheus text exposition format; the file is replaced every generation (suitable for a textfile collector)
+		const static _Storage prometheus = 1;
+	};
+
+	static const char * phaseName( Phase::_Storage phase )
+	{
+		static const char * names[Phase::NUM_PHASES] = { "selection", "crossover", "mutation", "replacement", "evaluation" };
+		return phase < Phase::NUM_PHASES ? names[phase] : "unknown";
+	}
+
+	static const char * counterName( Counter::_Storage counter )
+	{
+		static const char * names[Counter::NUM_COUNTERS] = { "selection_draws", "crossover_copies", "genes_mutated", "genes_evaluated", "allocations" };
+		return counter < Counter::NUM_COUNTERS ? names[counter] : "unknown";
+	}
+
+	static const char * fitnessQuantileName( FitnessQuantile::_Storage quantile )
+	{
+		static const char * names[FitnessQuantile::NUM_QUANTILES] = { "min", "p10", "p50", "p90", "p99", "max" };
+		return quantile < FitnessQuantile::NUM_QUANTILES ? names[quantile] : "unknown";
+	}
+
+	// the q of each FitnessQuantile, as a Prometheus quantile label
+	static const char * fitnessQuantileLabel( FitnessQuantile::_Storage quantile )
+	{
+		static const char * labels[FitnessQuantile::NUM_QUANTILES] = { "0", "0.1", "0.5", "0.9", "0.99", "1" };
+		return quantile < FitnessQuantile::NUM_QUANTILES ? labels[quantile] : "unknown";
+	}
+
+protected:
+	bool enabled_;
+	unsigned long long generation_;
+	unsigned long long generation_start_ns_;
+	unsigned long long last_generation_ns_;
+	unsigned long long total_generation_ns_;
+
+	// running values for the generation in progress
+	unsigned long long phase_ns_[Phase::NUM_PHASES];
+	unsigned long long counters_[Counter::NUM_COUNTERS];
+
+	// values for the last completed generation
+	unsigned long long last_phase_ns_[Phase::NUM_PHASES];
+	unsigned long long last_counters_[Counter::NUM_COUNTERS];
+
+	unsigned long long total_phase_ns_[Phase::NUM_PHASES];
+	unsigned long long total_counters_[Counter::NUM_COUNTERS];
+
+	double fitness_quantiles_[FitnessQuantile::NUM_QUANTILES];
+
+	std::string dump_filename_;
+	Format::_Storage dump_format_;
+	FILE * dump_file_;
+
+public:
+	ProcessMetrics() :
+		enabled_( true ), dump_format_( Format::json ), dump_file_( NULL )
+	{
+		clear();
+	}
+
+	~ProcessMetrics()
+	{
+		closeDump();
+	}
+
+	void clear()
+	{
+		generation_ = 0;
+		generation_start_ns_ = 0;
+		last_generation_ns_ = 0;
+		total_generation_ns_ = 0;
+		for ( Phase::_Storage i = 0; i < Phase::NUM_PHASES; ++i )
+			phase_ns_[i] = last_phase_ns_[i] = total_phase_ns_[i] = 0;
+		for ( Counter::_Storage i = 0; i < Counter::NUM_COUNTERS; ++i )
+			counters_[i] = last_counters_[i] = total_counters_[i] = 0;
+		for ( FitnessQuantile::_Storage i = 0; i < FitnessQuantile::NUM_QUANTILES; ++i )
+			fitness_quantiles_[i] = 0;
+	}
+
+	void setEnabled( bool enabled )
+	{
+		enabled_ = enabled;
+	}
+
+	bool enabled() const
+	{
+		return enabled_;
+	}
+
+	// dump the metrics to the given file after every generation; returns false if the file can't be opened
+	bool openDump( const std::string & filename, Format::_Storage format = Format::json )
+	{
+		closeDump();
+		dump_filename_ = filename;
+		dump_format_ = format;
+		if ( format == Format::prometheus ) return true;
+		dump_file_ = fopen( filename.c_str(), "w" );
+		return dump_file_ != NULL;
+	}
+
+	void closeDump()
+	{
+		if ( dump_file_ ) fclose( dump_file_ );
+		dump_file_ = NULL;
+		dump_filename_.clear();
+	}
+
+	// phases are timed as start/stop pairs and may be entered several times per generation; the durations add up
+	unsigned long long startPhase() const
+	{
+		return enabled_ ? ProcessMetricsUtil::nowNs() : 0;
+	}
+
+	void stopPhase( Phase::_Storage phase, unsigned long long start_ns )
+	{
+		if ( enabled_ ) phase_ns_[phase] += ProcessMetricsUtil::nowNs() - start_ns;
+	}
+
+	// stopPhase() that returns the stop time as the start of the next phase, for phases that follow each other in a loop
+	unsigned long long switchPhase( Phase::_Storage phase, unsigned long long start_ns )
+	{
+		if ( !enabled_ ) return 0;
+		const unsigned long long now_ns = ProcessMetricsUtil::nowNs();
+		phase_ns_[phase] += now_ns - start_ns;
+		return now_ns;
+	}
+
+	void count( Counter::_Storage counter, unsigned long long amount = 1 )
+	{
+		counters_[counter] += amount;
+	}
+
+	// replaces the fitness quantiles with those of the population just evaluated
+	void setFitnessQuantiles( const double quantiles[FitnessQuantile::NUM_QUANTILES] )
+	{
+		for ( FitnessQuantile::_Storage i = 0; i < FitnessQuantile::NUM_QUANTILES; ++i )
+			fitness_quantiles_[i] = quantiles[i];
+	}
+
+	// anything recorded since the last generation ended (e.g. the initial evaluation) is not attributed to this one
+	void beginGeneration()
+	{
+		for ( Phase::_Storage i = 0; i < Phase::NUM_PHASES; ++i )
+			phase_ns_[i] = 0;
+		for ( Counter::_Storage i = 0; i < Counter::NUM_COUNTERS; ++i )
+			counters_[i] = 0;
+		if ( enabled_ ) generation_start_ns_ = ProcessMetricsUtil::nowNs();
+	}
+
+	// close the current generation: move the running values into "last" and the totals, then dump if a dump file is set
+	void endGeneration()
+	{
+		if ( !enabled_ ) return;
+		last_generation_ns_ = ProcessMetricsUtil::nowNs() - generation_start_ns_;
+		total_generation_ns_ += last_generation_ns_;
+		for ( Phase::_Storage i = 0; i < Phase::NUM_PHASES; ++i )
+		{
+			last_phase_ns_[i] = phase_ns_[i];
+			total_phase_ns_[i] += phase_ns_[i];
+		}
+		for ( Counter::_Storage i = 0; i < Counter::NUM_COUNTERS; ++i )
+		{
+			last_counters_[i] = counters_[i];
+			total_counters_[i] += counters_[i];
+		}
+		++generation_;
+
+		if ( !dump_filename_.empty() ) dump();
+	}
+
+	unsigned long long numGenerations() const
+	{
+		return generation_;
+	}
+
+	unsigned long long lastGenerationNs() const
+	{
+		return last_generation_ns_;
+	}
+
+	unsigned long long totalGenerationNs() const
+	{
+		return total_generation_ns_;
+	}
+
+	unsigned long long lastPhaseNs( Phase::_Storage phase ) const
+	{
+		return last_phase_ns_[phase];
+	}
+
+	unsigned long long totalPhaseNs( Phase::_Storage phase ) const
+	{
+		return total_phase_ns_[phase];
+	}
+
+	unsigned long long lastCounter( Counter::_Storage counter ) const
+	{
+		return last_counters_[counter];
+	}
+
+	unsigned long long totalCounter( Counter::_Storage counter ) const
+	{
+		return total_counters_[counter];
+	}
+
+	double fitnessQuantile( FitnessQuantile::_Storage quantile ) const
+	{
+		return fitness_quantiles_[quantile];
+	}
+
+	void writeJson( FILE * file ) const
+	{
+		fprintf( file, "{\"generation\":%llu,\"generation_ns\":%llu,\"total_generation_ns\":%llu", generation_, last_generation_ns_, total_generation_ns_ );
+		fprintf( file, ",\"phase_ns\":{" );
+		for ( Phase::_Storage i = 0; i < Phase::NUM_PHASES; ++i )
+			fprintf( file, "%s\"%s\":%llu", i ? "," : "", phaseName( i ), last_phase_ns_[i] );
+		fprintf( file, "},\"total_phase_ns\":{" );
+		for ( Phase::_Storage i = 0; i < Phase::NUM_PHASES; ++i )
+			fprintf( file, "%s\"%s\":%llu", i ? "," : "", phaseName( i ), total_phase_ns_[i] );
+		fprintf( file, "},\"counters\":{" );
+		for ( Counter::_Storage i = 0; i < Counter::NUM_COUNTERS; ++i )
+			fprintf( file, "%s\"%s\":%llu", i ? "," : "", counterName( i ), last_counters_[i] );
+		fprintf( file, "},\"total_counters\":{" );
+		for ( Counter::_Storage i = 0; i < Counter::NUM_COUNTERS; ++i )
+			fprintf( file, "%s\"%s\":%llu", i ? "," : "", counterName( i ), total_counters_[i] );
+		fprintf( file, "},\"fitness\":{" );
+		for ( FitnessQuantile::_Storage i = 0; i < FitnessQuantile::NUM_QUANTILES; ++i )
+			fprintf( file, "%s\"%s\":%.9g", i ? "," : "", fitnessQuantileName( i ), fitness_quantiles_[i] );
+		fprintf( file, "}}\n" );
+	}
+
+	// totals are exported as counters, the last generation as gauges
+	void writePrometheus( FILE * file ) const
+	{
+		fprintf( file, "# TYPE chromosound_generations_total counter\nchromosound_generations_total %llu\n", generation_ );
+		fprintf( file, "# TYPE chromosound_generation_seconds gauge\nchromosound_generation_seconds %.9f\n", last_generation_ns_ / 1e9 );
+		fprintf( file, "# TYPE chromosound_generation_seconds_total counter\nchromosound_generation_seconds_total %.9f\n", total_generation_ns_ / 1e9 );
+		fprintf( file, "# TYPE chromosound_phase_seconds gauge\n" );
+		for ( Phase::_Storage i = 0; i < Phase::NUM_PHASES; ++i )
+			fprintf( file, "chromosound_phase_seconds{phase=\"%s\"} %.9f\n", phaseName( i ), last_phase_ns_[i] / 1e9 );
+		fprintf( file, "# TYPE chromosound_phase_seconds_total counter\n" );
+		for ( Phase::_Storage i = 0; i < Phase::NUM_PHASES; ++i )
+			fprintf( file, "chromosound_phase_seconds_total{phase=\"%s\"} %.9f\n", phaseName( i ), total_phase_ns_[i] / 1e9 );
+		for ( Counter::_Storage i = 0; i < Counter::NUM_COUNTERS; ++i )
+		{
+			fprintf( file, "# TYPE chromosound_%s gauge\nchromosound_%s %llu\n", counterName( i ), counterName( i ), last_counters_[i] );
+			fprintf( file, "# TYPE chromosound_%s_total counter\nchromosound_%s_total %llu\n", counterName( i ), counterName( i ), total_counters_[i] );
+		}
+		fprintf( file, "# TYPE chromosound_fitness gauge\n" );
+		for ( FitnessQuantile::_Storage i = 0; i < FitnessQuantile::NUM_QUANTILES; ++i )
+			fprintf( file, "chromosound_fitness{quantile=\"%s\"} %.9g\n", fitnessQuantileLabel( i ), fitness_quantiles_[i] );
+	}
+
+	// human-readable breakdown of the whole run
+	void print( FILE * file ) const
+	{
+		fprintf( file, "--process metrics (%llu generations, %.3f ms/generation)\n", generation_, generation_ ? total_generation_ns_ / 1e6 / generation_ : 0.0 );
+		for ( Phase::_Storage i = 0; i < Phase::NUM_PHASES; ++i )
+			fprintf( file, "%12s: %10.3f ms (%5.1f%%)\n", phaseName( i ), total_phase_ns_[i] / 1e6, total_generation_ns_ ? 100.0 * total_phase_ns_[i] / total_generation_ns_ : 0.0 );
+		for ( Counter::_Storage i = 0; i < Counter::NUM_COUNTERS; ++i )
+			fprintf( file, "%16s: %llu\n", counterName( i ), total_counters_[i] );
+	}
+
+protected:
+	void dump()
+	{
+		if ( dump_format_ == Format::json )
+		{
+			if ( !dump_file_ ) return;
+			writeJson( dump_file_ );
+			fflush( dump_file_ );
+			return;
+		}
+
+		// write next to the target and rename so scrapers never see a partial file
+		const std::string temp_filename = dump_filename_ + ".tmp";
+		FILE * file = fopen( temp_filename.c_str(), "w" );
+		if ( !file ) return;
+		writePrometheus( file );
+		fclose( file );
+		rename( temp_filename.c_str(), dump_filename_.c_str() );
+	}
+};
+
+#endif /* PROCESS_METRICS_H_ */
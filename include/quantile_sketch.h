@@ -0,0 +1,310 @@
+/*******************************************************************************
+ *
+ *      quantile_sketch
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef QUANTILE_SKETCH_H_
+#define QUANTILE_SKETCH_H_
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+// a mergeable streaming sketch of a distribution (DDSketch): values are counted in logarithmically sized buckets, so any
+// quantile comes back within relative_accuracy_ of a value that was added, with no sorting and memory logarithmic in the
+// range of magnitudes. negative and positive values are kept in separate sets of buckets, and magnitudes too small to index
+// count as zero
+//
+// merging adds bucket counts, so sketches built over parts of the data (e.g. one per thread) merge into exactly the sketch
+// of the whole, whatever the split and the order. when a set of buckets would grow past max_buckets_ the smallest
+// magnitudes are folded together, which only costs accuracy for values close to zero (and makes the merged sketch depend
+// on the order after all, as values may be folded in one order and not the other)
+//
+// rather than calling log() for every value, the bucket index interpolates log2 linearly between powers of two, read
+// straight off the bits of the double. that underestimates the slope of the log by up to a factor of 2 ln 2, so the
+// buckets are made that much narrower to keep the same accuracy (about 44% more of them)
+class QuantileSketch
+{
+public:
+	struct Descriptor
+	{
+		double relative_accuracy_;
+		// per sign
+		unsigned int max_buckets_;
+
+		Descriptor( double relative_accuracy = 0.01, unsigned int max_buckets = 2048 ) :
+			relative_accuracy_( relative_accuracy ), max_buckets_( max_buckets )
+		{
+			//
+		}
+	};
+
+	// magnitudes below this count as zero
+	constexpr static double MIN_MAGNITUDE = 1e-9;
+
+protected:
+	// counts_[i] is the number of magnitudes in bucket offset_ + i, that is with ( offset_ + i - 1 ) / scale_ < log2'( magnitude )
+	// <= ( offset_ + i ) / scale_, log2' being the interpolated log2
+	struct Buckets
+	{
+		std::vector<unsigned long long> counts_;
+		int offset_;
+
+		Buckets() :
+			offset_( 0 )
+		{
+			//
+		}
+	};
+
+	Descriptor descriptor_;
+	// buckets per power of two
+	double scale_;
+	Buckets negative_;
+	Buckets positive_;
+	unsigned long long zero_count_;
+	unsigned long long count_;
+	double min_;
+	double max_;
+	double sum_;
+
+public:
+	QuantileSketch( Descriptor descriptor = Descriptor() ) :
+		descriptor_( descriptor ), scale_( 1 / log( ( 1 + descriptor.relative_accuracy_ ) / ( 1 - descriptor.relative_accuracy_ ) ) ), zero_count_( 0 ),
+				count_( 0 ), min_( 0 ), max_( 0 ), sum_( 0 )
+	{
+		//
+	}
+
+	// forgets every value but keeps the memory
+	void clear()
+	{
+		negative_.counts_.clear();
+		positive_.counts_.clear();
+		zero_count_ = 0;
+		count_ = 0;
+		min_ = max_ = sum_ = 0;
+	}
+
+	unsigned long long count() const
+	{
+		return count_;
+	}
+
+	// exact, as are max() and sum()
+	double min() const
+	{
+		return min_;
+	}
+
+	double max() const
+	{
+		return max_;
+	}
+
+	double sum() const
+	{
+		return sum_;
+	}
+
+	void add( double value )
+	{
+		if ( count_ == 0 || value < min_ ) min_ = value;
+		if ( count_ == 0 || value > max_ ) max_ = value;
+		++count_;
+		sum_ += value;
+
+		if ( value >= MIN_MAGNITUDE ) increment( positive_, bucketIndex( value ), 1 );
+		else if ( value <= -MIN_MAGNITUDE ) increment( negative_, bucketIndex( -value ), 1 );
+		else ++zero_count_;
+	}
+
+	// both sketches must have the same relative accuracy
+	void merge( const QuantileSketch & other )
+	{
+		if ( other.count_ == 0 ) return;
+		if ( count_ == 0 || other.min_ < min_ ) min_ = other.min_;
+		if ( count_ == 0 || other.max_ > max_ ) max_ = other.max_;
+		count_ += other.count_;
+		sum_ += other.sum_;
+		zero_count_ += other.zero_count_;
+		mergeBuckets( negative_, other.negative_ );
+		mergeBuckets( positive_, other.positive_ );
+	}
+
+	// the value at rank q * ( count() - 1 ), q in [0, 1]; 0 if the sketch is empty
+	double quantile( double q ) const
+	{
+		if ( count_ == 0 ) return 0;
+		if ( q <= 0 ) return min_;
+		if ( q >= 1 ) return max_;
+
+		const unsigned long long rank = (unsigned long long) ( q * ( count_ - 1 ) );
+		unsigned long long seen = 0;
+		double result = max_;
+
+		// the most negative values first
+		bool found = false;
+		for ( size_t i = negative_.counts_.size(); i-- > 0 && !found; )
+		{
+			seen += negative_.counts_[i];
+			if ( seen > rank ) result = -bucketValue( negative_.offset_ + (int) i ), found = true;
+		}
+		if ( !found && ( seen += zero_count_ ) > rank ) result = 0, found = true;
+		for ( size_t i = 0; i < positive_.counts_.size() && !found; ++i )
+		{
+			seen += positive_.counts_[i];
+			if ( seen > rank ) result = bucketValue( positive_.offset_ + (int) i ), found = true;
+		}
+		return std::min( std::max( result, min_ ), max_ );
+	}
+
+	// counts of the values falling in num_bins equal slices of [min(), max()]; each bucket lands in the slice its value
+	// (as quantile() would report it) falls in
+	void histogram( unsigned int num_bins, std::vector<unsigned long long> & bins ) const
+	{
+		bins.assign( num_bins, 0 );
+		if ( num_bins == 0 || count_ == 0 ) return;
+
+		for ( size_t i = 0; i < negative_.counts_.size(); ++i )
+		{
+			if ( negative_.counts_[i] > 0 ) bins[bin( -bucketValue( negative_.offset_ + (int) i ), num_bins )] += negative_.counts_[i];
+		}
+		if ( zero_count_ > 0 ) bins[bin( 0, num_bins )] += zero_count_;
+		for ( size_t i = 0; i < positive_.counts_.size(); ++i )
+		{
+			if ( positive_.counts_[i] > 0 ) bins[bin( bucketValue( positive_.offset_ + (int) i ), num_bins )] += positive_.counts_[i];
+		}
+	}
+
+protected:
+	// magnitude = ( 1 + m ) * 2^e with m in [0, 1) gives log2' = e + m; magnitudes are normal doubles since they're at least
+	// MIN_MAGNITUDE
+	int bucketIndex( double magnitude ) const
+	{
+		uint64_t bits;
+		memcpy( &bits, &magnitude, sizeof( bits ) );
+		const int exponent = (int) ( bits >> 52 ) - 1023;
+		const double mantissa = ( bits & ( ( (uint64_t) 1 << 52 ) - 1 ) ) * ( 1.0 / ( (uint64_t) 1 << 52 ) );
+		// ceil, without the call
+		const double position = ( exponent + mantissa ) * scale_;
+		const int index = (int) position;
+		return index < position ? index + 1 : index;
+	}
+
+	// inverse of log2'
+	static double interpolatedPow2( double log2 )
+	{
+		const double exponent = floor( log2 );
+		return ldexp( 1 + ( log2 - exponent ), (int) exponent );
+	}
+
+	// the harmonic mean of the bucket's bounds, which is within the relative accuracy of anything in it
+	double bucketValue( int index ) const
+	{
+		const double low = interpolatedPow2( ( index - 1 ) / scale_ );
+		const double high = interpolatedPow2( index / scale_ );
+		return 2 * low * high / ( low + high );
+	}
+
+	unsigned int bin( double value, unsigned int num_bins ) const
+	{
+		if ( max_ <= min_ ) return 0;
+		const double position = ( std::min( std::max( value, min_ ), max_ ) - min_ ) / ( max_ - min_ ) * num_bins;
+		return std::min( (unsigned int) position, num_bins - 1 );
+	}
+
+	void addToBuckets( Buckets & buckets, int index, unsigned long long count )
+	{
+		const int max_buckets = descriptor_.max_buckets_;
+		if ( buckets.counts_.empty() )
+		{
+			buckets.counts_.push_back( 0 );
+			buckets.offset_ = index;
+		}
+
+		const int end = buckets.offset_ + (int) buckets.counts_.size();
+		if ( index < buckets.offset_ )
+		{
+			// smaller than anything seen: grow downwards as far as the limit allows, fold the rest into the lowest bucket
+			const int new_offset = std::max( index, end - max_buckets );
+			if ( new_offset < buckets.offset_ )
+			{
+				buckets.counts_.insert( buckets.counts_.begin(), buckets.offset_ - new_offset, 0 );
+				buckets.offset_ = new_offset;
+			}
+			index = std::max( index, buckets.offset_ );
+		}
+		else if ( index >= end )
+		{
+			// bigger than anything seen: fold the lowest buckets together to make room if needed; on a jump of more than
+			// max_buckets_ everything ends up in the new lowest bucket
+			const int excess = index + 1 - buckets.offset_ - max_buckets;
+			if ( excess > 0 )
+			{
+				const size_t folded = std::min<size_t>( excess, buckets.counts_.size() - 1 );
+				for ( size_t i = 0; i < folded; ++i )
+				{
+					buckets.counts_[folded] += buckets.counts_[i];
+				}
+				buckets.counts_.erase( buckets.counts_.begin(), buckets.counts_.begin() + folded );
+				buckets.offset_ += excess;
+			}
+			buckets.counts_.resize( index + 1 - buckets.offset_, 0 );
+		}
+		buckets.counts_[index - buckets.offset_] += count;
+	}
+
+	inline void increment( Buckets & buckets, int index, unsigned long long count )
+	{
+		const size_t position = (size_t) ( index - buckets.offset_ );
+		if ( position < buckets.counts_.size() ) buckets.counts_[position] += count;
+		else addToBuckets( buckets, index, count );
+	}
+
+	void mergeBuckets( Buckets & buckets, const Buckets & other )
+	{
+		if ( other.counts_.empty() ) return;
+		// grow to the whole range up front, lowest first, so the buckets move at most twice
+		increment( buckets, other.offset_, 0 );
+		increment( buckets, other.offset_ + (int) other.counts_.size() - 1, 0 );
+		for ( size_t i = 0; i < other.counts_.size(); ++i )
+		{
+			if ( other.counts_[i] > 0 ) increment( buckets, other.offset_ + (int) i, other.counts_[i] );
+		}
+	}
+};
+
+#endif /* QUANTILE_SKETCH_H_ */
@@ -0,0 +1,328 @@
+/*******************************************************************************
+ *
+ *      trace_events
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef TRACE_EVENTS_H_
+#define TRACE_EVENTS_H_
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// timeline of spans in the Chrome trace-event JSON format (chrome://tracing, ui.perfetto.dev)
+// every thread appends to its own buffer; full buffers are handed to a background thread which formats and writes them, so the
+// traced threads never touch the file. while tracing is stopped a span costs one relaxed atomic load
+//
+// usage:
+//   TraceLog::instance().start( "run.trace.json" );
+//   { ScopedTrace span( "evaluate", "ga" ); ... }
+//   TraceLog::instance().stop();
+
+namespace TraceEventsUtil
+{
+	// monotonic time in nanoseconds
+	static unsigned long long nowNs()
+	{
+		struct timespec ts;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+}
+
+class TraceLog
+{
+public:
+	// names, categories and argument names must be string literals (or otherwise outlive the trace); they're stored as pointers
+	struct Event
+	{
+		// 'X' complete span, 'C' counter, 'i' instant
+		char phase_;
+		const char * name_;
+		const char * category_;
+		unsigned long long start_ns_;
+		unsigned long long duration_ns_;
+		const char * arg_name_;
+		double arg_value_;
+		unsigned int thread_id_;
+	};
+
+	typedef std::vector<Event> _EventVector;
+
+	// events per thread buffer before it's handed to the writer
+	const static unsigned int CHUNK_SIZE = 4096;
+
+protected:
+	struct ThreadBuffer
+	{
+		std::mutex mutex_;
+		_EventVector events_;
+		unsigned int thread_id_;
+		std::string name_;
+	};
+
+	std::atomic<bool> enabled_;
+	std::mutex mutex_;
+	std::condition_variable chunks_ready_;
+	std::deque<_EventVector> chunks_;
+	std::vector<ThreadBuffer *> thread_buffers_;
+	std::thread writer_;
+	bool stop_writer_;
+	FILE * file_;
+	unsigned long long start_ns_;
+	unsigned long long num_events_written_;
+
+	TraceLog() :
+		enabled_( false ), stop_writer_( false ), file_( NULL ), start_ns_( 0 ), num_events_written_( 0 )
+	{
+		//
+	}
+
+public:
+	~TraceLog()
+	{
+		stop();
+		for ( unsigned int i = 0; i < thread_buffers_.size(); ++i )
+			delete thread_buffers_[i];
+	}
+
+	static TraceLog & instance()
+	{
+		static TraceLog trace_log;
+		return trace_log;
+	}
+
+	static bool enabled()
+	{
+		return instance().enabled_.load( std::memory_order_relaxed );
+	}
+
+	bool start( const std::string & filename )
+	{
+		stop();
+		std::lock_guard<std::mutex> lock( mutex_ );
+		file_ = fopen( filename.c_str(), "w" );
+		if ( !file_ ) return false;
+		fprintf( file_, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+		fprintf( file_, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"chromosound\"}}" );
+		num_events_written_ = 0;
+		start_ns_ = TraceEventsUtil::nowNs();
+		stop_writer_ = false;
+		writer_ = std::thread( &TraceLog::writerLoop, this );
+		enabled_ = true;
+		return true;
+	}
+
+	// collect what every thread still has buffered, wait for the writer to drain and close the file
+	// spans still open when the trace stops are dropped
+	void stop()
+	{
+		if ( !enabled_.exchange( false ) ) return;
+
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			for ( unsigned int i = 0; i < thread_buffers_.size(); ++i )
+			{
+				ThreadBuffer * buffer = thread_buffers_[i];
+				std::lock_guard<std::mutex> buffer_lock( buffer->mutex_ );
+				if ( buffer->events_.empty() ) continue;
+				chunks_.push_back( _EventVector() );
+				chunks_.back().swap( buffer->events_ );
+			}
+			stop_writer_ = true;
+		}
+		chunks_ready_.notify_one();
+		writer_.join();
+
+		for ( unsigned int i = 0; i < thread_buffers_.size(); ++i )
+		{
+			fprintf( file_, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", thread_buffers_[i]->thread_id_ );
+			writeEscaped( thread_buffers_[i]->name_ );
+			fprintf( file_, "\"}}" );
+		}
+		fprintf( file_, "\n]}\n" );
+		fclose( file_ );
+		file_ = NULL;
+	}
+
+	unsigned long long numEventsWritten() const
+	{
+		return num_events_written_;
+	}
+
+	// name the calling thread in the timeline
+	void setThreadName( const std::string & name )
+	{
+		ThreadBuffer * buffer = threadBuffer();
+		std::lock_guard<std::mutex> lock( buffer->mutex_ );
+		buffer->name_ = name;
+	}
+
+	void complete( const char * name, const char * category, unsigned long long start_ns, unsigned long long end_ns, const char * arg_name = NULL, double arg_value = 0 )
+	{
+		if ( !enabled() ) return;
+		Event event = { 'X', name, category, start_ns, end_ns - start_ns, arg_name, arg_value, 0 };
+		append( event );
+	}
+
+	// a value over time, drawn as its own track (e.g. queued audio)
+	void counter( const char * name, double value )
+	{
+		if ( !enabled() ) return;
+		Event event = { 'C', name, "counter", TraceEventsUtil::nowNs(), 0, name, value, 0 };
+		append( event );
+	}
+
+	void instant( const char * name, const char * category )
+	{
+		if ( !enabled() ) return;
+		Event event = { 'i', name, category, TraceEventsUtil::nowNs(), 0, NULL, 0, 0 };
+		append( event );
+	}
+
+protected:
+	ThreadBuffer * threadBuffer()
+	{
+		static thread_local ThreadBuffer * thread_buffer = NULL;
+		if ( !thread_buffer )
+		{
+			thread_buffer = new ThreadBuffer();
+			std::lock_guard<std::mutex> lock( mutex_ );
+			thread_buffer->thread_id_ = thread_buffers_.size() + 1;
+			thread_buffer->events_.reserve( CHUNK_SIZE );
+			char name[32];
+			snprintf( name, sizeof( name ), "thread %u", thread_buffer->thread_id_ );
+			thread_buffer->name_ = name;
+			thread_buffers_.push_back( thread_buffer );
+		}
+		return thread_buffer;
+	}
+
+	// the per-thread lock is only ever contended while stop() collects the buffers
+	void append( Event & event )
+	{
+		ThreadBuffer * buffer = threadBuffer();
+		event.thread_id_ = buffer->thread_id_;
+
+		_EventVector full_chunk;
+		{
+			std::lock_guard<std::mutex> lock( buffer->mutex_ );
+			buffer->events_.push_back( event );
+			if ( buffer->events_.size() < CHUNK_SIZE ) return;
+			full_chunk.swap( buffer->events_ );
+			buffer->events_.reserve( CHUNK_SIZE );
+		}
+
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			chunks_.push_back( _EventVector() );
+			chunks_.back().swap( full_chunk );
+		}
+		chunks_ready_.notify_one();
+	}
+
+	void writerLoop()
+	{
+		std::unique_lock<std::mutex> lock( mutex_ );
+		while ( true )
+		{
+			chunks_ready_.wait( lock, [this] { return stop_writer_ || !chunks_.empty(); } );
+			while ( !chunks_.empty() )
+			{
+				_EventVector chunk;
+				chunk.swap( chunks_.front() );
+				chunks_.pop_front();
+				// format without holding the lock so traced threads can keep handing over chunks
+				lock.unlock();
+				writeChunk( chunk );
+				lock.lock();
+			}
+			if ( stop_writer_ ) return;
+		}
+	}
+
+	void writeChunk( const _EventVector & chunk )
+	{
+		for ( _EventVector::const_iterator it = chunk.begin(); it != chunk.end(); ++it )
+		{
+			// timestamps are in microseconds since the trace started
+			const double ts = it->start_ns_ >= start_ns_ ? ( it->start_ns_ - start_ns_ ) / 1000.0 : 0;
+			fprintf( file_, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f", it->phase_, it->name_, it->category_, it->thread_id_, ts );
+			if ( it->phase_ == 'X' ) fprintf( file_, ",\"dur\":%.3f", it->duration_ns_ / 1000.0 );
+			if ( it->phase_ == 'i' ) fprintf( file_, ",\"s\":\"t\"" );
+			if ( it->arg_name_ ) fprintf( file_, ",\"args\":{\"%s\":%.17g}", it->arg_name_, it->arg_value_ );
+			fprintf( file_, "}" );
+		}
+		num_events_written_ += chunk.size();
+	}
+
+	void writeEscaped( const std::string & text )
+	{
+		for ( unsigned int i = 0; i < text.size(); ++i )
+		{
+			if ( text[i] == '"' || text[i] == '\\' ) fputc( '\\', file_ );
+			if ( (unsigned char) text[i] >= 0x20 ) fputc( text[i], file_ );
+		}
+	}
+};
+
+// records a span from construction to destruction on the calling thread
+class ScopedTrace
+{
+protected:
+	const char * name_;
+	const char * category_;
+	const char * arg_name_;
+	double arg_value_;
+	unsigned long long start_ns_;
+
+public:
+	ScopedTrace( const char * name, const char * category, const char * arg_name = NULL, double arg_value = 0 ) :
+		name_( name ), category_( category ), arg_name_( arg_name ), arg_value_( arg_value ), start_ns_( TraceLog::enabled() ? TraceEventsUtil::nowNs() : 0 )
+	{
+		//
+	}
+
+	~ScopedTrace()
+	{
+		if ( start_ns_ ) TraceLog::instance().complete( name_, category_, start_ns_, TraceEventsUtil::nowNs(), arg_name_, arg_value_ );
+	}
+};
+
+#endif /* TRACE_EVENTS_H_ */
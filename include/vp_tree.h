@@ -0,0 +1,235 @@
+/*******************************************************************************
+ *
+ *      vp_tree
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef VP_TREE_H_
+#define VP_TREE_H_
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+// vantage-point tree over fixed-size float vectors with euclidean distance, for k-nearest-neighbour queries in
+// logarithmic rather than linear time
+// the tree keeps its own copy of the points, laid out in tree order so a query walks memory mostly forwards. it is built
+// once and not modified; rebuild it (or query a small unindexed set on the side) to take new points into account
+class VpTree
+{
+public:
+	// squared distance and id of a neighbour
+	typedef std::pair<float, unsigned int> _Neighbour;
+
+protected:
+	struct Node
+	{
+		// points within radius of the vantage point are in the nodes [node + 1, outside), the rest from outside on
+		// a negative radius marks a leaf: the points [node, outside) are simply scanned
+		float radius_;
+		unsigned int outside_;
+	};
+
+	// below this many points a linear scan beats walking further down the tree
+	const static size_t LEAF_SIZE = 8;
+
+	unsigned int dimension_;
+	// one entry per node; node i's vantage point is points_[i * dimension_] with id ids_[i]
+	std::vector<Node> nodes_;
+	std::vector<float> points_;
+	std::vector<unsigned int> ids_;
+
+public:
+	VpTree( unsigned int dimension ) :
+		dimension_( dimension )
+	{
+		//
+	}
+
+	unsigned int dimension() const
+	{
+		return dimension_;
+	}
+
+	size_t size() const
+	{
+		return ids_.size();
+	}
+
+	static float squaredDistance( const float * a, const float * b, unsigned int dimension )
+	{
+		float result = 0;
+		for ( unsigned int i = 0; i < dimension; ++i )
+		{
+			const float difference = a[i] - b[i];
+			result += difference * difference;
+		}
+		return result;
+	}
+
+	// index num_points points of dimension() values each, stored one after the other; ids (or, if NULL, the positions of the
+	// points) are what queries return
+	void build( const float * points, size_t num_points, const unsigned int * ids = NULL )
+	{
+		std::vector<Item> items( num_points );
+		for ( size_t i = 0; i < num_points; ++i )
+		{
+			items[i].point_ = points + i * dimension_;
+			items[i].id_ = ids ? ids[i] : i;
+		}
+
+		nodes_.resize( num_points );
+		points_.resize( num_points * dimension_ );
+		ids_.resize( num_points );
+		if ( num_points > 0 ) build( items, 0, num_points );
+	}
+
+	// append the k points nearest to query (fewer if the tree is smaller) to neighbours, which is kept as a max-heap on distance
+	// of at most k entries; queries over several trees (or a brute-force set) can share one heap
+	void search( const float * query, unsigned int k, std::vector<_Neighbour> & neighbours ) const
+	{
+		if ( k == 0 || nodes_.empty() ) return;
+		search( query, k, 0, nodes_.size(), neighbours );
+	}
+
+	// offer one point to a neighbour heap, as search() does
+	static void offer( std::vector<_Neighbour> & neighbours, unsigned int k, float squared_distance, unsigned int id )
+	{
+		if ( neighbours.size() < k )
+		{
+			neighbours.push_back( _Neighbour( squared_distance, id ) );
+			std::push_heap( neighbours.begin(), neighbours.end() );
+		}
+		else if ( squared_distance < neighbours.front().first )
+		{
+			std::pop_heap( neighbours.begin(), neighbours.end() );
+			neighbours.back() = _Neighbour( squared_distance, id );
+			std::push_heap( neighbours.begin(), neighbours.end() );
+		}
+	}
+
+protected:
+	struct Item
+	{
+		const float * point_;
+		unsigned int id_;
+		float distance_;
+	};
+
+	struct CloserItem
+	{
+		bool operator()( const Item & a, const Item & b ) const
+		{
+			return a.distance_ < b.distance_;
+		}
+	};
+
+	// builds the subtree of items [begin, end) into nodes [begin, end)
+	void build( std::vector<Item> & items, size_t begin, size_t end )
+	{
+		while ( begin < end )
+		{
+			Node & node = nodes_[begin];
+			if ( end - begin <= LEAF_SIZE )
+			{
+				for ( size_t i = begin; i < end; ++i )
+				{
+					std::copy( items[i].point_, items[i].point_ + dimension_, &points_[i * dimension_] );
+					ids_[i] = items[i].id_;
+				}
+				node.radius_ = -1;
+				node.outside_ = end;
+				return;
+			}
+
+			// the middle item makes a better vantage point than the first on data that arrives sorted
+			std::swap( items[begin], items[begin + ( end - begin ) / 2] );
+			const Item & vantage = items[begin];
+			std::copy( vantage.point_, vantage.point_ + dimension_, &points_[begin * dimension_] );
+			ids_[begin] = vantage.id_;
+
+			for ( size_t i = begin + 1; i < end; ++i )
+			{
+				items[i].distance_ = sqrtf( squaredDistance( vantage.point_, items[i].point_, dimension_ ) );
+			}
+
+			// the closer half goes inside
+			const size_t middle = begin + 1 + ( end - begin - 1 ) / 2;
+			std::nth_element( items.begin() + begin + 1, items.begin() + middle, items.begin() + end, CloserItem() );
+			node.radius_ = items[middle].distance_;
+			node.outside_ = middle;
+
+			build( items, begin + 1, middle );
+			begin = middle;
+		}
+	}
+
+	void search( const float * query, unsigned int k, size_t begin, size_t end, std::vector<_Neighbour> & neighbours ) const
+	{
+		while ( begin < end )
+		{
+			const Node & node = nodes_[begin];
+			if ( node.radius_ < 0 )
+			{
+				for ( size_t i = begin; i < end; ++i )
+				{
+					offer( neighbours, k, squaredDistance( query, &points_[i * dimension_], dimension_ ), ids_[i] );
+				}
+				return;
+			}
+
+			const float squared_distance = squaredDistance( query, &points_[begin * dimension_], dimension_ );
+			offer( neighbours, k, squared_distance, ids_[begin] );
+
+			const float distance = sqrtf( squared_distance );
+			const size_t inside_begin = begin + 1, inside_end = node.outside_;
+
+			// visit the side the query is on first; the other one only if the current k-th neighbour is farther than the boundary
+			if ( distance < node.radius_ )
+			{
+				search( query, k, inside_begin, inside_end, neighbours );
+				if ( neighbours.size() == k && distance + sqrtf( neighbours.front().first ) < node.radius_ ) return;
+				begin = inside_end;
+			}
+			else
+			{
+				search( query, k, inside_end, end, neighbours );
+				if ( neighbours.size() == k && distance - sqrtf( neighbours.front().first ) > node.radius_ ) return;
+				begin = inside_begin;
+				end = inside_end;
+			}
+		}
+	}
+};
+
+#endif /* VP_TREE_H_ */
@@ -0,0 +1,169 @@
+/*******************************************************************************
+ *
+ *      wav_writer
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef WAV_WRITER_H_
+#define WAV_WRITER_H_
+
+#include <stdio.h>
+#include <string>
+
+// streams 16-bit PCM samples into a RIFF/WAVE file; only the header is ever rewritten so memory use is independent of the file length
+class WavWriter
+{
+public:
+	typedef short _SampleType;
+
+	// the RIFF sizes are 32-bit: the data chunk can't grow past this many bytes
+	const static unsigned long long MAX_DATA_SIZE = 0xFFFFFFFFull - 36;
+
+protected:
+	FILE * file_;
+	std::string filename_;
+	unsigned int sample_rate_;
+	unsigned int num_channels_;
+	unsigned long num_frames_;
+
+	bool writeU32( unsigned int value )
+	{
+		unsigned char bytes[4] = { (unsigned char) ( value & 0xFF ), (unsigned char) ( ( value >> 8 ) & 0xFF ), (unsigned char) ( ( value >> 16 ) & 0xFF ), (unsigned char) ( ( value >> 24 ) & 0xFF ) };
+		return fwrite( bytes, 1, 4, file_ ) == 4;
+	}
+
+	bool writeU16( unsigned short value )
+	{
+		unsigned char bytes[2] = { (unsigned char) ( value & 0xFF ), (unsigned char) ( ( value >> 8 ) & 0xFF ) };
+		return fwrite( bytes, 1, 2, file_ ) == 2;
+	}
+
+	bool writeTag( const char * tag )
+	{
+		return fwrite( tag, 1, 4, file_ ) == 4;
+	}
+
+	// the RIFF and data chunk sizes are unknown until the file is closed; they're written as zero first and patched in close()
+	bool writeHeader()
+	{
+		// write() keeps this within MAX_DATA_SIZE
+		const unsigned int data_size = num_frames_ * num_channels_ * sizeof( _SampleType );
+		bool success = writeTag( "RIFF" );
+		success &= writeU32( 36 + data_size );
+		success &= writeTag( "WAVE" );
+		success &= writeTag( "fmt " );
+		success &= writeU32( 16 );
+		success &= writeU16( 1 ); // PCM
+		success &= writeU16( num_channels_ );
+		success &= writeU32( sample_rate_ );
+		success &= writeU32( sample_rate_ * num_channels_ * sizeof( _SampleType ) );
+		success &= writeU16( num_channels_ * sizeof( _SampleType ) );
+		success &= writeU16( 8 * sizeof( _SampleType ) );
+		success &= writeTag( "data" );
+		success &= writeU32( data_size );
+		return success;
+	}
+
+public:
+	WavWriter() :
+		file_( NULL ), sample_rate_( 0 ), num_channels_( 0 ), num_frames_( 0 )
+	{
+		//
+	}
+
+	virtual ~WavWriter()
+	{
+		close();
+	}
+
+	bool open( const std::string & filename, unsigned int sample_rate, unsigned int num_channels = 1 )
+	{
+		close();
+		file_ = fopen( filename.c_str(), "wb" );
+		if ( !file_ ) return false;
+
+		filename_ = filename;
+		sample_rate_ = sample_rate;
+		num_channels_ = num_channels;
+		num_frames_ = 0;
+		if ( writeHeader() ) return true;
+		fclose( file_ );
+		file_ = NULL;
+		return false;
+	}
+
+	bool isOpen() const
+	{
+		return file_ != NULL;
+	}
+
+	// samples are interleaved; num_frames is the number of samples per channel
+	// note: samples are written in host byte order, which is little-endian on every platform we run on
+	// fails without writing anything if the file would grow past MAX_DATA_SIZE; samples isn't read if num_frames is 0
+	bool write( const _SampleType * samples, unsigned int num_frames )
+	{
+		if ( !file_ ) return false;
+		if ( num_frames == 0 ) return true;
+		if ( ( (unsigned long long) num_frames_ + num_frames ) * num_channels_ * sizeof( _SampleType ) > MAX_DATA_SIZE )
+		{
+			fprintf( stderr, "%s would be larger than a WAV file can be\n", filename_.c_str() );
+			return false;
+		}
+		const size_t num_samples = (size_t) num_frames * num_channels_;
+		if ( fwrite( samples, sizeof( _SampleType ), num_samples, file_ ) != num_samples ) return false;
+		num_frames_ += num_frames;
+		return true;
+	}
+
+	// returns false if the header couldn't be patched or buffered samples couldn't be flushed (e.g. the disk is full), in
+	// which case the file is incomplete; closing a writer that isn't open succeeds
+	bool close()
+	{
+		if ( !file_ ) return true;
+		bool success = fseek( file_, 0, SEEK_SET ) == 0 && writeHeader();
+		success &= fclose( file_ ) == 0;
+		file_ = NULL;
+		return success;
+	}
+
+	unsigned long numFrames() const
+	{
+		return num_frames_;
+	}
+
+	const std::string & filename() const
+	{
+		return filename_;
+	}
+};
+
+#endif /* WAV_WRITER_H_ */
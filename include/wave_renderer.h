@@ -0,0 +1,327 @@
+/*******************************************************************************
+ *
+ *      wave_renderer
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef WAVE_RENDERER_H_
+#define WAVE_RENDERER_H_
+
+#include <vector>
+#include <string.h>
+#include <math.h>
+#include "audio_genome.h"
+#include "memory_accounting.h"
+
+// turns WaveDescriptors into 16-bit PCM in software so any AudioOutput can play (or store) them
+// the shapes match the ones alutCreateBufferWaveform() produces
+class WaveRenderer
+{
+public:
+	typedef short _SampleType;
+	typedef std::vector<_SampleType> _SampleVector;
+	typedef AudioGenomeDefs::WaveDescriptor _WaveDescriptor;
+	typedef AudioGenomeDefs::Waveform _Waveform;
+
+	struct Descriptor
+	{
+	public:
+		unsigned int sample_rate_;
+		// peak amplitude in [0,1]
+		float amplitude_;
+		// smooth the discontinuities of square and sawtooth waves so they don't alias; turn off to get ALUT's naive shapes
+		bool band_limited_;
+		// keep the oscillator phase running from one note to the next instead of restarting every note at its own phase
+		bool phase_continuous_;
+		// note envelope; attack and release are shortened proportionally for notes that are too short to fit them
+		float attack_ms_;
+		float decay_ms_;
+		float sustain_level_;
+		float release_ms_;
+
+		Descriptor( unsigned int sample_rate = 44100, float amplitude = 0.5, bool band_limited = true, bool phase_continuous = true, float attack_ms = 5, float decay_ms = 0,
+				float sustain_level = 1, float release_ms = 5 ) :
+			sample_rate_( sample_rate ), amplitude_( amplitude ), band_limited_( band_limited ), phase_continuous_( phase_continuous ), attack_ms_( attack_ms ), decay_ms_( decay_ms ),
+					sustain_level_( sustain_level ), release_ms_( release_ms )
+		{
+			//
+		}
+	};
+
+	// samples are synthesized and shaped in chunks of this many frames
+	const static unsigned int BLOCK_SIZE = 256;
+
+protected:
+	Descriptor descriptor_;
+	// private noise generator so rendering never disturbs the genetic process's random sequence
+	unsigned int noise_state_;
+
+	// the wave currently being rendered
+	_WaveDescriptor wave_;
+	unsigned int num_frames_;
+	unsigned int frames_remaining_;
+	float phase_;
+	float phase_increment_;
+	bool has_previous_wave_;
+
+	// envelope of the current wave, in frames
+	float attack_frames_;
+	float decay_frames_;
+	float release_frames_;
+
+	float oscillator_block_[BLOCK_SIZE];
+	float gain_block_[BLOCK_SIZE];
+
+	float noise()
+	{
+		noise_state_ = noise_state_ * 1664525 + 1013904223;
+		return (float) ( noise_state_ >> 8 ) / ( 1 << 23 ) - 1;
+	}
+
+public:
+	WaveRenderer( Descriptor descriptor = Descriptor() ) :
+		descriptor_( descriptor ), noise_state_( 22222 ), wave_( 2, _Waveform::sine, 0, 0, 0 ), num_frames_( 0 ), frames_remaining_( 0 ), phase_( 0 ), phase_increment_( 0 ),
+				has_previous_wave_( false ), attack_frames_( 0 ), decay_frames_( 0 ), release_frames_( 0 )
+	{
+		//
+	}
+
+	const Descriptor & descriptor() const
+	{
+		return descriptor_;
+	}
+
+	unsigned int getNumFrames( const _WaveDescriptor & wave ) const
+	{
+		return (unsigned int) ( wave.duration * descriptor_.sample_rate_ + 0.5f );
+	}
+
+	// polynomial band-limited step (PolyBLEP): the correction to subtract from a naive unit step at phase 0 so the
+	// discontinuity is spread over the neighbouring samples; phase_increment is the wave's frequency / sample rate
+	static float polyBlep( float phase, float phase_increment )
+	{
+		if ( phase < phase_increment )
+		{
+			phase /= phase_increment;
+			return phase + phase - phase * phase - 1;
+		}
+		if ( phase > 1 - phase_increment )
+		{
+			phase = ( phase - 1 ) / phase_increment;
+			return phase * phase + phase + phase + 1;
+		}
+		return 0;
+	}
+
+	// value of the given shape at phase in [0,1)
+	float oscillate( _Waveform::_Storage shape, float phase, float phase_increment )
+	{
+		switch ( shape )
+		{
+		case _Waveform::square:
+		{
+			float value = phase < 0.5f ? 1 : -1;
+			if ( descriptor_.band_limited_ )
+			{
+				// one rising edge at 0 and one falling edge at 0.5
+				float falling_phase = phase + 0.5f;
+				if ( falling_phase >= 1 ) falling_phase -= 1;
+				value += polyBlep( phase, phase_increment ) - polyBlep( falling_phase, phase_increment );
+			}
+			return value;
+		}
+		case _Waveform::sawtooth:
+			return 2 * phase - 1 - ( descriptor_.band_limited_ ? polyBlep( phase, phase_increment ) : 0 );
+		case _Waveform::whitenoise:
+			return noise();
+		case _Waveform::impulse:
+			return phase == 0 ? 1 : 0;
+		case _Waveform::sine:
+		default:
+			return sin( 2 * M_PI * phase );
+		}
+	}
+
+protected:
+	// fill oscillator_block_ with the next block_size values of the current wave and advance the phase
+	// the shape is chosen once per block rather than once per sample
+	void oscillateBlock( unsigned int block_size )
+	{
+		float phase = phase_;
+		const float phase_increment = phase_increment_;
+		if ( wave_.wave_type == _Waveform::sine )
+		{
+			for ( unsigned int i = 0; i < block_size; ++i )
+			{
+				oscillator_block_[i] = sin( 2 * M_PI * phase );
+				phase += phase_increment;
+				if ( phase >= 1 ) phase -= floor( phase );
+			}
+		}
+		else
+		{
+			for ( unsigned int i = 0; i < block_size; ++i )
+			{
+				oscillator_block_[i] = oscillate( wave_.wave_type, phase, phase_increment );
+				phase += phase_increment;
+				if ( phase >= 1 ) phase -= floor( phase );
+			}
+		}
+		phase_ = phase;
+	}
+
+	// fill gain_block_ with the envelope for frames [first_frame, first_frame + block_size) of the current wave
+	// attack/decay/sustain and release are independent ramps that are multiplied together, so the loop has no branches
+	void envelopeBlock( unsigned int first_frame, unsigned int block_size )
+	{
+		const float attack_slope = attack_frames_ > 0 ? 1 / attack_frames_ : 0;
+		// without a decay phase we drop to the sustain level straight after the attack
+		const float decay_slope = ( 1 - descriptor_.sustain_level_ ) / ( decay_frames_ > 1 ? decay_frames_ : 1 );
+		const float sustain_level = descriptor_.sustain_level_;
+		const float release_slope = release_frames_ > 0 ? 1 / release_frames_ : 0;
+		const float attack_end = attack_frames_;
+		const float release_start = num_frames_ - release_frames_;
+		const float num_frames = num_frames_;
+
+		for ( unsigned int i = 0; i < block_size; ++i )
+		{
+			const float frame = first_frame + i;
+			const float attack = attack_slope > 0 && frame < attack_end ? frame * attack_slope : 1;
+			const float decay = frame >= attack_end ? 1 - ( frame - attack_end ) * decay_slope : 1;
+			const float release = release_slope > 0 && frame >= release_start ? ( num_frames - frame ) * release_slope : 1;
+			gain_block_[i] = attack * ( decay > sustain_level ? decay : sustain_level ) * release;
+		}
+	}
+
+public:
+	// start rendering a new wave; its samples are produced by renderBlock()
+	void begin( const _WaveDescriptor & wave )
+	{
+		wave_ = wave;
+		num_frames_ = frames_remaining_ = getNumFrames( wave );
+		phase_increment_ = wave.frequency / descriptor_.sample_rate_;
+		// the phase is given in degrees, as with ALUT; a continuous voice only takes it from its first wave
+		if ( !descriptor_.phase_continuous_ || !has_previous_wave_ )
+		{
+			phase_ = wave.phase / 360;
+			phase_ -= floor( phase_ );
+		}
+		has_previous_wave_ = true;
+
+		attack_frames_ = descriptor_.attack_ms_ * descriptor_.sample_rate_ / 1000;
+		decay_frames_ = descriptor_.decay_ms_ * descriptor_.sample_rate_ / 1000;
+		release_frames_ = descriptor_.release_ms_ * descriptor_.sample_rate_ / 1000;
+		if ( attack_frames_ + release_frames_ > num_frames_ )
+		{
+			const float shrink = num_frames_ / ( attack_frames_ + release_frames_ );
+			attack_frames_ *= shrink;
+			release_frames_ *= shrink;
+		}
+		if ( attack_frames_ + decay_frames_ + release_frames_ > num_frames_ ) decay_frames_ = num_frames_ - attack_frames_ - release_frames_;
+	}
+
+	// forget the phase of the previous wave; the next wave starts at its own phase
+	void reset()
+	{
+		has_previous_wave_ = false;
+		frames_remaining_ = 0;
+	}
+
+	// render up to max_frames samples of the current wave, already shaped by the envelope and scaled by the amplitude
+	// returns the number rendered (0 once the wave is finished); silent waves (type 2) render as zeros
+	unsigned int renderBlock( float * samples, unsigned int max_frames )
+	{
+		const unsigned int num_frames = frames_remaining_ < max_frames ? frames_remaining_ : max_frames;
+
+		if ( wave_.type != 1 )
+		{
+			memset( samples, 0, num_frames * sizeof( float ) );
+			frames_remaining_ -= num_frames;
+			return num_frames;
+		}
+
+		for ( unsigned int offset = 0; offset < num_frames; offset += BLOCK_SIZE )
+		{
+			const unsigned int block_size = num_frames - offset < BLOCK_SIZE ? num_frames - offset : BLOCK_SIZE;
+			oscillateBlock( block_size );
+			envelopeBlock( num_frames_ - frames_remaining_, block_size );
+
+			float * __restrict out = samples + offset;
+			const float amplitude = descriptor_.amplitude_;
+			for ( unsigned int i = 0; i < block_size; ++i )
+			{
+				out[i] = amplitude * oscillator_block_[i] * gain_block_[i];
+			}
+			frames_remaining_ -= block_size;
+		}
+		return num_frames;
+	}
+
+	// same as above, converted to 16-bit samples
+	unsigned int renderBlock( _SampleType * samples, unsigned int max_frames )
+	{
+		float block[BLOCK_SIZE];
+		unsigned int total_frames = 0, num_frames;
+		while ( total_frames < max_frames && ( num_frames = renderBlock( block, max_frames - total_frames < BLOCK_SIZE ? max_frames - total_frames : BLOCK_SIZE ) ) > 0 )
+		{
+			_SampleType * __restrict out = samples + total_frames;
+			for ( unsigned int i = 0; i < num_frames; ++i )
+			{
+				const float sample = block[i] > 1 ? 1 : block[i] < -1 ? -1 : block[i];
+				out[i] = (_SampleType) ( 32767 * sample );
+			}
+			total_frames += num_frames;
+		}
+		return total_frames;
+	}
+
+	unsigned int framesRemaining() const
+	{
+		return frames_remaining_;
+	}
+
+	// append the samples for one whole wave to the given buffer
+	unsigned int render( const _WaveDescriptor & wave, _SampleVector & samples )
+	{
+		begin( wave );
+		const unsigned int num_frames = frames_remaining_;
+		const size_t offset = samples.size();
+		{
+			MemoryScope memory_scope( MemorySubsystem::audio_buffers );
+			samples.resize( offset + num_frames );
+		}
+		if ( num_frames > 0 ) renderBlock( &samples[offset], num_frames );
+		return num_frames;
+	}
+};
+
+#endif /* WAVE_RENDERER_H_ */
@@ -0,0 +1,152 @@
+/*******************************************************************************
+ *
+ *      worker_pool
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// a fixed set of threads that run batches of indexed tasks; run() blocks until every task of the batch is done
+// the calling thread works on the batch too, so a pool of N threads keeps N + 1 cores busy; a pool of 0 threads runs everything
+// on the caller. tasks are handed out in index order, one at a time
+class WorkerPool
+{
+public:
+	typedef std::function<void( unsigned int task, unsigned int worker )> _Task;
+
+protected:
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable batch_ready_;
+	std::condition_variable batch_done_;
+
+	const _Task * task_;
+	unsigned int num_tasks_;
+	unsigned int next_task_;
+	unsigned int num_tasks_done_;
+	unsigned long long batch_;
+	bool stop_;
+
+public:
+	WorkerPool( unsigned int num_threads = 0 ) :
+		task_( NULL ), num_tasks_( 0 ), next_task_( 0 ), num_tasks_done_( 0 ), batch_( 0 ), stop_( false )
+	{
+		for ( unsigned int i = 0; i < num_threads; ++i )
+		{
+			threads_.push_back( std::thread( &WorkerPool::workerLoop, this, i + 1 ) );
+		}
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			stop_ = true;
+		}
+		batch_ready_.notify_all();
+		for ( unsigned int i = 0; i < threads_.size(); ++i )
+			threads_[i].join();
+	}
+
+	// number of distinct worker indices passed to tasks: the pool threads plus the caller (worker 0)
+	unsigned int numWorkers() const
+	{
+		return threads_.size() + 1;
+	}
+
+	void run( unsigned int num_tasks, const _Task & task )
+	{
+		if ( num_tasks == 0 ) return;
+		if ( threads_.empty() )
+		{
+			for ( unsigned int i = 0; i < num_tasks; ++i )
+				task( i, 0 );
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			task_ = &task;
+			num_tasks_ = num_tasks;
+			next_task_ = 0;
+			num_tasks_done_ = 0;
+			++batch_;
+		}
+		batch_ready_.notify_all();
+
+		work( 0 );
+
+		std::unique_lock<std::mutex> lock( mutex_ );
+		batch_done_.wait( lock, [this] { return num_tasks_done_ == num_tasks_; } );
+		task_ = NULL;
+	}
+
+protected:
+	// take tasks from the current batch until there are none left
+	void work( unsigned int worker )
+	{
+		std::unique_lock<std::mutex> lock( mutex_ );
+		while ( task_ && next_task_ < num_tasks_ )
+		{
+			const unsigned int task = next_task_++;
+			const _Task * current_task = task_;
+			lock.unlock();
+			( *current_task )( task, worker );
+			lock.lock();
+			if ( ++num_tasks_done_ == num_tasks_ ) batch_done_.notify_one();
+		}
+	}
+
+	void workerLoop( unsigned int worker )
+	{
+		unsigned long long last_batch = 0;
+		while ( true )
+		{
+			{
+				std::unique_lock<std::mutex> lock( mutex_ );
+				batch_ready_.wait( lock, [this, last_batch] { return stop_ || batch_ != last_batch; } );
+				if ( stop_ ) return;
+				last_batch = batch_;
+			}
+			work( worker );
+		}
+	}
+};
+
+#endif /* WORKER_POOL_H_ */
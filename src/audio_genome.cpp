@@ -35,4 +35,4 @@
 
 #include "../include/audio_genome.h"
 
-AudioGenomeDefs::WaveFSM AudioGenome::wave_fsm = AudioGenomeDefs::WaveFSM();
+AudioGenomeDefs::Timing AudioGenome::timing = AudioGenomeDefs::Timing();
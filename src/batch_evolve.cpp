@@ -0,0 +1,354 @@
+/*******************************************************************************
+ *
+ *      batch_evolve
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+
+#include "../include/genetic_process.h"
+#include "../include/audio_genome.h"
+#include "../include/genome_archive.h"
+#include "../include/memory_accounting.h"
+#include "../include/checkpoint.h"
+#include "../include/generation_history.h"
+#include "../include/genealogy.h"
+#include "../include/population_seeder.h"
+#include "../include/hall_of_fame.h"
+#include "../include/novelty_search.h"
+#include "../include/fitness_sharing.h"
+#include "../include/population_diversity.h"
+
+// headless batch evolution: runs the genetic process on AudioGenomes without touching any audio library
+
+typedef AudioGenome _Genome;
+typedef GeneticProcess<_Genome> _GeneticProcess;
+
+typedef AudioGenomeDefs::_SizeType _SizeType;
+typedef AudioGenomeDefs::_GenomeBase _GenomeBase;
+typedef typename _GenomeBase::_Chromosome _Chromosome;
+
+static void printUsage( const char * program_name )
+{
+	fprintf( stderr, "usage: %s [--population N] [--genome-size N] [--chromosome-size N] [--generations N] [--mutation-rate R] [--seed S] [--threads N] [--archive FILE] [--metrics FILE] [--metrics-format json|prometheus] [--trace FILE] [--log-level silent|quiet|normal|verbose]\n"
+			"       [--memory-report] [--alloc-budget N] [--alloc-warmup N] [--checkpoint FILE] [--checkpoint-every N] [--resume FILE] [--history FILE]\n"
+			"       [--genealogy FILE] [--keyframe-every N] [--warm-start ARCHIVE] [--warm-start-fraction F] [--warm-start-mutate] [--target-fitness F]\n"
+			"       [--hall-of-fame K] [--hall-of-fame-archive FILE] [--novelty K] [--novelty-archive N] [--fitness-weight W]\n"
+			"       [--sharing RADIUS] [--sharing-tables N] [--sharing-positions N] [--diversity] [--histogram N]\n", program_name );
+}
+
+int main( int argc, char **argv )
+{
+	_SizeType population_size = 10, genome_size = 4 * 16, chromosome_size = 1, num_generations = 100;
+	double mutation_rate = 0.05;
+	unsigned int num_threads = 0;
+	long rand_seed = time( NULL );
+	const char * archive_filename = NULL;
+	const char * metrics_filename = NULL;
+	const char * trace_filename = NULL;
+	const char * checkpoint_filename = NULL;
+	const char * resume_filename = NULL;
+	const char * history_filename = NULL;
+	const char * genealogy_filename = NULL;
+	unsigned int keyframe_interval = GenealogyDefs::DEFAULT_KEYFRAME_INTERVAL;
+	const char * warm_start_filename = NULL;
+	PopulationSeeder<_GeneticProcess>::Descriptor warm_start;
+	bool has_target_fitness = false;
+	unsigned int hall_of_fame_size = 0;
+	const char * hall_of_fame_filename = NULL;
+	double target_fitness = 0;
+	unsigned int novelty_k = 0;
+	NoveltySearch<_GeneticProcess>::Descriptor novelty;
+	FitnessSharing<_GeneticProcess>::Descriptor sharing( 0 );
+	bool measure_diversity = false;
+	unsigned int histogram_bins = 0;
+	unsigned long long checkpoint_interval = 0;
+	bool memory_report = false;
+	long long allocation_budget = -1;
+	unsigned long long allocation_warmup = 1;
+	ProcessMetrics::Format::_Storage metrics_format = ProcessMetrics::Format::json;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		const bool has_value = i + 1 < argc;
+		if ( has_value && strcmp( argv[i], "--population" ) == 0 ) population_size = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--genome-size" ) == 0 ) genome_size = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--chromosome-size" ) == 0 ) chromosome_size = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--generations" ) == 0 ) num_generations = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--mutation-rate" ) == 0 ) mutation_rate = atof( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--seed" ) == 0 ) rand_seed = atol( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--threads" ) == 0 ) num_threads = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--archive" ) == 0 ) archive_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--metrics" ) == 0 ) metrics_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--trace" ) == 0 ) trace_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--alloc-budget" ) == 0 ) allocation_budget = atoll( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--alloc-warmup" ) == 0 ) allocation_warmup = strtoull( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--checkpoint" ) == 0 ) checkpoint_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--checkpoint-every" ) == 0 ) checkpoint_interval = strtoull( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--resume" ) == 0 ) resume_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--history" ) == 0 ) history_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--genealogy" ) == 0 ) genealogy_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--keyframe-every" ) == 0 ) keyframe_interval = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--warm-start" ) == 0 ) warm_start_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--warm-start-fraction" ) == 0 ) warm_start.fraction_ = atof( argv[++i] );
+		else if ( strcmp( argv[i], "--warm-start-mutate" ) == 0 ) warm_start.mutate_ = true;
+		else if ( has_value && strcmp( argv[i], "--target-fitness" ) == 0 ) target_fitness = atof( argv[++i] ), has_target_fitness = true;
+		else if ( has_value && strcmp( argv[i], "--hall-of-fame" ) == 0 ) hall_of_fame_size = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--hall-of-fame-archive" ) == 0 ) hall_of_fame_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--novelty" ) == 0 ) novelty_k = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--novelty-archive" ) == 0 ) novelty.max_archive_size_ = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--fitness-weight" ) == 0 ) novelty.fitness_weight_ = atof( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--sharing" ) == 0 ) sharing.radius_ = atof( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--sharing-tables" ) == 0 ) sharing.num_tables_ = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--sharing-positions" ) == 0 ) sharing.positions_per_table_ = strtoul( argv[++i], NULL, 10 );
+		else if ( strcmp( argv[i], "--diversity" ) == 0 ) measure_diversity = true;
+		else if ( has_value && strcmp( argv[i], "--histogram" ) == 0 ) histogram_bins = strtoul( argv[++i], NULL, 10 );
+		else if ( strcmp( argv[i], "--memory-report" ) == 0 ) memory_report = true;
+		else if ( has_value && strcmp( argv[i], "--log-level" ) == 0 && flags::io::debug::parseLevel( argv[i + 1] ) >= 0 ) flags::io::debug::setLevel( flags::io::debug::parseLevel( argv[++i] ) );
+		else if ( has_value && strcmp( argv[i], "--metrics-format" ) == 0 && strcmp( argv[i + 1], "json" ) == 0 ) metrics_format = ProcessMetrics::Format::json, ++i;
+		else if ( has_value && strcmp( argv[i], "--metrics-format" ) == 0 && strcmp( argv[i + 1], "prometheus" ) == 0 ) metrics_format = ProcessMetrics::Format::prometheus, ++i;
+		else
+		{
+			printUsage( argv[0] );
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ( population_size < 2 || genome_size < 1 || chromosome_size < 1 )
+	{
+		printUsage( argv[0] );
+		return EXIT_FAILURE;
+	}
+
+	// a resumed run takes its parameters from the checkpoint; only the thread count can be overridden
+	CheckpointReader<_GeneticProcess> resume_checkpoint;
+	if ( resume_filename && !resume_checkpoint.open( resume_filename ) )
+	{
+		fprintf( stderr, "Failed to open checkpoint %s\n", resume_filename );
+		return EXIT_FAILURE;
+	}
+
+	_GeneticProcess::Descriptor descriptor = resume_checkpoint.isOpen() ? resume_checkpoint.descriptor() : _GeneticProcess::Descriptor( population_size, mutation_rate, rand_seed,
+			_Genome::Descriptor( genome_size, _Chromosome::Descriptor( chromosome_size ) ) );
+	if ( num_threads > 0 ) descriptor.num_threads_ = num_threads;
+	rand_seed = descriptor.random_seed_;
+
+	// steady-state generations (after the warmup) that allocate more than the budget fail the run
+	MemoryAccounting::instance().setBudget( allocation_budget, allocation_warmup );
+
+	_GeneticProcess process( descriptor );
+
+	// the best individuals of the whole run, not just of the last generation
+	if ( hall_of_fame_filename && hall_of_fame_size == 0 ) hall_of_fame_size = 10;
+	HallOfFame<_GeneticProcess> hall_of_fame( HallOfFame<_GeneticProcess>::Descriptor( hall_of_fame_size ), descriptor.genome_descriptor_ );
+	if ( hall_of_fame_size > 0 ) process.addEvaluationListener( &hall_of_fame );
+
+	// novelty search replaces (or, with a fitness weight, blends into) the fitness selection sees
+	if ( novelty_k > 0 ) novelty.k_ = novelty_k;
+	novelty.num_threads_ = descriptor.num_threads_;
+	NoveltySearch<_GeneticProcess> novelty_search( novelty );
+	if ( novelty_k > 0 ) process.addEvaluationListener( &novelty_search );
+
+	// niching: similar genomes share their fitness, so several species can survive
+	sharing.num_threads_ = descriptor.num_threads_;
+	sharing.random_seed_ = rand_seed;
+	FitnessSharing<_GeneticProcess> fitness_sharing( sharing );
+	if ( sharing.radius_ > 0 ) process.addEvaluationListener( &fitness_sharing );
+
+	// convergence, measured after every evaluation (logged at the normal level)
+	PopulationDiversity<_GeneticProcess> diversity( PopulationDiversity<_GeneticProcess>::Descriptor( descriptor.num_threads_ ) );
+	if ( measure_diversity ) process.addEvaluationListener( &diversity );
+
+	if ( metrics_filename && !process.metrics().openDump( metrics_filename, metrics_format ) )
+	{
+		fprintf( stderr, "Failed to open metrics file %s\n", metrics_filename );
+		return EXIT_FAILURE;
+	}
+
+	if ( trace_filename && !TraceLog::instance().start( trace_filename ) )
+	{
+		fprintf( stderr, "Failed to open trace file %s\n", trace_filename );
+		return EXIT_FAILURE;
+	}
+	TraceLog::instance().setThreadName( "genetic process" );
+
+	const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+	if ( resume_checkpoint.isOpen() )
+	{
+		resume_checkpoint.restore( process, descriptor.num_threads_ - 1 );
+		resume_checkpoint.close();
+		__DEBUG__QUIET__ logPrintf( "Resumed from %s at generation %llu\n", resume_filename, process.generation() );
+	}
+	else if ( warm_start_filename )
+	{
+		GenomeArchiveReader<_Genome> warm_start_archive;
+		if ( !warm_start_archive.open( warm_start_filename ) )
+		{
+			fprintf( stderr, "Failed to open archive %s\n", warm_start_filename );
+			return EXIT_FAILURE;
+		}
+		if ( !PopulationSeeder<_GeneticProcess>( warm_start ).seed( process, warm_start_archive ) ) return EXIT_FAILURE;
+	}
+	else process.initializePopulation();
+
+	// time to acceptable fitness: the first generation whose best individual reaches the target
+	long long target_generation = -1;
+	double target_seconds = 0;
+	if ( has_target_fitness && process.populationStatistics().max_fitness_ >= target_fitness )
+	{
+		target_generation = process.generation();
+		target_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start_time ).count();
+	}
+
+	// every generation (starting with the initial one) goes to the history log; a resumed run continues the log from its
+	// checkpoint instead of starting it over
+	GenerationHistoryWriter<_GeneticProcess> history;
+	const bool history_opened = !history_filename || ( resume_filename ? history.resume( history_filename, descriptor.genome_descriptor_, process.generation() )
+			: history.open( history_filename, descriptor.genome_descriptor_ ) );
+	if ( !history_opened )
+	{
+		fprintf( stderr, "Failed to open history %s\n", history_filename );
+		return EXIT_FAILURE;
+	}
+	if ( history_filename && !history.endsAt( process.generation() ) ) history.append( process );
+
+	// and to the genealogy, as deltas against the generation before (a resumed run picks up again with a keyframe of the
+	// checkpoint's generation)
+	GenealogyWriter<_GeneticProcess> genealogy;
+	const bool genealogy_opened = !genealogy_filename || ( resume_filename ? genealogy.resume( genealogy_filename, descriptor.genome_descriptor_, process.generation(),
+			keyframe_interval ) : genealogy.open( genealogy_filename, descriptor.genome_descriptor_, keyframe_interval ) );
+	if ( !genealogy_opened )
+	{
+		fprintf( stderr, "Failed to open genealogy %s\n", genealogy_filename );
+		return EXIT_FAILURE;
+	}
+	if ( genealogy_filename ) genealogy.append( process );
+
+	// checkpoints are written in the background while the next generations run
+	CheckpointWriter<_GeneticProcess> checkpoint;
+	while ( process.generation() < num_generations )
+	{
+		process.step();
+		if ( has_target_fitness && target_generation < 0 && process.populationStatistics().max_fitness_ >= target_fitness )
+		{
+			target_generation = process.generation();
+			target_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start_time ).count();
+		}
+		if ( history_filename ) history.append( process );
+		if ( genealogy_filename && !genealogy.append( process ) )
+		{
+			fprintf( stderr, "Failed to write genealogy %s\n", genealogy_filename );
+			return EXIT_FAILURE;
+		}
+		if ( checkpoint_filename && checkpoint_interval > 0 && process.generation() % checkpoint_interval == 0 ) checkpoint.write( process, checkpoint_filename );
+	}
+	if ( checkpoint_filename ) checkpoint.write( process, checkpoint_filename );
+	if ( !checkpoint.wait() || !history.close() ) return EXIT_FAILURE;
+
+	process.evaluatePopulation();
+	TraceLog::instance().stop();
+	process.printPopulation();
+
+	const _GeneticProcess::PopulationStatistics & stats = process.populationStatistics();
+	// store the final population, best first, for offline rendering
+	if ( archive_filename )
+	{
+		_GeneticProcess::_PopulationVector sorted_population = process.population();
+		std::sort( sorted_population.begin(), sorted_population.end(), _Genome::compare );
+
+		GenomeArchiveWriter<_Genome> archive;
+		if ( !archive.open( archive_filename, descriptor.genome_descriptor_ ) )
+		{
+			fprintf( stderr, "Failed to open archive %s\n", archive_filename );
+			return EXIT_FAILURE;
+		}
+		for ( _GeneticProcess::_PopulationIterator it = sorted_population.begin(); it != sorted_population.end(); ++it )
+		{
+			archive.write( *it );
+		}
+		archive.close();
+	}
+
+	HallOfFame<_GeneticProcess>::_SnapshotPtr hall_of_fame_snapshot = hall_of_fame.snapshot();
+	if ( hall_of_fame_filename )
+	{
+		GenomeArchiveWriter<_Genome> archive;
+		if ( !archive.open( hall_of_fame_filename, descriptor.genome_descriptor_ ) )
+		{
+			fprintf( stderr, "Failed to open archive %s\n", hall_of_fame_filename );
+			return EXIT_FAILURE;
+		}
+		for ( size_t i = 0; i < hall_of_fame_snapshot->entries_.size(); ++i )
+		{
+			archive.write( &hall_of_fame_snapshot->entries_[i].genes_[0], hall_of_fame_snapshot->entries_[i].fitness_ );
+		}
+		archive.close();
+	}
+
+	// the population and anything else logged must land before the summary
+	AsyncLog::instance().flush();
+	process.metrics().print( stdout );
+	if ( memory_report || allocation_budget >= 0 ) MemoryAccounting::instance().print( stdout );
+	for ( size_t i = 0; i < hall_of_fame_snapshot->entries_.size(); ++i )
+	{
+		printf( "hall of fame %zu: fitness %f from generation %llu (%016llx)\n", i + 1, hall_of_fame_snapshot->entries_[i].fitness_, hall_of_fame_snapshot->entries_[i].generation_,
+				hall_of_fame_snapshot->entries_[i].hash_ );
+	}
+	if ( has_target_fitness && target_generation >= 0 ) printf( "target fitness %f reached at generation %lld after %.3f s\n", target_fitness, target_generation, target_seconds );
+	else if ( has_target_fitness ) printf( "target fitness %f not reached\n", target_fitness );
+	if ( novelty_k > 0 ) printf( "novelty: archive %u behaviours, mean novelty %f\n", novelty_search.archiveSize(), novelty_search.meanNovelty() );
+	if ( sharing.radius_ > 0 ) printf( "fitness sharing: mean niche count %f, %llu genome comparisons\n", fitness_sharing.meanNicheCount(), fitness_sharing.distanceEvaluations() );
+	if ( measure_diversity ) printf( "diversity: %u unique genomes, mean distance %f genes (%f from the best), entropy %f bits, %f alleles per position\n",
+			diversity.statistics().unique_genomes_, diversity.statistics().mean_distance_, diversity.statistics().mean_distance_to_best_, diversity.statistics().mean_entropy_,
+			diversity.statistics().mean_alleles_ );
+	if ( genealogy_filename ) printf( "genealogy: %llu generations, %llu bytes (%.1f%% of full genomes)\n", genealogy.numGenerations(), genealogy.dataBytes(),
+			genealogy.rawBytes() > 0 ? 100.0 * genealogy.dataBytes() / genealogy.rawBytes() : 0.0 );
+	printf( "fitness quantiles: p10 %f p50 %f p90 %f p99 %f\n", stats.p10_fitness_, stats.p50_fitness_, stats.p90_fitness_, stats.p99_fitness_ );
+	if ( histogram_bins > 0 )
+	{
+		std::vector<unsigned long long> bins;
+		const QuantileSketch & sketch = process.fitnessSketch();
+		sketch.histogram( histogram_bins, bins );
+		const double bin_width = ( sketch.max() - sketch.min() ) / histogram_bins;
+		for ( unsigned int i = 0; i < histogram_bins; ++i )
+		{
+			printf( "fitness histogram [%f, %f): %llu\n", sketch.min() + i * bin_width, sketch.min() + ( i + 1 ) * bin_width, bins[i] );
+		}
+	}
+	printf( "seed: %li generations: %u min: %f max: %f avg: %f\n", rand_seed, num_generations, stats.min_fitness_, stats.max_fitness_, stats.avg_fitness_ );
+
+	return MemoryAccounting::instance().numViolations() > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,475 @@
+/*******************************************************************************
+ *
+ *      benchmark_operators
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../include/genetic_process.h"
+#include "../include/audio_genome.h"
+#include "../include/memory_accounting.h"
+#include "../include/vp_tree.h"
+#include "../include/fitness_sharing.h"
+#include "../include/population_diversity.h"
+#include "../include/quantile_sketch.h"
+
+// microbenchmarks for the genetic operators and the AudioGenome decode
+// every benchmark runs its operation in batches until the minimum time has passed and reports the time and heap allocations per
+// operation plus a throughput in the unit that matters for it (genes, individuals or draws per second)
+// objects created by an operation are freed between batches, outside of the timed region
+
+typedef AudioGenome _Genome;
+typedef _Genome * _GenomePtr;
+typedef GeneticProcess<_Genome> _GeneticProcess;
+
+typedef AudioGenomeDefs::_SizeType _SizeType;
+typedef AudioGenomeDefs::_GenomeBase _GenomeBase;
+typedef typename _GenomeBase::_Chromosome _Chromosome;
+typedef _Chromosome * _ChromosomePtr;
+
+// heap allocations are counted by src/memory_accounting.cpp, which this tool is linked with
+static unsigned long long numAllocations()
+{
+	return MemoryAccounting::instance().total().allocations_.load( std::memory_order_relaxed );
+}
+
+struct BenchmarkOptions
+{
+	double min_time_ns_;
+	unsigned int batch_size_;
+	const char * filter_;
+	bool csv_;
+
+	BenchmarkOptions() :
+		min_time_ns_( 2e8 ), batch_size_( 64 ), filter_( NULL ), csv_( false )
+	{
+		//
+	}
+};
+
+static BenchmarkOptions options;
+
+static void printHeader()
+{
+	if ( options.csv_ ) printf( "benchmark,parameters,ops,ns_per_op,allocs_per_op,throughput,throughput_unit\n" );
+	else printf( "%-34s %-24s %10s %14s %14s %16s\n", "benchmark", "parameters", "ops", "ns/op", "allocs/op", "throughput" );
+}
+
+// operation() is timed; cleanup() runs after every batch and isn't
+template<class _Operation, class _Cleanup>
+static void runBenchmark( const std::string & name, const std::string & parameters, double items_per_op, const char * item_unit, _Operation operation, _Cleanup cleanup )
+{
+	if ( options.filter_ && name.find( options.filter_ ) == std::string::npos ) return;
+
+	unsigned long long num_ops = 0, total_ns = 0, total_allocations = 0;
+	while ( total_ns < options.min_time_ns_ )
+	{
+		const unsigned long long allocations_before = numAllocations();
+		const unsigned long long start_ns = ProcessMetricsUtil::nowNs();
+		for ( unsigned int i = 0; i < options.batch_size_; ++i )
+			operation( i );
+		total_ns += ProcessMetricsUtil::nowNs() - start_ns;
+		total_allocations += numAllocations() - allocations_before;
+		num_ops += options.batch_size_;
+		cleanup();
+	}
+
+	const double ns_per_op = (double) total_ns / num_ops;
+	const double allocations_per_op = (double) total_allocations / num_ops;
+	const double throughput = items_per_op * 1e9 / ns_per_op;
+	if ( options.csv_ ) printf( "%s,%s,%llu,%.1f,%.2f,%.0f,%s/s\n", name.c_str(), parameters.c_str(), num_ops, ns_per_op, allocations_per_op, throughput, item_unit );
+	else printf( "%-34s %-24s %10llu %14.1f %14.2f %12.3g %s/s\n", name.c_str(), parameters.c_str(), num_ops, ns_per_op, allocations_per_op, throughput, item_unit );
+	fflush( stdout );
+}
+
+static std::string formatParameters( const char * format, unsigned int a, unsigned int b = 0 )
+{
+	char text[64];
+	snprintf( text, sizeof( text ), format, a, b );
+	return text;
+}
+
+static _Genome::Descriptor genomeDescriptor( _SizeType genome_size, _SizeType chromosome_size )
+{
+	return _Genome::Descriptor( genome_size, _Chromosome::Descriptor( chromosome_size ) );
+}
+
+static _GenomePtr createRandomGenome( _SizeType genome_size, _SizeType chromosome_size )
+{
+	_GenomePtr genome = new _Genome( genomeDescriptor( genome_size, chromosome_size ) );
+	genome->randomize();
+	return genome;
+}
+
+template<class _Pointer>
+static void deleteAll( std::vector<_Pointer> & objects )
+{
+	for ( unsigned int i = 0; i < objects.size(); ++i )
+	{
+		delete objects[i];
+		objects[i] = NULL;
+	}
+}
+
+static void benchmarkChromosomeCopy( _SizeType chromosome_size )
+{
+	_GenomePtr genome = createRandomGenome( 1, chromosome_size );
+	_ChromosomePtr chromosome = genome->chromosomes()[0];
+	std::vector<_ChromosomePtr> copies( options.batch_size_ );
+
+	runBenchmark( "Chromosome::copy", formatParameters( "genes=%u", chromosome_size ), chromosome_size, "genes", [&]( unsigned int i )
+	{	copies[i] = chromosome->copy();}, [&]()
+	{	deleteAll( copies );} );
+
+	delete genome;
+}
+
+static void benchmarkGenomeCopy( _SizeType genome_size, _SizeType chromosome_size )
+{
+	_GenomePtr genome = createRandomGenome( genome_size, chromosome_size );
+	std::vector<_GenomePtr> copies( options.batch_size_ );
+
+	runBenchmark( "Genome::copy", formatParameters( "length=%u chromosome=%u", genome_size, chromosome_size ), genome_size * chromosome_size, "genes", [&]( unsigned int i )
+	{	copies[i] = genome->copy();}, [&]()
+	{	deleteAll( copies );} );
+
+	delete genome;
+}
+
+static void benchmarkMutate( _SizeType genome_size, _SizeType chromosome_size )
+{
+	_GenomePtr genome = createRandomGenome( genome_size, chromosome_size );
+
+	runBenchmark( "Genome::mutate", formatParameters( "length=%u chromosome=%u", genome_size, chromosome_size ), genome_size * chromosome_size, "genes", [&]( unsigned int )
+	{	genome->mutate( 0.05 );}, []()
+	{} );
+
+	delete genome;
+}
+
+static void benchmarkWaveFSMUpdate( unsigned int num_genes )
+{
+	_GenomePtr genome = createRandomGenome( 1, num_genes );
+	_Chromosome & chromosome = *genome->chromosomes()[0];
+	AudioGenomeDefs::WaveFSM fsm;
+	// keeps the updates from being optimised away
+	volatile int sink = 0;
+
+	runBenchmark( "WaveFSM::update", formatParameters( "genes=%u", num_genes ), num_genes, "genes", [&]( unsigned int )
+	{
+		int result = 0;
+		for ( typename _Chromosome::_GeneIterator it = chromosome.begin(); it != chromosome.end(); ++it )
+			result += fsm.update( ( *it )->data_ );
+		sink = result;
+	}, []()
+	{} );
+
+	delete genome;
+}
+
+static void benchmarkCalculateFitness( _SizeType genome_size, _SizeType chromosome_size )
+{
+	_GenomePtr genome = createRandomGenome( genome_size, chromosome_size );
+
+	runBenchmark( "AudioGenome::calculateFitness", formatParameters( "length=%u chromosome=%u", genome_size, chromosome_size ), genome_size * chromosome_size, "genes", [&]( unsigned int )
+	{	genome->calculateFitness();}, []()
+	{} );
+
+	delete genome;
+}
+
+// a process with an evaluated random population, ready for selection and crossover
+static _GeneticProcess * createProcess( _SizeType population_size, _SizeType genome_size, _SizeType chromosome_size )
+{
+	_GeneticProcess * process = new _GeneticProcess( _GeneticProcess::Descriptor( population_size, 0.05, 1, genomeDescriptor( genome_size, chromosome_size ) ) );
+	process->initializePopulation();
+	return process;
+}
+
+static void benchmarkCrossover( _SizeType genome_size, _SizeType chromosome_size )
+{
+	_GeneticProcess * process = createProcess( 2, genome_size, chromosome_size );
+	const _GeneticProcess::_GeneticPair parents( process->population()[0], process->population()[1] );
+	std::vector<_GenomePtr> children( 2 * options.batch_size_ );
+
+	runBenchmark( "GeneticProcess::crossover", formatParameters( "length=%u chromosome=%u", genome_size, chromosome_size ), 2, "children", [&]( unsigned int i )
+	{
+		const _GeneticProcess::_Family family = process->crossover( parents );
+		children[2 * i] = family.children_.first;
+		children[2 * i + 1] = family.children_.second;
+	}, [&]()
+	{	deleteAll( children );} );
+
+	delete process;
+}
+
+static void benchmarkRouletteSelect( _SizeType population_size )
+{
+	_GeneticProcess * process = createProcess( population_size, 16, 1 );
+
+	runBenchmark( "GeneticProcess::rouletteSelect", formatParameters( "population=%u", population_size ), 1, "draws", [&]( unsigned int )
+	{	process->rouletteSelect();}, []()
+	{} );
+
+	delete process;
+}
+
+static void benchmarkSelectBestParents( _SizeType population_size )
+{
+	_GeneticProcess * process = createProcess( population_size, 16, 1 );
+
+	runBenchmark( "GeneticProcess::selectBestParents", formatParameters( "population=%u", population_size ), population_size, "individuals", [&]( unsigned int )
+	{	process->selectBestParents();}, []()
+	{} );
+
+	delete process;
+}
+
+// k-nearest-neighbour queries over an archive of behaviours, as novelty search makes them: indexed and brute force
+static void benchmarkNoveltyQuery( unsigned int archive_size, unsigned int k )
+{
+	const unsigned int dimension = _Genome::BEHAVIOUR_SIZE;
+	const unsigned int num_queries = 256;
+
+	// behaviours of random genomes, so the points are distributed like real ones
+	std::vector<float> behaviours( (size_t) ( archive_size + num_queries ) * dimension );
+	for ( unsigned int i = 0; i < archive_size + num_queries; ++i )
+	{
+		_GenomePtr genome = createRandomGenome( 64, 1 );
+		AudioGenomeDefs::WaveFSM fsm;
+		genome->decode( fsm );
+		genome->behaviour( &behaviours[(size_t) i * dimension] );
+		delete genome;
+	}
+	const float * queries = &behaviours[(size_t) archive_size * dimension];
+
+	VpTree tree( dimension );
+	tree.build( &behaviours[0], archive_size );
+	std::vector<VpTree::_Neighbour> neighbours;
+	neighbours.reserve( k );
+
+	runBenchmark( "VpTree::search", formatParameters( "archive=%u k=%u", archive_size, k ), 1, "queries", [&]( unsigned int i )
+	{
+		neighbours.clear();
+		tree.search( &queries[( i % num_queries ) * dimension], k, neighbours );
+	}, []()
+	{} );
+
+	runBenchmark( "brute force kNN", formatParameters( "archive=%u k=%u", archive_size, k ), 1, "queries", [&]( unsigned int i )
+	{
+		neighbours.clear();
+		const float * query = &queries[( i % num_queries ) * dimension];
+		for ( unsigned int j = 0; j < archive_size; ++j )
+			VpTree::offer( neighbours, k, VpTree::squaredDistance( query, &behaviours[(size_t) j * dimension], dimension ), j );
+	}, []()
+	{} );
+}
+
+// fitness sharing over a population of num_species random genomes, each copied with a tenth of its genes swapped for another
+// species' (num_species = 0 leaves the population random): bucketed and every pair compared
+static void benchmarkFitnessSharing( _SizeType population_size, unsigned int num_species )
+{
+	const _SizeType genome_size = 64;
+	_GeneticProcess * process = createProcess( population_size, genome_size, 1 );
+	_GeneticProcess::_PopulationVector & population = process->population();
+
+	if ( num_species > 0 )
+	{
+		std::vector<_GeneticProcess::_DataType> species( (size_t) num_species * genome_size ), genes( genome_size );
+		for ( unsigned int i = 0; i < num_species; ++i )
+		{
+			GenomeArchiveDefs::packGenome( population[i], &species[(size_t) i * genome_size] );
+		}
+		for ( _SizeType i = 0; i < population_size; ++i )
+		{
+			const unsigned int parent = i % num_species;
+			for ( _SizeType j = 0; j < genome_size; ++j )
+			{
+				const unsigned int source = GeneticProcessUtil::irand() % 10 == 0 ? GeneticProcessUtil::irand() % num_species : parent;
+				genes[j] = species[(size_t) source * genome_size + j];
+			}
+			const _GeneticProcess::_FitnessType fitness = population[i]->fitness();
+			delete population[i];
+			population[i] = GenomeArchiveDefs::unpackGenome<_Genome>( genomeDescriptor( genome_size, 1 ), &genes[0] );
+			population[i]->setFitness( fitness );
+		}
+	}
+
+	std::vector<_GeneticProcess::_FitnessType> fitness( population_size );
+	for ( _SizeType i = 0; i < population_size; ++i )
+	{
+		fitness[i] = population[i]->fitness();
+	}
+
+	const char * format = num_species > 0 ? "population=%u species=%u" : "population=%u random";
+	FitnessSharing<_GeneticProcess> lsh_sharing;
+	FitnessSharing<_GeneticProcess> exact_sharing( FitnessSharing<_GeneticProcess>::Descriptor( 0.25, 1, 0 ) );
+	FitnessSharing<_GeneticProcess> * sharings[] = { &lsh_sharing, &exact_sharing };
+	const char * names[] = { "FitnessSharing LSH", "FitnessSharing exact" };
+	for ( unsigned int s = 0; s < 2; ++s )
+	{
+		runBenchmark( names[s], formatParameters( format, population_size, num_species ), population_size, "individuals", [&]( unsigned int )
+		{
+			for ( _SizeType i = 0; i < population_size; ++i )
+				population[i]->setFitness( fitness[i] );
+			sharings[s]->adjustFitness( *process );
+		}, []()
+		{} );
+	}
+	printf( "# niche count: LSH %f exact %f, comparisons per individual: LSH %.1f exact %.1f\n", lsh_sharing.meanNicheCount(), exact_sharing.meanNicheCount(),
+			(double) lsh_sharing.distanceEvaluations() / population_size, (double) exact_sharing.distanceEvaluations() / population_size );
+
+	delete process;
+}
+
+static void benchmarkPopulationDiversity( _SizeType population_size )
+{
+	_GeneticProcess * process = createProcess( population_size, 64, 1 );
+	PopulationDiversity<_GeneticProcess> diversity;
+
+	runBenchmark( "PopulationDiversity::measure", formatParameters( "population=%u length=%u", population_size, 64 ), population_size, "individuals", [&]( unsigned int )
+	{	diversity.measure( *process );}, []()
+	{} );
+
+	delete process;
+}
+
+// the fitness quantiles of a population as evaluatePopulation() gets them, a sketch per chunk merged in order, against
+// sorting a copy of the fitness values
+static void benchmarkFitnessQuantiles( _SizeType population_size )
+{
+	const unsigned int num_chunks = 16;
+	std::vector<double> fitness( population_size );
+	for ( _SizeType i = 0; i < population_size; ++i )
+		fitness[i] = ( rand() % 2000 ) - 1500 + rand() / (double) RAND_MAX;
+
+	std::vector<QuantileSketch> chunk_sketches( num_chunks );
+	QuantileSketch sketch;
+	std::vector<double> sorted;
+	// keeps the quantiles from being optimised away
+	volatile double sink = 0;
+
+	runBenchmark( "QuantileSketch add+merge", formatParameters( "population=%u chunks=%u", population_size, num_chunks ), population_size, "individuals", [&]( unsigned int )
+	{
+		sketch.clear();
+		const size_t chunk_size = ( population_size + num_chunks - 1 ) / num_chunks;
+		for ( unsigned int chunk = 0; chunk < num_chunks; ++chunk )
+		{
+			chunk_sketches[chunk].clear();
+			for ( size_t i = chunk * chunk_size; i < std::min<size_t>( ( chunk + 1 ) * chunk_size, population_size ); ++i )
+				chunk_sketches[chunk].add( fitness[i] );
+			sketch.merge( chunk_sketches[chunk] );
+		}
+		sink = sketch.quantile( 0.1 ) + sketch.quantile( 0.5 ) + sketch.quantile( 0.9 ) + sketch.quantile( 0.99 );
+	}, []()
+	{} );
+
+	runBenchmark( "sorted quantiles", formatParameters( "population=%u", population_size ), population_size, "individuals", [&]( unsigned int )
+	{
+		sorted.assign( fitness.begin(), fitness.end() );
+		std::sort( sorted.begin(), sorted.end() );
+		sink = sorted[( population_size - 1 ) / 10] + sorted[( population_size - 1 ) / 2] + sorted[( population_size - 1 ) * 9 / 10] + sorted[( population_size - 1 ) * 99 / 100];
+	}, []()
+	{} );
+}
+
+static void printUsage( const char * program_name )
+{
+	fprintf( stderr, "usage: %s [--min-time-ms N] [--batch N] [--filter SUBSTRING] [--csv]\n", program_name );
+}
+
+int main( int argc, char **argv )
+{
+	for ( int i = 1; i < argc; ++i )
+	{
+		const bool has_value = i + 1 < argc;
+		if ( has_value && strcmp( argv[i], "--min-time-ms" ) == 0 ) options.min_time_ns_ = 1e6 * atof( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--batch" ) == 0 ) options.batch_size_ = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--filter" ) == 0 ) options.filter_ = argv[++i];
+		else if ( strcmp( argv[i], "--csv" ) == 0 ) options.csv_ = true;
+		else
+		{
+			printUsage( argv[0] );
+			return EXIT_FAILURE;
+		}
+	}
+	if ( options.batch_size_ == 0 ) options.batch_size_ = 1;
+
+	// keep the operators' own output out of the measurements
+	flags::io::debug::setLevel( flags::io::debug::SILENT );
+	GeneticProcessUtil::seedRandom( 1 );
+
+	const _SizeType genome_sizes[] = { 16, 64, 256, 1024 };
+	const _SizeType population_sizes[] = { 10, 100, 1000, 10000 };
+
+	printHeader();
+
+	for ( unsigned int i = 0; i < 4; ++i )
+		benchmarkChromosomeCopy( genome_sizes[i] );
+	for ( unsigned int i = 0; i < 4; ++i )
+		benchmarkGenomeCopy( genome_sizes[i], 1 );
+	benchmarkGenomeCopy( 16, 16 );
+	for ( unsigned int i = 0; i < 4; ++i )
+		benchmarkCrossover( genome_sizes[i], 1 );
+	for ( unsigned int i = 0; i < 4; ++i )
+		benchmarkMutate( genome_sizes[i], 1 );
+	for ( unsigned int i = 0; i < 4; ++i )
+		benchmarkRouletteSelect( population_sizes[i] );
+	for ( unsigned int i = 0; i < 4; ++i )
+		benchmarkSelectBestParents( population_sizes[i] );
+	for ( unsigned int i = 0; i < 4; ++i )
+		benchmarkPopulationDiversity( population_sizes[i] );
+	for ( unsigned int i = 0; i < 4; ++i )
+		benchmarkFitnessQuantiles( population_sizes[i] );
+	for ( unsigned int i = 0; i < 4; ++i )
+		benchmarkWaveFSMUpdate( genome_sizes[i] );
+	for ( unsigned int i = 0; i < 4; ++i )
+		benchmarkCalculateFitness( genome_sizes[i], 1 );
+
+	const unsigned int archive_sizes[] = { 1000, 10000, 100000 };
+	for ( unsigned int i = 0; i < 3; ++i )
+		if ( !options.filter_ || strstr( "VpTree::search brute force kNN", options.filter_ ) ) benchmarkNoveltyQuery( archive_sizes[i], 15 );
+
+	const _SizeType sharing_population_sizes[] = { 1000, 10000 };
+	for ( unsigned int i = 0; i < 2; ++i )
+	{
+		if ( options.filter_ && !strstr( "FitnessSharing LSH exact", options.filter_ ) ) continue;
+		benchmarkFitnessSharing( sharing_population_sizes[i], 0 );
+		benchmarkFitnessSharing( sharing_population_sizes[i], 20 );
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+/*******************************************************************************
+ *
+ *      memory_accounting
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+#include <stdlib.h>
+#include <new>
+
+#include "../include/memory_accounting.h"
+
+// replacement global operator new/delete that feed MemoryAccounting; link this file into a program to account its heap
+// every block carries a small header with its size and the subsystem it was charged to, so frees are charged back correctly
+
+namespace
+{
+	// keeps the user block aligned for any fundamental type
+	struct alignas( alignof( max_align_t ) ) AllocationHeader
+	{
+		size_t size_;
+		MemorySubsystem::_Storage subsystem_;
+	};
+
+	struct EnableMemoryAccounting
+	{
+		EnableMemoryAccounting()
+		{
+			MemoryAccounting::instance().setEnabled( true );
+		}
+	} enable_memory_accounting;
+
+	void * allocate( size_t size )
+	{
+		AllocationHeader * header = (AllocationHeader *) malloc( sizeof(AllocationHeader) + size );
+		if ( !header ) return NULL;
+		header->size_ = size;
+		header->subsystem_ = MemoryAccounting::currentSubsystem();
+		MemoryAccounting::instance().allocated( header->subsystem_, size );
+		return header + 1;
+	}
+
+	void deallocate( void * pointer )
+	{
+		if ( !pointer ) return;
+		AllocationHeader * header = (AllocationHeader *) pointer - 1;
+		MemoryAccounting::instance().deallocated( header->subsystem_, header->size_ );
+		free( header );
+	}
+}
+
+void * operator new( size_t size )
+{
+	void * pointer = allocate( size );
+	if ( !pointer ) throw std::bad_alloc();
+	return pointer;
+}
+
+void * operator new[]( size_t size )
+{
+	void * pointer = allocate( size );
+	if ( !pointer ) throw std::bad_alloc();
+	return pointer;
+}
+
+void * operator new( size_t size, const std::nothrow_t & ) noexcept
+{
+	return allocate( size );
+}
+
+void * operator new[]( size_t size, const std::nothrow_t & ) noexcept
+{
+	return allocate( size );
+}
+
+void operator delete( void * pointer ) noexcept
+{
+	deallocate( pointer );
+}
+
+void operator delete[]( void * pointer ) noexcept
+{
+	deallocate( pointer );
+}
+
+void operator delete( void * pointer, size_t ) noexcept
+{
+	deallocate( pointer );
+}
+
+void operator delete[]( void * pointer, size_t ) noexcept
+{
+	deallocate( pointer );
+}
+
+void operator delete( void * pointer, const std::nothrow_t & ) noexcept
+{
+	deallocate( pointer );
+}
+
+void operator delete[]( void * pointer, const std::nothrow_t & ) noexcept
+{
+	deallocate( pointer );
+}
@@ -0,0 +1,209 @@
+/*******************************************************************************
+ *
+ *      render_genomes
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "../include/audio_genome.h"
+#include "../include/genome_archive.h"
+#include "../include/wave_renderer.h"
+#include "../include/wav_writer.h"
+#include "../include/trace_events.h"
+
+// offline renderer: decodes every genome of a packed archive through its own WaveFSM and writes it to a WAV file
+// genomes are spread over all cores; each worker streams fixed-size blocks to disk so memory use doesn't depend on song length
+
+typedef AudioGenome _Genome;
+typedef _Genome * _GenomePtr;
+typedef GenomeArchiveReader<_Genome> _GenomeArchiveReader;
+typedef AudioGenome::_WaveDescriptorIterator _WaveDescriptorIterator;
+
+struct RenderJob
+{
+	const _GenomeArchiveReader * archive_;
+	std::string output_prefix_;
+	unsigned int sample_rate_;
+	unsigned int block_size_;
+
+	std::atomic<unsigned long long> next_genome_;
+	std::atomic<unsigned long long> num_frames_rendered_;
+	std::atomic<unsigned int> num_failures_;
+
+	RenderJob( const _GenomeArchiveReader * archive, const std::string & output_prefix, unsigned int sample_rate, unsigned int block_size ) :
+		archive_( archive ), output_prefix_( output_prefix ), sample_rate_( sample_rate ), block_size_( block_size ), next_genome_( 0 ), num_frames_rendered_( 0 ), num_failures_( 0 )
+	{
+		//
+	}
+};
+
+static bool renderGenome( RenderJob & job, unsigned long long index, WaveRenderer & renderer, std::vector<WaveRenderer::_SampleType> & block )
+{
+	ScopedTrace trace( "render", "render", "genome", index );
+
+	_GenomePtr genome = job.archive_->createGenome( index );
+	// every genome is decoded from a fresh state machine so the result doesn't depend on which genomes a worker rendered before
+	AudioGenomeDefs::WaveFSM fsm;
+	{
+		ScopedTrace decode_trace( "decode", "render" );
+		genome->decode( fsm );
+	}
+
+	char filename[32];
+	snprintf( filename, sizeof( filename ), "_%06llu.wav", index );
+
+	// every genome is its own voice
+	renderer.reset();
+
+	WavWriter writer;
+	bool success = writer.open( job.output_prefix_ + filename, job.sample_rate_ );
+
+	for ( _WaveDescriptorIterator wave_it = genome->wave_descriptors.begin(); success && wave_it != genome->wave_descriptors.end(); ++wave_it )
+	{
+		renderer.begin( *wave_it );
+		unsigned int num_frames;
+		while ( success && ( num_frames = renderer.renderBlock( &block[0], job.block_size_ ) ) > 0 )
+		{
+			success = writer.write( &block[0], num_frames );
+		}
+	}
+
+	job.num_frames_rendered_ += writer.numFrames();
+	// the last samples and the header only reach the disk on close
+	success &= writer.close();
+	delete genome;
+	return success;
+}
+
+static void renderWorker( RenderJob * job, unsigned int worker_index )
+{
+	char thread_name[32];
+	snprintf( thread_name, sizeof( thread_name ), "render worker %u", worker_index );
+	TraceLog::instance().setThreadName( thread_name );
+
+	WaveRenderer renderer( WaveRenderer::Descriptor( job->sample_rate_ ) );
+	std::vector<WaveRenderer::_SampleType> block;
+	{
+		MemoryScope memory_scope( MemorySubsystem::audio_buffers );
+		block.resize( job->block_size_ );
+	}
+
+	unsigned long long index;
+	while ( ( index = job->next_genome_++ ) < job->archive_->numGenomes() )
+	{
+		if ( !renderGenome( *job, index, renderer, block ) )
+		{
+			fprintf( stderr, "Failed to render genome %llu\n", index );
+			++job->num_failures_;
+		}
+	}
+}
+
+static void printUsage( const char * program_name )
+{
+	fprintf( stderr, "usage: %s [--threads N] [--sample-rate R] [--bpm B] [--beat-resolution N] [--block-size N] [--trace FILE] [--log-level silent|quiet|normal|verbose] <archive> <output_prefix>\n", program_name );
+}
+
+int main( int argc, char **argv )
+{
+	unsigned int num_threads = std::thread::hardware_concurrency(), sample_rate = 44100, block_size = 4096, cycles_per_beat = 16;
+	float beats_per_minute = 60;
+	const char * trace_filename = NULL;
+	std::vector<std::string> positional;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		const bool has_value = i + 1 < argc;
+		if ( has_value && strcmp( argv[i], "--threads" ) == 0 ) num_threads = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--sample-rate" ) == 0 ) sample_rate = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--block-size" ) == 0 ) block_size = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--bpm" ) == 0 ) beats_per_minute = atof( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--beat-resolution" ) == 0 ) cycles_per_beat = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--trace" ) == 0 ) trace_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--log-level" ) == 0 && flags::io::debug::parseLevel( argv[i + 1] ) >= 0 ) flags::io::debug::setLevel( flags::io::debug::parseLevel( argv[++i] ) );
+		else positional.push_back( argv[i] );
+	}
+
+	if ( positional.size() != 2 || sample_rate == 0 || block_size == 0 || beats_per_minute <= 0 || cycles_per_beat == 0 )
+	{
+		printUsage( argv[0] );
+		return EXIT_FAILURE;
+	}
+	if ( num_threads == 0 ) num_threads = 1;
+
+	// wave durations are quantized to the output sample rate when genomes are decoded
+	AudioGenome::timing = AudioGenomeDefs::Timing( beats_per_minute, cycles_per_beat, sample_rate );
+
+	_GenomeArchiveReader archive;
+	if ( !archive.open( positional[0] ) )
+	{
+		fprintf( stderr, "Failed to open archive %s\n", positional[0].c_str() );
+		return EXIT_FAILURE;
+	}
+
+	RenderJob job( &archive, positional[1], sample_rate, block_size );
+
+	if ( trace_filename && !TraceLog::instance().start( trace_filename ) )
+	{
+		fprintf( stderr, "Failed to open trace file %s\n", trace_filename );
+		return EXIT_FAILURE;
+	}
+
+	const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for ( unsigned int i = 0; i < num_threads; ++i )
+	{
+		workers.push_back( std::thread( renderWorker, &job, i ) );
+	}
+	for ( unsigned int i = 0; i < workers.size(); ++i )
+	{
+		workers[i].join();
+	}
+
+	TraceLog::instance().stop();
+
+	const double elapsed_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start_time ).count();
+	const double audio_seconds = (double) job.num_frames_rendered_ / sample_rate;
+
+	printf( "rendered %llu genomes (%.1f s of audio) in %.3f s on %u threads: %.1fx real time\n", archive.numGenomes(), audio_seconds, elapsed_seconds, num_threads,
+			elapsed_seconds > 0 ? audio_seconds / elapsed_seconds : 0 );
+
+	return job.num_failures_ > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
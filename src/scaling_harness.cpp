@@ -0,0 +1,209 @@
+/*******************************************************************************
+ *
+ *      scaling_harness
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "../include/genetic_process.h"
+#include "../include/audio_genome.h"
+
+// macro benchmark: runs whole generations of GeneticProcess<AudioGenome>::step() for every combination of population size,
+// genome length and thread count, and writes one CSV row per combination
+// every combination runs in its own child process so its peak RSS is its own, and starts from the same seed so rows are
+// comparable between commits; fitness doesn't depend on the thread count, so rows of different thread counts run the same
+// workload
+
+typedef AudioGenome _Genome;
+typedef GeneticProcess<_Genome> _GeneticProcess;
+
+typedef AudioGenomeDefs::_SizeType _SizeType;
+typedef AudioGenomeDefs::_GenomeBase _GenomeBase;
+typedef typename _GenomeBase::_Chromosome _Chromosome;
+
+typedef ProcessMetrics::Phase _Phase;
+
+struct ScalingConfig
+{
+	_SizeType population_size_;
+	_SizeType genome_size_;
+	_SizeType chromosome_size_;
+	unsigned int num_threads_;
+	_SizeType num_generations_;
+	long seed_;
+};
+
+static void printHeader( FILE * file )
+{
+	fprintf( file, "population,genome_size,chromosome_size,threads,generations,seed,init_s,run_s,generations_per_s,ms_per_generation" );
+	for ( _Phase::_Storage phase = 0; phase < _Phase::NUM_PHASES; ++phase )
+		fprintf( file, ",%s_ms", ProcessMetrics::phaseName( phase ) );
+	fprintf( file, ",peak_rss_mb,min_fitness,max_fitness,avg_fitness\n" );
+}
+
+// runs one configuration in the current process and writes its CSV row
+static void runConfig( const ScalingConfig & config, FILE * file )
+{
+	const _GeneticProcess::Descriptor descriptor( config.population_size_, 0.05, config.seed_, _Genome::Descriptor( config.genome_size_, _Chromosome::Descriptor( config.chromosome_size_ ) ),
+			config.num_threads_ );
+	_GeneticProcess process( descriptor );
+
+	const unsigned long long init_start = ProcessMetricsUtil::nowNs();
+	process.initializePopulation();
+	const double init_seconds = ( ProcessMetricsUtil::nowNs() - init_start ) / 1e9;
+
+	const unsigned long long run_start = ProcessMetricsUtil::nowNs();
+	process.step( config.num_generations_ );
+	const double run_seconds = ( ProcessMetricsUtil::nowNs() - run_start ) / 1e9;
+
+	struct rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+
+	const ProcessMetrics & metrics = process.metrics();
+	const _GeneticProcess::PopulationStatistics & stats = process.populationStatistics();
+	const double num_generations = config.num_generations_ > 0 ? config.num_generations_ : 1;
+
+	fprintf( file, "%u,%u,%u,%u,%u,%li,%.6f,%.6f,%.3f,%.4f", config.population_size_, config.genome_size_, config.chromosome_size_, config.num_threads_, config.num_generations_, config.seed_,
+			init_seconds, run_seconds, run_seconds > 0 ? config.num_generations_ / run_seconds : 0, metrics.totalGenerationNs() / 1e6 / num_generations );
+	for ( _Phase::_Storage phase = 0; phase < _Phase::NUM_PHASES; ++phase )
+		fprintf( file, ",%.4f", metrics.totalPhaseNs( phase ) / 1e6 / num_generations );
+	// ru_maxrss is in kilobytes on Linux
+	fprintf( file, ",%.1f,%f,%f,%f\n", usage.ru_maxrss / 1024.0, stats.min_fitness_, stats.max_fitness_, stats.avg_fitness_ );
+	fflush( file );
+}
+
+// runs the configuration in a child process; returns false if the child failed (e.g. ran out of memory)
+static bool runConfigIsolated( const ScalingConfig & config, FILE * file )
+{
+	fflush( file );
+	const pid_t pid = fork();
+	if ( pid < 0 ) return false;
+	if ( pid == 0 )
+	{
+		runConfig( config, file );
+		_exit( EXIT_SUCCESS );
+	}
+
+	int status = 0;
+	if ( waitpid( pid, &status, 0 ) < 0 ) return false;
+	return WIFEXITED( status ) && WEXITSTATUS( status ) == EXIT_SUCCESS;
+}
+
+static std::vector<unsigned int> parseList( const char * text )
+{
+	std::vector<unsigned int> values;
+	const char * current = text;
+	while ( *current )
+	{
+		char * end;
+		const double value = strtod( current, &end );
+		if ( end == current ) break;
+		values.push_back( (unsigned int) value );
+		current = *end == ',' ? end + 1 : end;
+	}
+	return values;
+}
+
+static void printUsage( const char * program_name )
+{
+	fprintf( stderr, "usage: %s [--populations N,N,..] [--genome-sizes N,N,..] [--chromosome-size N] [--threads N,N,..] [--generations N] [--seed S] [--output FILE]\n", program_name );
+	fprintf( stderr, "  lists accept scientific notation, e.g. --populations 1e2,1e4,1e6\n" );
+}
+
+int main( int argc, char **argv )
+{
+	std::vector<unsigned int> population_sizes = parseList( "100,1000,10000" );
+	std::vector<unsigned int> genome_sizes = parseList( "64" );
+	std::vector<unsigned int> thread_counts = parseList( "1,2,4" );
+	_SizeType chromosome_size = 1, num_generations = 20;
+	long seed = 1;
+	const char * output_filename = NULL;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		const bool has_value = i + 1 < argc;
+		if ( has_value && strcmp( argv[i], "--populations" ) == 0 ) population_sizes = parseList( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--genome-sizes" ) == 0 ) genome_sizes = parseList( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--threads" ) == 0 ) thread_counts = parseList( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--chromosome-size" ) == 0 ) chromosome_size = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--generations" ) == 0 ) num_generations = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--seed" ) == 0 ) seed = atol( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--output" ) == 0 ) output_filename = argv[++i];
+		else
+		{
+			printUsage( argv[0] );
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ( population_sizes.empty() || genome_sizes.empty() || thread_counts.empty() || chromosome_size == 0 )
+	{
+		printUsage( argv[0] );
+		return EXIT_FAILURE;
+	}
+
+	FILE * file = output_filename ? fopen( output_filename, "w" ) : stdout;
+	if ( !file )
+	{
+		fprintf( stderr, "Failed to open %s\n", output_filename );
+		return EXIT_FAILURE;
+	}
+
+	// the per-generation statistics would otherwise swamp the CSV (and the timings)
+	flags::io::debug::setLevel( flags::io::debug::SILENT );
+
+	printHeader( file );
+
+	unsigned int num_failures = 0;
+	for ( unsigned int p = 0; p < population_sizes.size(); ++p )
+		for ( unsigned int g = 0; g < genome_sizes.size(); ++g )
+			for ( unsigned int t = 0; t < thread_counts.size(); ++t )
+			{
+				const ScalingConfig config = { population_sizes[p], genome_sizes[g], chromosome_size, thread_counts[t] > 0 ? thread_counts[t] : 1, num_generations, seed };
+				if ( config.population_size_ < 2 || config.genome_size_ == 0 ) continue;
+				if ( !runConfigIsolated( config, file ) )
+				{
+					fprintf( stderr, "population %u, genome size %u, %u threads failed\n", config.population_size_, config.genome_size_, config.num_threads_ );
+					++num_failures;
+				}
+			}
+
+	if ( file != stdout ) fclose( file );
+	return num_failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
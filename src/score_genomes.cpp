@@ -0,0 +1,276 @@
+/*******************************************************************************
+ *
+ *      score_genomes
+ * 
+ *      Copyright (c) 2011, edward
+ *      All rights reserved.
+ *
+ *      Redistribution and use in source and binary forms, with or without
+ *      modification, are permitted provided that the following conditions are
+ *      met:
+ *      
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following disclaimer
+ *        in the documentation and/or other materials provided with the
+ *        distribution.
+ *      * Neither the name of "Chromosound" nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *      
+ *      THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *      "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *      LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *      A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *      OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *      SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *      LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *      DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *      THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *      (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *      OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../include/audio_genome.h"
+#include "../include/genome_archive.h"
+#include "../include/trace_events.h"
+
+// batch scorer: re-evaluates every genome of a packed archive with the current fitness function and writes the results to a
+// fitness file that parallels the archive
+// workers claim chunks of records, decode each genome through its own WaveFSM and write their results straight to their place
+// in the output; finished chunks are dropped from the mapping, so memory use doesn't depend on the size of the archive
+//
+// fitness file:
+//   char[8]  magic "CSFITNES"
+//   uint32   version
+//   uint32   reserved
+//   uint64   number of genomes (the archive's)
+//   double[] fitness of each genome, in archive order
+
+typedef AudioGenome _Genome;
+typedef _Genome * _GenomePtr;
+typedef GenomeArchiveReader<_Genome> _GenomeArchiveReader;
+
+namespace FitnessFileDefs
+{
+	const static char MAGIC[8] = { 'C', 'S', 'F', 'I', 'T', 'N', 'E', 'S' };
+	const static unsigned int VERSION = 1;
+
+	struct Header
+	{
+		char magic_[8];
+		unsigned int version_;
+		unsigned int reserved_;
+		unsigned long long num_genomes_;
+	};
+}
+
+struct ScoreJob
+{
+	const _GenomeArchiveReader * archive_;
+	int output_fd_;
+	unsigned int chunk_size_;
+
+	std::atomic<unsigned long long> next_chunk_;
+	std::atomic<unsigned int> num_failures_;
+
+	ScoreJob( const _GenomeArchiveReader * archive, int output_fd, unsigned int chunk_size ) :
+		archive_( archive ), output_fd_( output_fd ), chunk_size_( chunk_size ), next_chunk_( 0 ), num_failures_( 0 )
+	{
+		//
+	}
+};
+
+struct ScoreSummary
+{
+	unsigned long long num_scored_;
+	double min_fitness_;
+	double max_fitness_;
+	double total_fitness_;
+
+	ScoreSummary() :
+		num_scored_( 0 ), min_fitness_( 0 ), max_fitness_( 0 ), total_fitness_( 0 )
+	{
+		//
+	}
+
+	void add( double fitness )
+	{
+		if ( num_scored_ == 0 || fitness < min_fitness_ ) min_fitness_ = fitness;
+		if ( num_scored_ == 0 || fitness > max_fitness_ ) max_fitness_ = fitness;
+		total_fitness_ += fitness;
+		++num_scored_;
+	}
+
+	void merge( const ScoreSummary & other )
+	{
+		if ( other.num_scored_ == 0 ) return;
+		if ( num_scored_ == 0 || other.min_fitness_ < min_fitness_ ) min_fitness_ = other.min_fitness_;
+		if ( num_scored_ == 0 || other.max_fitness_ > max_fitness_ ) max_fitness_ = other.max_fitness_;
+		total_fitness_ += other.total_fitness_;
+		num_scored_ += other.num_scored_;
+	}
+};
+
+static bool writeFully( int fd, const void * data, size_t size, off_t offset )
+{
+	const char * bytes = (const char *) data;
+	while ( size > 0 )
+	{
+		const ssize_t written = pwrite( fd, bytes, size, offset );
+		if ( written <= 0 ) return false;
+		bytes += written;
+		size -= written;
+		offset += written;
+	}
+	return true;
+}
+
+static void scoreWorker( ScoreJob * job, unsigned int worker_index, ScoreSummary * summary )
+{
+	char thread_name[32];
+	snprintf( thread_name, sizeof( thread_name ), "score worker %u", worker_index );
+	TraceLog::instance().setThreadName( thread_name );
+
+	const unsigned long long num_genomes = job->archive_->numGenomes();
+	std::vector<double> results( job->chunk_size_ );
+
+	unsigned long long chunk;
+	while ( ( chunk = job->next_chunk_++ ) * job->chunk_size_ < num_genomes )
+	{
+		const unsigned long long first = chunk * job->chunk_size_;
+		const unsigned long long count = std::min<unsigned long long>( job->chunk_size_, num_genomes - first );
+		ScopedTrace trace( "score", "score", "first", first );
+
+		for ( unsigned long long i = 0; i < count; ++i )
+		{
+			_GenomePtr genome = job->archive_->createGenome( first + i );
+			// a fresh state machine per genome, so the score doesn't depend on what the worker scored before
+			AudioGenomeDefs::WaveFSM fsm;
+			results[i] = genome->decode( fsm );
+			summary->add( results[i] );
+			delete genome;
+		}
+
+		if ( !writeFully( job->output_fd_, &results[0], count * sizeof( double ), sizeof( FitnessFileDefs::Header ) + first * sizeof( double ) ) )
+		{
+			fprintf( stderr, "Failed to write scores %llu-%llu\n", first, first + count - 1 );
+			++job->num_failures_;
+		}
+		job->archive_->release( first, count );
+	}
+}
+
+static void printUsage( const char * program_name )
+{
+	fprintf( stderr, "usage: %s [--threads N] [--sample-rate R] [--bpm B] [--beat-resolution N] [--chunk-size N] [--trace FILE] [--log-level silent|quiet|normal|verbose] <archive> <output>\n",
+			program_name );
+}
+
+int main( int argc, char **argv )
+{
+	unsigned int num_threads = std::thread::hardware_concurrency(), sample_rate = 44100, chunk_size = 1024, cycles_per_beat = 16;
+	float beats_per_minute = 60;
+	const char * trace_filename = NULL;
+	std::vector<std::string> positional;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		const bool has_value = i + 1 < argc;
+		if ( has_value && strcmp( argv[i], "--threads" ) == 0 ) num_threads = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--sample-rate" ) == 0 ) sample_rate = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--chunk-size" ) == 0 ) chunk_size = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--bpm" ) == 0 ) beats_per_minute = atof( argv[++i] );
+		else if ( has_value && strcmp( argv[i], "--beat-resolution" ) == 0 ) cycles_per_beat = strtoul( argv[++i], NULL, 10 );
+		else if ( has_value && strcmp( argv[i], "--trace" ) == 0 ) trace_filename = argv[++i];
+		else if ( has_value && strcmp( argv[i], "--log-level" ) == 0 && flags::io::debug::parseLevel( argv[i + 1] ) >= 0 ) flags::io::debug::setLevel( flags::io::debug::parseLevel( argv[++i] ) );
+		else positional.push_back( argv[i] );
+	}
+
+	if ( positional.size() != 2 || sample_rate == 0 || chunk_size == 0 || beats_per_minute <= 0 || cycles_per_beat == 0 )
+	{
+		printUsage( argv[0] );
+		return EXIT_FAILURE;
+	}
+	if ( num_threads == 0 ) num_threads = 1;
+
+	// only the timing is matched to the batch run here; the scores are the raw fitness of each genome on its own, which differs
+	// from the fitness an archive stores wherever the run reshaped it (novelty search, fitness sharing) or decoded differently
+	AudioGenome::timing = AudioGenomeDefs::Timing( beats_per_minute, cycles_per_beat, sample_rate );
+
+	_GenomeArchiveReader archive;
+	if ( !archive.open( positional[0] ) )
+	{
+		fprintf( stderr, "Failed to open archive %s\n", positional[0].c_str() );
+		return EXIT_FAILURE;
+	}
+
+	// the header is written up front and the file sized to its final length, so workers can fill it in any order
+	const std::string temp_filename = positional[1] + ".tmp";
+	const int output_fd = open( temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	FitnessFileDefs::Header header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic_, FitnessFileDefs::MAGIC, sizeof( header.magic_ ) );
+	header.version_ = FitnessFileDefs::VERSION;
+	header.num_genomes_ = archive.numGenomes();
+	if ( output_fd < 0 || !writeFully( output_fd, &header, sizeof( header ), 0 ) || ftruncate( output_fd, sizeof( header ) + header.num_genomes_ * sizeof( double ) ) != 0 )
+	{
+		fprintf( stderr, "Failed to create %s\n", temp_filename.c_str() );
+		return EXIT_FAILURE;
+	}
+
+	ScoreJob job( &archive, output_fd, chunk_size );
+
+	if ( trace_filename && !TraceLog::instance().start( trace_filename ) )
+	{
+		fprintf( stderr, "Failed to open trace file %s\n", trace_filename );
+		return EXIT_FAILURE;
+	}
+
+	const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+	std::vector<ScoreSummary> summaries( num_threads );
+	std::vector<std::thread> workers;
+	for ( unsigned int i = 0; i < num_threads; ++i )
+	{
+		workers.push_back( std::thread( scoreWorker, &job, i, &summaries[i] ) );
+	}
+	ScoreSummary summary;
+	for ( unsigned int i = 0; i < workers.size(); ++i )
+	{
+		workers[i].join();
+		summary.merge( summaries[i] );
+	}
+
+	TraceLog::instance().stop();
+
+	// only replace an earlier output once every score is in
+	if ( fsync( output_fd ) != 0 ) ++job.num_failures_;
+	close( output_fd );
+	if ( job.num_failures_ > 0 || rename( temp_filename.c_str(), positional[1].c_str() ) != 0 )
+	{
+		fprintf( stderr, "Failed to write %s\n", positional[1].c_str() );
+		unlink( temp_filename.c_str() );
+		return EXIT_FAILURE;
+	}
+
+	const double elapsed_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start_time ).count();
+	printf( "scored %llu genomes in %.3f s on %u threads: %.0f genomes/s min: %f max: %f avg: %f\n", summary.num_scored_, elapsed_seconds, num_threads,
+			elapsed_seconds > 0 ? summary.num_scored_ / elapsed_seconds : 0, summary.min_fitness_, summary.max_fitness_,
+			summary.num_scored_ > 0 ? summary.total_fitness_ / summary.num_scored_ : 0 );
+
+	return EXIT_SUCCESS;
+}
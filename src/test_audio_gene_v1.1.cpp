@@ -40,12 +40,19 @@
 #include <sstream>
 #include <time.h>
 #include <math.h>
+#include <unistd.h>
 #include <iostream>
 #include <typeinfo>
 
 #include "../include/genetic_process.h"
 #include "../include/audio_genome.h"
-#include "../include/alut_util.h"
+#include "../include/lookahead_scheduler.h"
+#include "../include/wave_renderer.h"
+#include "../include/audio_mixer.h"
+#include "../include/audio_output.h"
+#include "../include/openal_output.h"
+#include "../include/playback_metrics.h"
+#include "../include/trace_events.h"
 #include <time.h>
 
 //up to 1/(2^4) second beat resolution
@@ -57,7 +64,6 @@
 // then we have 4*16 potential beat-start combinations
 // #define num_beats 4 * 16
 
-ALuint sound_source_;
 ALenum shape_ = ALUT_WAVEFORM_SINE;
 ALfloat frequency_ = 1000;
 ALfloat phase_ = 0.0f;
@@ -87,38 +93,118 @@ typedef typename _GenomeBase::_Chromosome _Chromosome;
 typedef typename _GenomeBase::_ChromosomePtr _ChromosomePtr;
 typedef typename _AudioGenome::_WaveDescriptorIterator _WaveDescriptorIterator;
 
-unsigned int loadPopulationIntoBuffer( _PopulationVector population )
+// each individual in a generation is one voice: the sequence of waves its genome decodes to
+typedef std::vector<_WaveDescriptor> _Voice;
+typedef std::vector<_Voice> _VoiceVector;
+
+struct Generation
 {
-	unsigned int num_buffers = 0;
-	// queue up (starting at the front) our rotating queue of file buffers
-	for ( _PopulationIterator population_it = population.begin(); population_it != population.end(); ++population_it )
+	unsigned int index_;
+	_VoiceVector voices_;
+};
+
+typedef Generation _Generation;
+typedef LookaheadScheduler<_Generation> _LookaheadScheduler;
+
+// samples per channel in every buffer handed to the output
+const unsigned int buffer_frames = 4096;
+
+// snapshot the wave descriptors of the whole population so they survive the next call to step()
+_Generation collectVoices( const _PopulationVector & population, unsigned int index )
+{
+	_Generation generation;
+	generation.index_ = index;
+	for ( typename _PopulationVector::const_iterator population_it = population.begin(); population_it != population.end(); ++population_it )
 	{
 		_GenomePtr current_genome = *population_it;
-		num_buffers += current_genome->wave_descriptors.size();
-		// printf( "number of wave descriptors: %zu\n", current_genome->wave_descriptors.size() );
-		for ( _WaveDescriptorIterator wave_descriptor_it = current_genome->wave_descriptors.begin(); wave_descriptor_it != current_genome->wave_descriptors.end(); ++wave_descriptor_it )
+		generation.voices_.push_back( current_genome->wave_descriptors );
+	}
+	return generation;
+}
+
+float getVoiceMs( const _Voice & voice )
+{
+	float total_ms = 0;
+	for ( typename _Voice::const_iterator it = voice.begin(); it != voice.end(); ++it )
+	{
+		total_ms += 1000 * it->duration;
+	}
+	return total_ms;
+}
+
+// how long a generation plays for when num_voices individuals are auditioned at once
+float getGenerationMs( const _Generation & generation, unsigned int num_voices )
+{
+	float total_ms = 0;
+	for ( unsigned int i = 0; i < generation.voices_.size(); i += num_voices )
+	{
+		float group_ms = 0;
+		for ( unsigned int j = i; j < i + num_voices && j < generation.voices_.size(); ++j )
 		{
-			_WaveDescriptor current_descriptor = *wave_descriptor_it;
-			// every gene advances our "clock" 1/16 of a beat
-			// the wave state is updated first
-			// if we've reached a commit bit, the buffer for the wave is generated and queued
-			// if our note duration has expired, we go silent (queue silent wave buffer)
+			const float voice_ms = getVoiceMs( generation.voices_[j] );
+			if ( voice_ms > group_ms ) group_ms = voice_ms;
+		}
+		total_ms += group_ms;
+	}
+	return total_ms;
+}
 
-			if ( current_descriptor.type == 1 )
-			{
-				printf( "Creating sound clip: %f %f\n", current_descriptor.frequency, current_descriptor.duration );
-			}
-			else
+unsigned int loadGenerationIntoBuffer( const _Generation & generation, unsigned int num_voices, AudioMixer & mixer, AudioOutput & output, _LookaheadScheduler & scheduler,
+		PlaybackMetrics & metrics )
+{
+	const unsigned int num_channels = mixer.descriptor().num_channels_;
+	const unsigned int sample_rate = mixer.descriptor().voice_descriptor_.sample_rate_;
+	MemoryScope memory_scope( MemorySubsystem::audio_buffers );
+	std::vector<AudioMixer::_SampleType> samples( buffer_frames * num_channels );
+
+	unsigned int num_buffers = 0;
+	for ( unsigned int i = 0; i < generation.voices_.size(); i += num_voices )
+	{
+		// audition the next num_voices individuals together, spread evenly across the stereo field
+		for ( unsigned int j = i; j < i + num_voices && j < generation.voices_.size(); ++j )
+		{
+			const float pan = num_voices > 1 ? -1 + 2.0f * ( j - i ) / ( num_voices - 1 ) : 0;
+			mixer.addVoice( generation.voices_[j], 1 / sqrt( (float) num_voices ), pan );
+		}
+		__DEBUG__NORMAL__ logPrintf( "Mixing individuals %u-%u\n", i, i + mixer.numVoices() - 1 );
+
+		while ( true )
+		{
+			// the clock is only read while tracing
+			const bool tracing = TraceLog::enabled();
+			unsigned long long trace_start = tracing ? TraceEventsUtil::nowNs() : 0;
+			const unsigned int num_frames = mixer.mix( &samples[0], buffer_frames );
+			if ( num_frames == 0 ) break;
+			if ( tracing ) TraceLog::instance().complete( "render", "audio", trace_start, TraceEventsUtil::nowNs(), "generation", generation.index_ );
+			metrics.generationRendered( generation.index_ );
+
+			if ( tracing ) trace_start = TraceEventsUtil::nowNs();
+			const unsigned long num_buffers_before = output.numBuffersQueued();
+			if ( !output.queueBuffer( &samples[0], num_frames ) )
 			{
-				printf( "Creating silent clip: %f %f\n", current_descriptor.frequency, current_descriptor.duration );
+				fprintf( stderr, "Failed to queue buffer on %s output\n", output.name().c_str() );
+				exit( EXIT_FAILURE );
 			}
-			alutCheckAndQueueBuffer( sound_source_, alutCreateBufferWaveform( current_descriptor.wave_type, current_descriptor.frequency, current_descriptor.phase, current_descriptor.duration ) );
-
+			if ( tracing ) TraceLog::instance().complete( "enqueue", "audio", trace_start, TraceEventsUtil::nowNs(), "generation", generation.index_ );
+			metrics.generationEnqueued( generation.index_, num_buffers_before );
+			scheduler.bufferQueued( 1000.0f * num_frames / sample_rate );
+			++num_buffers;
 		}
 	}
+	// a generation without any audio counts as played as soon as everything before it has been
+	if ( num_buffers == 0 ) metrics.generationEnqueued( generation.index_, output.numBuffersQueued() );
 	return num_buffers;
 }
 
+// "openal" (default), "null" or "wav:<filename>"
+AudioOutput * createAudioOutput( const std::string & spec )
+{
+	if ( spec == "openal" ) return new OpenALAudioOutput();
+	if ( spec == "null" ) return new NullAudioOutput();
+	if ( spec.compare( 0, 4, "wav:" ) == 0 && spec.size() > 4 ) return new WavFileAudioOutput( spec.substr( 4 ) );
+	return NULL;
+}
+
 // enables printing of custom states
 /*namespace GeneticProcessUtil
 {
@@ -144,57 +230,94 @@ int main( int argc, char **argv )
 
 	_GeneticProcess::Descriptor descriptor( population_size, mutation_rate, rand_seed, _Genome::Descriptor( genome_size, _Chromosome::Descriptor( chromosome_size ) ) );
 
+	// usage: [output] [number of individuals to play simultaneously] [sample rate] [beats per minute] [trace file]
+	// set CHROMOSOUND_LOG_LEVEL (silent, quiet, normal or verbose) for more or less output
+	const std::string output_spec = argc > 1 ? argv[1] : "openal";
+	const unsigned int num_voices = argc > 2 && atoi( argv[2] ) > 0 ? atoi( argv[2] ) : 1;
+	const unsigned int sample_rate = argc > 3 && atoi( argv[3] ) > 0 ? atoi( argv[3] ) : 44100;
+	const float beats_per_minute = argc > 4 && atof( argv[4] ) > 0 ? atof( argv[4] ) : 60;
+
+	// optional timeline of the genetic process and the audio path, for chrome://tracing or Perfetto
+	if ( argc > 5 && !TraceLog::instance().start( argv[5] ) )
+	{
+		fprintf( stderr, "Failed to open trace file %s\n", argv[5] );
+		return EXIT_FAILURE;
+	}
+	TraceLog::instance().setThreadName( "main" );
+
+	// every genome is decoded with this tempo, so set it before the first evaluation
+	AudioGenome::timing = AudioGenomeDefs::Timing( beats_per_minute, 16, sample_rate );
+
 	_GeneticProcess process( descriptor );
 
 	process.initializePopulation();
 	process.printPopulation();
 
-	if ( !alutInit( &argc, argv ) ) alutReportError();
+	AudioOutput * output = createAudioOutput( output_spec );
+	if ( !output )
+	{
+		fprintf( stderr, "Unknown output %s; expected openal, null or wav:<filename>\n", output_spec.c_str() );
+		return EXIT_FAILURE;
+	}
 
-	alGenSources( 1, &sound_source_ );
+	// a single voice plays the population serially in mono; several voices are mixed into stereo
+	AudioMixer mixer( AudioMixer::Descriptor( num_voices > 1 ? 2 : 1, WaveRenderer::Descriptor( sample_rate ) ) );
+	if ( !output->open( AudioFormat( mixer.descriptor().voice_descriptor_.sample_rate_, mixer.descriptor().num_channels_ ) ) ) return EXIT_FAILURE;
 
-	loadPopulationIntoBuffer( process.population() );
+	// keep between 1s and 4s of audio ahead of the listener; evolve up to 4 generations ahead of the audio queue
+	_LookaheadScheduler scheduler( _LookaheadScheduler::Descriptor( 1000, 4000, 4 ) );
 
-	process.step();
-	process.printPopulation();
+	// follows each generation from evaluation to playback, and the output queue over time
+	PlaybackMetrics metrics;
 
-	_SizeType generation_counter = 0;
+	metrics.generationEvaluated( 0 );
+	_Generation generation = collectVoices( process.population(), 0 );
+	scheduler.pushGeneration( generation, getGenerationMs( generation, num_voices ) );
+	loadGenerationIntoBuffer( scheduler.popGeneration(), num_voices, mixer, *output, scheduler, metrics );
 
-	alSourcePlay( sound_source_ );
-	int num_buffers_processed, num_buffers_queued;
+	_SizeType generation_counter = 0;
+	const _SizeType max_generations = 20;
 
 	do
 	{
-		alGetSourcei( sound_source_, AL_BUFFERS_PROCESSED, &num_buffers_processed );
-		alGetSourcei( sound_source_, AL_BUFFERS_QUEUED, &num_buffers_queued );
-
-		printf( "%i/%i:%u\n", num_buffers_processed, num_buffers_queued, generation_counter );
-
-		// each time we process a buffer, unqueue the most recently processed buffer
-		// and queue up the buffer for the next item in the filenames list
-		if ( num_buffers_processed > 0 )
+		// each time buffers finish playing, the output releases them and we stop counting them as lookahead
+		const unsigned int num_buffers_processed = output->update();
+		scheduler.buffersPlayed( num_buffers_processed );
+		metrics.buffersPlayed( num_buffers_processed );
+		// only a real-time output can run dry while we still have audio to give it
+		metrics.sampleQueue( scheduler.queuedMs(), output->isRealTime() && ( scheduler.numPendingGenerations() > 0 || generation_counter < max_generations ) );
+		metrics.outputUnderruns( output->numUnderruns() );
+		TraceLog::instance().counter( "queued_ms", scheduler.queuedMs() );
+
+		__DEBUG__NORMAL__ logPrintf( "%u/%u:%u %.0fms queued, %.0fms pending\n", num_buffers_processed, scheduler.numQueuedBuffers(), generation_counter, scheduler.queuedMs(), scheduler.pendingMs() );
+
+		// hand over any generation whose turn has come
+		while ( scheduler.hasReadyGeneration() )
 		{
-			// unload the front buffer
-			ALuint buffer[num_buffers_processed];
-			alSourceUnqueueBuffers( sound_source_, num_buffers_processed, &buffer[0] );
-
-			// delete this buffer since we can't reuse them nicely
-			alDeleteBuffers( num_buffers_processed, &buffer[0] );
-
-			// add the next file to the queue
-			// checkAndQueueBuffer( createBufferFromFile( filenames_.getFrontAdvance() ) );
+			loadGenerationIntoBuffer( scheduler.popGeneration(), num_voices, mixer, *output, scheduler, metrics );
+		}
 
-			if ( num_buffers_queued <= 50 )
-			{
-				++generation_counter;
-				loadPopulationIntoBuffer( process.step() );
-				//process.printPopulation();
-			}
+		// evolve ahead of the audio, as far as the high watermark allows
+		if ( scheduler.wantsGeneration() && generation_counter < max_generations )
+		{
+			++generation_counter;
+			generation = collectVoices( process.step(), generation_counter );
+			metrics.generationEvaluated( generation_counter );
+			scheduler.pushGeneration( generation, getGenerationMs( generation, num_voices ) );
+			//process.printPopulation();
+			continue;
 		}
 
-		alutSleep( 1 );
+		// non-real-time outputs consume audio as fast as we can produce it
+		if ( output->isRealTime() ) usleep( 1000 * scheduler.getPollIntervalMs() );
 	}
-	while ( num_buffers_queued > 0 && generation_counter < 20 );
+	while ( scheduler.numQueuedBuffers() > 0 || scheduler.numPendingGenerations() > 0 || generation_counter < max_generations );
+
+	AsyncLog::instance().flush();
+	printf( "%s output: %lu buffers, %.2f seconds of audio\n", output->name().c_str(), output->numBuffersQueued(), output->secondsQueued() );
+	metrics.outputUnderruns( output->numUnderruns() );
+	metrics.print( stdout );
+	TraceLog::instance().stop();
 
 	process.evaluatePopulation();
 
@@ -202,9 +325,8 @@ int main( int argc, char **argv )
 
 	process.evaluatePopulation();
 
-	if ( !alutExit() )
-	{
-		alutReportError();
-	}
+	output->close();
+	delete output;
+
 	return EXIT_SUCCESS;
 }